@@ -21,8 +21,19 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <math.h>
+#include <time.h>
 #include "starfish-engine.h"
+// Only with STARFISH_TRACE does the engine need starfish-trace.cpp; the
+// Mac projects build it alone.
+#if STARFISH_TRACE
+#include "starfish-trace.h"
+#else
+static inline double StarfishTraceClock( void ) { return 0; }
+static inline void StarfishTraceSpan( const char*, const char*, double, const char*, long, const char*, long ) {}
+#endif
 
 #if BUILD_ALTIVEC
 #include "starfish-altivec.h"
@@ -41,6 +52,10 @@ bool			gUseAltivec;
 #undef assert
 #endif
 
+#if defined( __i386__ ) || defined( __x86_64__ )
+#include <x86intrin.h>
+#endif
+
 #define assert(cond) do { if (!(cond)) {printf("failed assertion: %s, %d", __FILE__, __LINE__ ); die_nicely();} } while (0) 
 
 
@@ -66,6 +81,23 @@ inline float max( float a, float b )
 	return a>b ? a : b;
 	}
 
+// The processor's time-stamp counter, where it has one we can read.
+#if defined( __i386__ ) || defined( __x86_64__ )
+static const bool kHaveCycleCount = true;
+
+static inline unsigned long long CycleCount( void )
+	{
+	return __rdtsc();
+	}
+#else
+static const bool kHaveCycleCount = false;
+
+static inline unsigned long long CycleCount( void )
+	{
+	return 0;
+	}
+#endif
+
 #ifndef __CARBON__
 const double pi = 3.1415926535898;				// This is defined in OS X in fp.h
 #endif
@@ -76,8 +108,143 @@ const double halfpiRecip = 1.0 / halfpi;
 
 #pragma mark -
 
+#pragma mark class StarfishNode
+/*
+Everything in a pattern's tree is a node. A node that owns other nodes
+lists them from Children, so the tree can be walked without knowing what
+kind of node is where; Kind and Genes say what a node is and carry its
+parameters to and from a genome (see GeneCoder). Nodes with continuous parameters can move them
+with Animate, where phase runs from 0 to 1 around a closed loop: phase 0
+and phase 1 are both the pattern as it was made.
+*/
+const int kMaxChildren = 3;
+
+#if STARFISH_PROFILE
+struct NodeProfile;
+#endif
+
+class StarfishNode
+	{
+	public:
+		virtual ~StarfishNode() {}
+		virtual int Children( StarfishNode** out ) const { return 0; }
+		virtual void Animate( float phase ) {}
+		virtual int Kind() const = 0;
+		virtual void Genes( class GeneCoder& genes ) = 0;
+#if STARFISH_PROFILE
+		virtual const NodeProfile* Profile() const { return NULL; }
+#endif
+	};
+
+#pragma mark class GeneCoder
+/*
+A pattern's genome is its tree of nodes with every node's parameters,
+written out in prefix order: each node's kind, its parameters, then its
+children in the order Children lists them. Each kind of node has one
+Genes method which hands its parameters and children to a GeneCoder in
+that order; the same method saves a node and, on a node made blank,
+loads it. Kinds are numbered for good: add new ones at the end of their
+group and never reuse a number.
+*/
+enum NodeKind
+	{
+	kCoswave,
+	kSawtooth,
+	kEss,
+	kInvertWave,
+	kInsertWavePeaks,
+	kModulator,
+	kMixLinear,
+	kMinimaxLinear,
+	kMultiplyLinear,
+	kGammaLinear,
+	kPebbledrop,
+	kCurtain,
+	kZigzag,
+	kStarfish,
+	kSpinflake,
+	kInvertPlane,
+	kMinimaxPlanar,
+	kMixPlanar,
+	kWarpPlane,
+	kReflector,
+	kGammaPlanar,
+	kMultiplyPlanar,
+	kQuadratesselator,
+	kHexatesselator,
+	kRotawarp,
+	kMixmaster,
+	kGradientor,
+	kCompositor,
+	kAntialiasImage,
+	kNodeKinds,
+	kFirstLinear = kCoswave,
+	kFirstPlanar = kPebbledrop,
+	kFirstImage = kGradientor
+	};
+
+enum Blank { kBlank };
+#if STARFISH_PROFILE
+enum Instrument { kInstrument };
+#endif
+
+class LinearWave;
+class PlanarWave;
+class ImageLayer;
+
+class GeneCoder
+	{
+	public:
+		GeneCoder( int format, unsigned char* buffer, long size );
+		GeneCoder( const unsigned char* data, long size );
+#if STARFISH_PROFILE
+		GeneCoder( Instrument );
+#endif
+		bool Loading() const { return mLoading; }
+		bool Failed() const { return mFailed; }
+		long Length() const { return mLength; }
+		void Header( bool& wrapEdges );
+		void Float( float& value );
+		void Flag( bool& value );
+		void Number( int& value, int limit );
+		void Colour( pixel& value );
+		void Linear( LinearWave*& node );
+		void Planar( PlanarWave*& node );
+		void Image( ImageLayer*& node );
+		void End( void );
+	private:
+		StarfishNode* Node( StarfishNode* node, int first, int limit );
+		void Put( const void* bytes, long count );
+		void Print( const char* text );
+		bool Get( void* bytes, long count );
+		bool Token( char* out, int size );
+		bool mLoading;
+		bool mText;
+		bool mFailed;
+		unsigned char* mOut;
+		long mRoom;
+		long mLength;
+		const unsigned char* mIn;
+		long mLeft;
+		int mDepth;
+#if STARFISH_PROFILE
+		bool mInstrumenting;
+#endif
+	};
+
+static void AnimateTree( StarfishNode* node, float phase )
+	{
+	StarfishNode* children[ kMaxChildren ];
+	int count = node->Children( children );
+	node->Animate( phase );
+	for( int i = 0; i < count; i++ )
+		{
+		AnimateTree( children[ i ], phase );
+		}
+	}
+
 #pragma mark class LinearWave
-class LinearWave
+class LinearWave : public StarfishNode
 	{
 	public:
 		virtual float Value( float d ) const = 0;
@@ -100,7 +267,7 @@ class LinearWave
 	};
 
 #pragma mark class PlanarWave
-class PlanarWave
+class PlanarWave : public StarfishNode
 	{
 	public:
 		virtual float Value( float x, float y ) const = 0;
@@ -125,7 +292,7 @@ class PlanarWave
 
 #pragma mark -
 #pragma mark class ImageLayer
-class ImageLayer
+class ImageLayer : public StarfishNode
 	{
 	public:
 		virtual pixel Value( float x, float y ) const = 0;
@@ -170,7 +337,31 @@ class Coswave : public LinearWave
 			// large values so we need to bias the random value
 			// toward the low end.
 			mPeriod = pi / pow( rnd(), 0.5 );
+			mRestPhase = mPhase;
 
+#if BUILD_ALTIVEC
+			if (gUseAltivec) Init_AV();
+#endif
+			}
+		Coswave( Blank ) {}
+		int Kind() const { return kCoswave; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mPeriod );
+			genes.Float( mRestPhase );
+			if( genes.Loading() )
+				{
+				mPhase = mRestPhase;
+#if BUILD_ALTIVEC
+				if (gUseAltivec) Init_AV();
+#endif
+				}
+			}
+//-----------------------------------------------------------------------------
+		void Animate( float phase )
+			{
+			// The wave rolls along by one whole period per loop.
+			mPhase = mRestPhase + phase * twopi;
 #if BUILD_ALTIVEC
 			if (gUseAltivec) Init_AV();
 #endif
@@ -197,6 +388,7 @@ class Coswave : public LinearWave
 	protected:
 		float mPeriod;
 		float mPhase;
+		float mRestPhase;
 #if BUILD_ALTIVEC
 		vector float mPeriodV, mPhaseV;
 #endif
@@ -219,6 +411,17 @@ class Sawtooth : public LinearWave
 
 #if BUILD_ALTIVEC
 			if (gUseAltivec) Init_AV();
+#endif
+			}
+		Sawtooth( Blank ) {}
+		int Kind() const { return kSawtooth; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mPeriod );
+			genes.Float( mPhase );
+			genes.Float( mFlipSign );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
 #endif
 			}
 //-----------------------------------------------------------------------------
@@ -281,6 +484,16 @@ class Ess : public LinearWave
 
 #if BUILD_ALTIVEC
 			if (gUseAltivec) Init_AV();
+#endif
+			}
+		Ess( Blank ) {}
+		int Kind() const { return kEss; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mAcceleration );
+			genes.Float( mSignflip );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
 #endif
 			}
 //-----------------------------------------------------------------------------
@@ -324,6 +537,17 @@ class InvertWave : public LinearWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		InvertWave( Blank ) {}
+		int Kind() const { return kInvertWave; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Linear( mSource );
+			}
 //-----------------------------------------------------------------------------
 		float Value(float d) const
 			{
@@ -359,6 +583,22 @@ class InsertWavePeaks : public LinearWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		InsertWavePeaks( Blank ) {}
+		int Kind() const { return kInsertWavePeaks; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mScale );
+			genes.Flag( mProcessSign );
+			genes.Linear( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value(float d) const
 			{
@@ -435,6 +675,19 @@ class Modulator : public LinearWave
 			delete mSource;
 			delete mWobbler;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			out[ 1 ] = mWobbler;
+			return 2;
+			}
+		Modulator( Blank ) {}
+		int Kind() const { return kModulator; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Linear( mSource );
+			genes.Linear( mWobbler );
+			}
 //-----------------------------------------------------------------------------
 		float Value( float d ) const
 			{
@@ -474,6 +727,28 @@ class MixLinear : public LinearWave
 			delete mAWave;
 			delete mBWave;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mAWave;
+			out[ 1 ] = mBWave;
+			return 2;
+			}
+		MixLinear( Blank ) {}
+		int Kind() const { return kMixLinear; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mAFactor );
+			genes.Float( mBFactor );
+			genes.Linear( mAWave );
+			genes.Linear( mBWave );
+			if( genes.Loading() )
+				{
+				mSumFactor = mAFactor + mBFactor;
+#if BUILD_ALTIVEC
+				if (gUseAltivec) Init_AV();
+#endif
+				}
+			}
 //-----------------------------------------------------------------------------
 		float Value( float d ) const
 			{
@@ -523,6 +798,23 @@ class MinimaxLinear : public LinearWave
 			delete mASrc;
 			delete mBSrc;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mASrc;
+			out[ 1 ] = mBSrc;
+			return 2;
+			}
+		MinimaxLinear( Blank ) {}
+		int Kind() const { return kMinimaxLinear; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Flag( mMin );
+			genes.Linear( mASrc );
+			genes.Linear( mBSrc );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float d ) const
 			{
@@ -576,6 +868,19 @@ class MultiplyLinear : public LinearWave
 			delete mASrc;
 			delete mBSrc;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mASrc;
+			out[ 1 ] = mBSrc;
+			return 2;
+			}
+		MultiplyLinear( Blank ) {}
+		int Kind() const { return kMultiplyLinear; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Linear( mASrc );
+			genes.Linear( mBSrc );
+			}
 //-----------------------------------------------------------------------------
 		float Value( float d ) const
 			{
@@ -611,6 +916,21 @@ class GammaLinear : public LinearWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		GammaLinear( Blank ) {}
+		int Kind() const { return kGammaLinear; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mExp );
+			genes.Linear( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float d ) const
 			{
@@ -657,6 +977,17 @@ class Pebbledrop : public PlanarWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		Pebbledrop( Blank ) {}
+		int Kind() const { return kPebbledrop; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Linear( mSource );
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -697,6 +1028,17 @@ class Curtain : public PlanarWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		Curtain( Blank ) {}
+		int Kind() const { return kCurtain; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Linear( mSource );
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -732,6 +1074,23 @@ class Zigzag : public PlanarWave
 			delete mOscillator;
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mOscillator;
+			out[ 1 ] = mSource;
+			return 2;
+			}
+		Zigzag( Blank ) {}
+		int Kind() const { return kZigzag; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mAmplitude );
+			genes.Linear( mOscillator );
+			genes.Linear( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -779,6 +1138,25 @@ class Starfish : public PlanarWave
 			delete mOscillator;
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mOscillator;
+			out[ 1 ] = mSource;
+			return 2;
+			}
+		Starfish( Blank ) {}
+		int Kind() const { return kStarfish; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mAmplitude );
+			genes.Float( mAttenuation );
+			genes.Float( mSpinRate );
+			genes.Linear( mOscillator );
+			genes.Linear( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -859,6 +1237,24 @@ class Spinflake : public PlanarWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		Spinflake( Blank ) {}
+		int Kind() const { return kSpinflake; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mRadius );
+			genes.Float( mAmplitude );
+			genes.Float( mSharpness );
+			genes.Float( mSignflip );
+			genes.Linear( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -952,6 +1348,17 @@ class InvertPlane : public PlanarWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		InvertPlane( Blank ) {}
+		int Kind() const { return kInvertPlane; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Planar( mSource );
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -988,6 +1395,23 @@ class MinimaxPlanar : public PlanarWave
 			delete mASrc;
 			delete mBSrc;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mASrc;
+			out[ 1 ] = mBSrc;
+			return 2;
+			}
+		MinimaxPlanar( Blank ) {}
+		int Kind() const { return kMinimaxPlanar; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Flag( mMin );
+			genes.Planar( mASrc );
+			genes.Planar( mBSrc );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -1046,6 +1470,24 @@ class MixPlanar : public PlanarWave
 			delete mASrc;
 			delete mBSrc;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mASrc;
+			out[ 1 ] = mBSrc;
+			return 2;
+			}
+		MixPlanar( Blank ) {}
+		int Kind() const { return kMixPlanar; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mABias );
+			genes.Float( mBBias );
+			genes.Planar( mASrc );
+			genes.Planar( mBSrc );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value(float x, float y) const
 			{
@@ -1088,6 +1530,7 @@ class WarpPlane : public PlanarWave
 			mAmplitude = rnd();
 			mAcceleration = rnd();
 			mAttenuation = 1.0 / pow( rnd(), 2.0 );
+			mRestAmplitude = mAmplitude;
 #if BUILD_ALTIVEC
 			if (gUseAltivec) Init_AV();
 #endif
@@ -1097,6 +1540,41 @@ class WarpPlane : public PlanarWave
 			delete mModulator;
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mModulator;
+			out[ 1 ] = mSource;
+			return 2;
+			}
+		WarpPlane( Blank ) {}
+		int Kind() const { return kWarpPlane; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mAcceleration );
+			genes.Float( mRestAmplitude );
+			genes.Float( mAttenuation );
+			genes.Linear( mModulator );
+			genes.Planar( mSource );
+			if( genes.Loading() )
+				{
+				mAmplitude = mRestAmplitude;
+#if BUILD_ALTIVEC
+				if (gUseAltivec) Init_AV();
+#endif
+				}
+			}
+//-----------------------------------------------------------------------------
+		void Animate( float phase )
+			{
+			// Swell and ebb by up to half again. Every warp starts its
+			// swell at a different point, taken from its acceleration,
+			// so they don't all breathe together.
+			float offset = mAcceleration * twopi;
+			mAmplitude = mRestAmplitude * (1.0 + 0.5 * (sin( phase * twopi + offset ) - sin( offset )));
+#if BUILD_ALTIVEC
+			if (gUseAltivec) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -1132,6 +1610,7 @@ class WarpPlane : public PlanarWave
 	protected:
 		float mAcceleration;
 		float mAmplitude;
+		float mRestAmplitude;
 		float mAttenuation;
 		LinearWave* mModulator;
 		PlanarWave* mSource;
@@ -1159,6 +1638,21 @@ class Reflector : public PlanarWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		Reflector( Blank ) {}
+		int Kind() const { return kReflector; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Number( mMode, 3 );
+			genes.Planar( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -1246,6 +1740,21 @@ class GammaPlanar : public PlanarWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		GammaPlanar( Blank ) {}
+		int Kind() const { return kGammaPlanar; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mExp );
+			genes.Planar( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -1294,6 +1803,19 @@ class MultiplyPlanar : public PlanarWave
 			delete mASrc;
 			delete mBSrc;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mASrc;
+			out[ 1 ] = mBSrc;
+			return 2;
+			}
+		MultiplyPlanar( Blank ) {}
+		int Kind() const { return kMultiplyPlanar; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Planar( mASrc );
+			genes.Planar( mBSrc );
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -1330,6 +1852,22 @@ class Quadratesselator : public PlanarWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		Quadratesselator( Blank ) {}
+		int Kind() const { return kQuadratesselator; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mHSize );
+			genes.Float( mVSize );
+			genes.Planar( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -1430,6 +1968,21 @@ class Hexatesselator : public PlanarWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		Hexatesselator( Blank ) {}
+		int Kind() const { return kHexatesselator; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mScale );
+			genes.Planar( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -1551,6 +2104,7 @@ class Rotawarp : public PlanarWave
 				{
 				mAmplitude = 1.0 / pow(mAmplitude - 1.0, 1.0);
 				}
+			mRestAmplitude = mAmplitude;
 #if BUILD_ALTIVEC
 			if (gUseAltivec) Init_AV();
 #endif
@@ -1560,6 +2114,38 @@ class Rotawarp : public PlanarWave
 			delete mSource;
 			delete mWarp;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			out[ 1 ] = mWarp;
+			return 2;
+			}
+		Rotawarp( Blank ) {}
+		int Kind() const { return kRotawarp; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mRestAmplitude );
+			genes.Planar( mSource );
+			genes.Linear( mWarp );
+			if( genes.Loading() )
+				{
+				mAmplitude = mRestAmplitude;
+#if BUILD_ALTIVEC
+				if (gUseAltivec) Init_AV();
+#endif
+				}
+			}
+//-----------------------------------------------------------------------------
+		void Animate( float phase )
+			{
+			// Twist harder and then ease off again, starting from
+			// wherever the amplitude itself says.
+			float offset = mRestAmplitude * twopi;
+			mAmplitude = mRestAmplitude * (1.0 + 0.5 * (sin( phase * twopi + offset ) - sin( offset )));
+#if BUILD_ALTIVEC
+			if (gUseAltivec) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -1596,6 +2182,7 @@ class Rotawarp : public PlanarWave
 //-----------------------------------------------------------------------------
 	protected:
 		float mAmplitude;
+		float mRestAmplitude;
 		PlanarWave* mSource;
 		LinearWave* mWarp;
 #if BUILD_ALTIVEC
@@ -1626,6 +2213,7 @@ class Mixmaster : public PlanarWave
 				mYFactor = rnd() + 0.1;
 				mXFactor = 1.0 / mYFactor;
 				}
+			mRestAngle = mAngle;
 #if BUILD_ALTIVEC
 			if (gUseAltivec) Init_AV();
 #endif
@@ -1634,6 +2222,40 @@ class Mixmaster : public PlanarWave
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		Mixmaster( Blank ) {}
+		int Kind() const { return kMixmaster; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mRestAngle );
+			genes.Float( mXOff );
+			genes.Float( mYOff );
+			genes.Float( mXFactor );
+			genes.Float( mYFactor );
+			genes.Planar( mSource );
+			if( genes.Loading() )
+				{
+				mAngle = mRestAngle;
+#if BUILD_ALTIVEC
+				if (gUseAltivec) Init_AV();
+#endif
+				}
+			}
+//-----------------------------------------------------------------------------
+		void Animate( float phase )
+			{
+			// Turn once around per loop; which way depends on
+			// which half of the circle we started in.
+			float turn = phase * twopi;
+			mAngle = (mRestAngle < pi) ? mRestAngle + turn : mRestAngle - turn;
+#if BUILD_ALTIVEC
+			if (gUseAltivec) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		float Value( float x, float y ) const
 			{
@@ -1693,6 +2315,7 @@ class Mixmaster : public PlanarWave
 //-----------------------------------------------------------------------------
 	protected:
 		float mAngle;
+		float mRestAngle;
 		PlanarWave* mSource;
 		float mXFactor;
 		float mXOff;
@@ -1708,6 +2331,15 @@ class Mixmaster : public PlanarWave
 	};
 
 #pragma mark class Gradientor
+/*
+A gradientor looks its colours up in a ramp of kRampSteps, worked out
+once from its two endpoints, instead of blending them for every sample.
+The nearest step is never more than one level out in any channel, and
+1024 of them keep a gradientor's ramp to 4K, so that the ramps of a
+whole composite stay in the first level cache.
+*/
+static const int kRampSteps = 1024;
+
 class Gradientor : public ImageLayer
 	{
 	public:
@@ -1725,6 +2357,7 @@ class Gradientor : public ImageLayer
 				}
 			while( bindex == aindex );
 			mBVal = colours->colour[ bindex ];
+			MakeRamp();
 #if BUILD_ALTIVEC
 			if (gUseAltivec) Init_AV();
 #endif
@@ -1733,6 +2366,23 @@ class Gradientor : public ImageLayer
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		Gradientor( Blank ) {}
+		int Kind() const { return kGradientor; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Colour( mAVal );
+			genes.Colour( mBVal );
+			genes.Planar( mSource );
+			if( genes.Loading() ) MakeRamp();
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		pixel Value( float x, float y ) const
 			{
@@ -1741,16 +2391,25 @@ class Gradientor : public ImageLayer
 			// acting as our gradient endpoints.
 			float val;
 			val = (mSource->Value( x, y ) + 1.0) / 2.0;
-			if( val < 0.0 || val > 1.0 )
+			// Written this way round so that a NaN is out of range too,
+			// rather than an index into who knows where.
+			if( !(val >= 0.0 && val <= 1.0) )
 				{
 				pixel out = {0xFF, 0, 0, 0};
 				return out;
 				}
-			pixel out;
-			out.red   = (unsigned char) ((mBVal.red - mAVal.red) * val + mAVal.red);
-			out.green = (unsigned char) ((mBVal.green - mAVal.green) * val + mAVal.green);
-			out.blue  = (unsigned char) ((mBVal.blue - mAVal.blue) * val + mAVal.blue);
-			return out;
+			return mRamp[ (int) (val * (kRampSteps - 1) + 0.5f) ];
+			}
+		void MakeRamp( void )
+			{
+			for( int i = 0; i < kRampSteps; i++ )
+				{
+				float val = (float) i / (kRampSteps - 1);
+				mRamp[ i ].red   = (unsigned char) ((mBVal.red - mAVal.red) * val + mAVal.red);
+				mRamp[ i ].green = (unsigned char) ((mBVal.green - mAVal.green) * val + mAVal.green);
+				mRamp[ i ].blue  = (unsigned char) ((mBVal.blue - mAVal.blue) * val + mAVal.blue);
+				mRamp[ i ].alpha = 0;
+				}
 			}
 //-----------------------------------------------------------------------------
 #if BUILD_ALTIVEC
@@ -1791,6 +2450,7 @@ class Gradientor : public ImageLayer
 			pixel mAVal;
 			pixel mBVal;
 			PlanarWave* mSource;
+			pixel mRamp[ kRampSteps ];
 #if BUILD_ALTIVEC
 			vector float		mARedV, mAGreenV, mABlueV;
 			vector float		mBRedV, mBGreenV, mBBlueV;
@@ -1813,6 +2473,21 @@ class Compositor : public ImageLayer
 			delete mSrcB;
 			delete mMask;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSrcA;
+			out[ 1 ] = mMask;
+			out[ 2 ] = mSrcB;
+			return 3;
+			}
+		Compositor( Blank ) {}
+		int Kind() const { return kCompositor; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Image( mSrcA );
+			genes.Planar( mMask );
+			genes.Image( mSrcB );
+			}
 //-----------------------------------------------------------------------------
 		pixel Value( float x, float y ) const
 			{
@@ -1875,6 +2550,22 @@ class AntialiasImage : public ImageLayer
 			{
 			delete mSource;
 			}
+		int Children( StarfishNode** out ) const
+			{
+			out[ 0 ] = mSource;
+			return 1;
+			}
+		AntialiasImage( Blank ) {}
+		int Kind() const { return kAntialiasImage; }
+		void Genes( GeneCoder& genes )
+			{
+			genes.Float( mDX );
+			genes.Float( mDY );
+			genes.Image( mSource );
+#if BUILD_ALTIVEC
+			if (gUseAltivec && genes.Loading()) Init_AV();
+#endif
+			}
 //-----------------------------------------------------------------------------
 		pixel Value( float x, float y ) const
 			{
@@ -1977,23 +2668,658 @@ class AntialiasImage : public ImageLayer
 #endif
 	};
 
+#if STARFISH_PROFILE
 #pragma mark -
+#pragma mark Profiler
+/*
+A profiling build slips a ProfiledLinear, ProfiledPlanar or ProfiledImage
+in above every node of a new tree (see GeneCoder's instrumenting mode).
+The wrapper passes each call straight through, counting it and the
+cycles it took; whatever its children took comes off to leave the node's
+own time. Wrappers answer Kind, Genes and Children for the node inside,
+so nothing else in the engine can tell they are there. The counts are
+shared between threads, so a profile from one thread is the cleanest.
+Counting costs more than the cheapest nodes do, so reports take out what
+it costs, as timed on a node that does nothing (see ProfileOverhead).
+*/
+struct NodeProfile
+	{
+	unsigned long long mCalls;
+	unsigned long long mCycles;		// in the node and everything below it
+	unsigned long long mChildCycles;
+	};
 
-static LinearWave* NewLinearWave( unsigned int complexity = 10 )
+#if defined( __i386__ ) || defined( __x86_64__ )
+static const char kProfileUnit[] = "cycles";
+
+static inline unsigned long long ProfileClock( void )
 	{
-	LinearWave* out;
-	int selector;
-	// Start with one of our root waves.
-	selector = (int) floor( rnd() * 3.0 );
-	switch( selector )
-		{
-		case 0: out = new Coswave; break;
-		case 1: out = new Sawtooth; break;
-		case 2: out = new Ess; break;
-		default: assert(0);
-		}
-	// Encrust our simple wave with a random assortment of
-	// modifier waves. Each of these accepts another wave as 
+	return CycleCount();
+	}
+#else
+static const char kProfileUnit[] = "ns";
+
+static inline unsigned long long ProfileClock( void )
+	{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+	}
+#endif
+
+// Cycles this thread has spent so far in the children of the node it is in.
+static __thread unsigned long long tChildCycles;
+
+class ProfileScope
+	{
+	public:
+		ProfileScope( NodeProfile& profile ) : mProfile( profile )
+			{
+			mOuter = tChildCycles;
+			tChildCycles = 0;
+			mStart = ProfileClock();
+			}
+		~ProfileScope()
+			{
+			unsigned long long spent = ProfileClock() - mStart;
+			__atomic_fetch_add( &mProfile.mCalls, 1, __ATOMIC_RELAXED );
+			__atomic_fetch_add( &mProfile.mCycles, spent, __ATOMIC_RELAXED );
+			__atomic_fetch_add( &mProfile.mChildCycles, tChildCycles, __ATOMIC_RELAXED );
+			tChildCycles = mOuter + spent;
+			}
+	private:
+		NodeProfile& mProfile;
+		unsigned long long mOuter;
+		unsigned long long mStart;
+	};
+
+class ProfiledLinear : public LinearWave
+	{
+	public:
+		ProfiledLinear( LinearWave* node )
+			{
+			mNode = node;
+			memset( &mProfile, 0, sizeof( mProfile ) );
+			}
+		~ProfiledLinear() { delete mNode; }
+		int Children( StarfishNode** out ) const { return mNode->Children( out ); }
+		void Animate( float phase ) { mNode->Animate( phase ); }
+		int Kind() const { return mNode->Kind(); }
+		void Genes( GeneCoder& genes ) { mNode->Genes( genes ); }
+		const NodeProfile* Profile() const { return &mProfile; }
+		float Value( float d ) const
+			{
+			ProfileScope scope( mProfile );
+			return mNode->Value( d );
+			}
+	private:
+		LinearWave* mNode;
+		mutable NodeProfile mProfile;
+	};
+
+class ProfiledPlanar : public PlanarWave
+	{
+	public:
+		ProfiledPlanar( PlanarWave* node )
+			{
+			mNode = node;
+			memset( &mProfile, 0, sizeof( mProfile ) );
+			}
+		~ProfiledPlanar() { delete mNode; }
+		int Children( StarfishNode** out ) const { return mNode->Children( out ); }
+		void Animate( float phase ) { mNode->Animate( phase ); }
+		int Kind() const { return mNode->Kind(); }
+		void Genes( GeneCoder& genes ) { mNode->Genes( genes ); }
+		const NodeProfile* Profile() const { return &mProfile; }
+		float Value( float x, float y ) const
+			{
+			ProfileScope scope( mProfile );
+			return mNode->Value( x, y );
+			}
+	private:
+		PlanarWave* mNode;
+		mutable NodeProfile mProfile;
+	};
+
+class ProfiledImage : public ImageLayer
+	{
+	public:
+		ProfiledImage( ImageLayer* node )
+			{
+			mNode = node;
+			memset( &mProfile, 0, sizeof( mProfile ) );
+			}
+		~ProfiledImage() { delete mNode; }
+		int Children( StarfishNode** out ) const { return mNode->Children( out ); }
+		void Animate( float phase ) { mNode->Animate( phase ); }
+		int Kind() const { return mNode->Kind(); }
+		void Genes( GeneCoder& genes ) { mNode->Genes( genes ); }
+		const NodeProfile* Profile() const { return &mProfile; }
+		pixel Value( float x, float y ) const
+			{
+			ProfileScope scope( mProfile );
+			return mNode->Value( x, y );
+			}
+	private:
+		ImageLayer* mNode;
+		mutable NodeProfile mProfile;
+	};
+
+class ProfileProbe : public LinearWave
+	{
+	public:
+		int Kind() const { return kCoswave; }
+		void Genes( GeneCoder& genes ) {}
+		float Value( float d ) const { return d; }
+	};
+
+struct ProfileOverhead
+	{
+	double mInside;		// counted against each profiled call
+	double mAround;		// counted against its caller
+	};
+
+static ProfileOverhead MeasureProfileOverhead( void )
+	{
+	// Profile a probe that does nothing, wrapped twice: everything the
+	// inner wrapper counts is the profiler's, and so is everything the
+	// outer one counts as its own. Keep the best of a few tries, since
+	// anything that happens meanwhile only makes them slower.
+	const int kCalls = 20000;
+	ProfileOverhead best = { 0, 0 };
+	for( int attempt = 0; attempt < 5; attempt++ )
+		{
+		ProfiledLinear* inner = new ProfiledLinear( new ProfileProbe );
+		ProfiledLinear outer( inner );
+		float sum = 0;
+		for( int i = 0; i < kCalls; i++ )
+			{
+			sum += outer.Value( (float) i );
+			}
+		const NodeProfile* in = inner->Profile();
+		const NodeProfile* out = outer.Profile();
+		double inside = (double) in->mCycles / kCalls;
+		double around = (double) (out->mCycles - out->mChildCycles) / kCalls;
+		if( !attempt || inside < best.mInside ) best.mInside = inside;
+		if( !attempt || around < best.mAround ) best.mAround = around;
+		if( sum < 0 ) best.mAround = 0;		// keep the loop from being optimized away
+		}
+	return best;
+	}
+
+static const ProfileOverhead& GetProfileOverhead( void )
+	{
+	static const ProfileOverhead overhead = MeasureProfileOverhead();
+	return overhead;
+	}
+#endif
+
+#pragma mark -
+#pragma mark GeneCoder
+
+/*
+In binary, a genome is "SFG1", a flags byte, and then the nodes: a byte
+for the kind, floats as their four IEEE bytes, least significant first,
+flags and numbers as a byte each, colours as red, green, blue, alpha.
+As text, it is a header line and then one node per line, indented by
+depth, named, with its parameters after the name. Floats are written
+with enough digits to come back exactly.
+*/
+static const unsigned char kGenomeMagic[ 4 ] = { 'S', 'F', 'G', '1' };
+static const char kGenomeTextMagic[] = "starfish-genome";
+static const int kGenomeTextVersion = 1;
+// Far deeper than anything NewImageLayer makes; it only keeps a
+// malformed genome from running the stack out.
+static const int kMaxGenomeDepth = 1000;
+
+static const char* const kNodeNames[ kNodeKinds ] =
+	{
+	"Coswave",
+	"Sawtooth",
+	"Ess",
+	"InvertWave",
+	"InsertWavePeaks",
+	"Modulator",
+	"MixLinear",
+	"MinimaxLinear",
+	"MultiplyLinear",
+	"GammaLinear",
+	"Pebbledrop",
+	"Curtain",
+	"Zigzag",
+	"Starfish",
+	"Spinflake",
+	"InvertPlane",
+	"MinimaxPlanar",
+	"MixPlanar",
+	"WarpPlane",
+	"Reflector",
+	"GammaPlanar",
+	"MultiplyPlanar",
+	"Quadratesselator",
+	"Hexatesselator",
+	"Rotawarp",
+	"Mixmaster",
+	"Gradientor",
+	"Compositor",
+	"AntialiasImage",
+	};
+
+static StarfishNode* NewBlankNode( int kind )
+	{
+	switch( kind )
+		{
+		case kCoswave: return new Coswave( kBlank );
+		case kSawtooth: return new Sawtooth( kBlank );
+		case kEss: return new Ess( kBlank );
+		case kInvertWave: return new InvertWave( kBlank );
+		case kInsertWavePeaks: return new InsertWavePeaks( kBlank );
+		case kModulator: return new Modulator( kBlank );
+		case kMixLinear: return new MixLinear( kBlank );
+		case kMinimaxLinear: return new MinimaxLinear( kBlank );
+		case kMultiplyLinear: return new MultiplyLinear( kBlank );
+		case kGammaLinear: return new GammaLinear( kBlank );
+		case kPebbledrop: return new Pebbledrop( kBlank );
+		case kCurtain: return new Curtain( kBlank );
+		case kZigzag: return new Zigzag( kBlank );
+		case kStarfish: return new Starfish( kBlank );
+		case kSpinflake: return new Spinflake( kBlank );
+		case kInvertPlane: return new InvertPlane( kBlank );
+		case kMinimaxPlanar: return new MinimaxPlanar( kBlank );
+		case kMixPlanar: return new MixPlanar( kBlank );
+		case kWarpPlane: return new WarpPlane( kBlank );
+		case kReflector: return new Reflector( kBlank );
+		case kGammaPlanar: return new GammaPlanar( kBlank );
+		case kMultiplyPlanar: return new MultiplyPlanar( kBlank );
+		case kQuadratesselator: return new Quadratesselator( kBlank );
+		case kHexatesselator: return new Hexatesselator( kBlank );
+		case kRotawarp: return new Rotawarp( kBlank );
+		case kMixmaster: return new Mixmaster( kBlank );
+		case kGradientor: return new Gradientor( kBlank );
+		case kCompositor: return new Compositor( kBlank );
+		case kAntialiasImage: return new AntialiasImage( kBlank );
+		}
+	return NULL;
+	}
+
+GeneCoder::GeneCoder( int format, unsigned char* buffer, long size )
+	{
+	mLoading = false;
+	mText = (format == STARFISH_GENOME_TEXT);
+	mFailed = (format != STARFISH_GENOME_TEXT && format != STARFISH_GENOME_BINARY);
+	mOut = buffer;
+	mRoom = buffer ? size : 0;
+	mLength = 0;
+	mIn = NULL;
+	mLeft = 0;
+	mDepth = 0;
+#if STARFISH_PROFILE
+	mInstrumenting = false;
+#endif
+	}
+
+GeneCoder::GeneCoder( const unsigned char* data, long size )
+	{
+	mLoading = true;
+	mText = !(size >= 4 && !memcmp( data, kGenomeMagic, 4 ));
+	mFailed = false;
+	mOut = NULL;
+	mRoom = 0;
+	mLength = 0;
+	mIn = data;
+	mLeft = size;
+	mDepth = 0;
+#if STARFISH_PROFILE
+	mInstrumenting = false;
+#endif
+	}
+
+#if STARFISH_PROFILE
+GeneCoder::GeneCoder( Instrument )
+	{
+	// Walk the tree as if saving it, with nowhere to save it to, and
+	// wrap every node on the way back up.
+	mLoading = false;
+	mText = false;
+	mFailed = false;
+	mOut = NULL;
+	mRoom = 0;
+	mLength = 0;
+	mIn = NULL;
+	mLeft = 0;
+	mDepth = 0;
+	mInstrumenting = true;
+	}
+#endif
+
+void GeneCoder::Put( const void* bytes, long count )
+	{
+	// Like snprintf, count everything but only store what fits.
+	for( long i = 0; i < count; i++ )
+		{
+		if( mLength + i < mRoom ) mOut[ mLength + i ] = ((const unsigned char*) bytes)[ i ];
+		}
+	mLength += count;
+	}
+
+void GeneCoder::Print( const char* text )
+	{
+	Put( text, strlen( text ) );
+	}
+
+bool GeneCoder::Get( void* bytes, long count )
+	{
+	if( mFailed || mLeft < count )
+		{
+		mFailed = true;
+		memset( bytes, 0, count );
+		return false;
+		}
+	memcpy( bytes, mIn, count );
+	mIn += count;
+	mLeft -= count;
+	return true;
+	}
+
+bool GeneCoder::Token( char* out, int size )
+	{
+	int length = 0;
+	while( mLeft > 0 && isspace( *mIn ) )
+		{
+		mIn++;
+		mLeft--;
+		}
+	while( mLeft > 0 && !isspace( *mIn ) )
+		{
+		if( length + 1 < size ) out[ length ] = *mIn;
+		length++;
+		mIn++;
+		mLeft--;
+		}
+	if( mFailed || length == 0 || length >= size )
+		{
+		mFailed = true;
+		out[ 0 ] = 0;
+		return false;
+		}
+	out[ length ] = 0;
+	return true;
+	}
+
+void GeneCoder::Header( bool& wrapEdges )
+	{
+	if( !mLoading )
+		{
+		if( mText )
+			{
+			char line[ 64 ];
+			snprintf( line, sizeof( line ), "%s %d %s", kGenomeTextMagic, kGenomeTextVersion, wrapEdges ? "wrap" : "nowrap" );
+			Print( line );
+			}
+		else
+			{
+			unsigned char flags = wrapEdges ? 1 : 0;
+			Put( kGenomeMagic, 4 );
+			Put( &flags, 1 );
+			}
+		}
+	else if( mText )
+		{
+		char token[ 32 ];
+		Token( token, sizeof( token ) );
+		if( strcmp( token, kGenomeTextMagic ) ) mFailed = true;
+		Token( token, sizeof( token ) );
+		if( atoi( token ) != kGenomeTextVersion ) mFailed = true;
+		Token( token, sizeof( token ) );
+		wrapEdges = !strcmp( token, "wrap" );
+		if( !wrapEdges && strcmp( token, "nowrap" ) ) mFailed = true;
+		}
+	else
+		{
+		unsigned char magic[ 4 ], flags;
+		Get( magic, 4 );
+		Get( &flags, 1 );
+		if( flags > 1 ) mFailed = true;
+		wrapEdges = flags & 1;
+		}
+	}
+
+void GeneCoder::Float( float& value )
+	{
+	if( mText )
+		{
+		char token[ 32 ];
+		if( !mLoading )
+			{
+			snprintf( token, sizeof( token ), " %.9g", value );
+			Print( token );
+			}
+		else if( Token( token, sizeof( token ) ) )
+			{
+			char* end;
+			value = strtof( token, &end );
+			if( *end ) mFailed = true;
+			}
+		else value = 0;
+		}
+	else
+		{
+		unsigned char bytes[ 4 ];
+		unsigned long bits = 0;
+		if( !mLoading )
+			{
+			unsigned int word;
+			memcpy( &word, &value, 4 );
+			for( int i = 0; i < 4; i++ ) bytes[ i ] = (unsigned char) (word >> (8 * i));
+			Put( bytes, 4 );
+			}
+		else
+			{
+			unsigned int word;
+			Get( bytes, 4 );
+			for( int i = 0; i < 4; i++ ) bits |= (unsigned long) bytes[ i ] << (8 * i);
+			word = (unsigned int) bits;
+			memcpy( &value, &word, 4 );
+			}
+		}
+	}
+
+void GeneCoder::Flag( bool& value )
+	{
+	int number = value ? 1 : 0;
+	Number( number, 2 );
+	value = number != 0;
+	}
+
+void GeneCoder::Number( int& value, int limit )
+	{
+	if( mText )
+		{
+		char token[ 16 ];
+		if( !mLoading )
+			{
+			snprintf( token, sizeof( token ), " %d", value );
+			Print( token );
+			return;
+			}
+		Token( token, sizeof( token ) );
+		value = atoi( token );
+		}
+	else
+		{
+		unsigned char byte = (unsigned char) value;
+		if( !mLoading )
+			{
+			Put( &byte, 1 );
+			return;
+			}
+		Get( &byte, 1 );
+		value = byte;
+		}
+	if( value < 0 || value >= limit )
+		{
+		mFailed = true;
+		value = 0;
+		}
+	}
+
+void GeneCoder::Colour( pixel& value )
+	{
+	unsigned char bytes[ 4 ] = { value.red, value.green, value.blue, value.alpha };
+	if( mText )
+		{
+		char token[ 16 ];
+		if( !mLoading )
+			{
+			snprintf( token, sizeof( token ), " #%02x%02x%02x%02x", bytes[ 0 ], bytes[ 1 ], bytes[ 2 ], bytes[ 3 ] );
+			Print( token );
+			return;
+			}
+		Token( token, sizeof( token ) );
+		unsigned long rgba = 0;
+		char* end = token;
+		if( token[ 0 ] == '#' && strlen( token ) == 9 ) rgba = strtoul( token + 1, &end, 16 );
+		if( *end ) mFailed = true;
+		for( int i = 0; i < 4; i++ ) bytes[ i ] = (unsigned char) (rgba >> (24 - 8 * i));
+		}
+	else if( !mLoading )
+		{
+		Put( bytes, 4 );
+		return;
+		}
+	else
+		{
+		Get( bytes, 4 );
+		}
+	value.red = bytes[ 0 ];
+	value.green = bytes[ 1 ];
+	value.blue = bytes[ 2 ];
+	value.alpha = bytes[ 3 ];
+	}
+
+StarfishNode* GeneCoder::Node( StarfishNode* node, int first, int limit )
+	{
+	int kind = 0;
+	if( !mLoading )
+		{
+		if( !node )
+			{
+			mFailed = true;
+			return node;
+			}
+		kind = node->Kind();
+		if( mText )
+			{
+			Print( "\n" );
+			for( int i = 0; i < mDepth; i++ ) Print( "  " );
+			Print( kNodeNames[ kind ] );
+			}
+		else
+			{
+			unsigned char byte = (unsigned char) kind;
+			Put( &byte, 1 );
+			}
+		}
+	else
+		{
+		// Whatever goes wrong, the parent gets a child it can delete.
+		node = NULL;
+		if( mText )
+			{
+			char token[ 32 ];
+			kind = -1;
+			if( Token( token, sizeof( token ) ) )
+				{
+				for( int i = 0; i < kNodeKinds; i++ )
+					{
+					if( !strcmp( token, kNodeNames[ i ] ) ) kind = i;
+					}
+				}
+			}
+		else
+			{
+			unsigned char byte;
+			Get( &byte, 1 );
+			kind = byte;
+			}
+		if( mFailed || kind < first || kind >= limit || mDepth >= kMaxGenomeDepth )
+			{
+			mFailed = true;
+			return NULL;
+			}
+		node = NewBlankNode( kind );
+		}
+	mDepth++;
+	node->Genes( *this );
+	mDepth--;
+	return node;
+	}
+
+void GeneCoder::Linear( LinearWave*& node )
+	{
+	node = static_cast<LinearWave*>( Node( node, kFirstLinear, kFirstPlanar ) );
+#if STARFISH_PROFILE
+	if( mInstrumenting && node ) node = new ProfiledLinear( node );
+#endif
+	}
+
+void GeneCoder::Planar( PlanarWave*& node )
+	{
+	node = static_cast<PlanarWave*>( Node( node, kFirstPlanar, kFirstImage ) );
+#if STARFISH_PROFILE
+	if( mInstrumenting && node ) node = new ProfiledPlanar( node );
+#endif
+	}
+
+void GeneCoder::Image( ImageLayer*& node )
+	{
+	node = static_cast<ImageLayer*>( Node( node, kFirstImage, kNodeKinds ) );
+#if STARFISH_PROFILE
+	if( mInstrumenting && node ) node = new ProfiledImage( node );
+#endif
+	}
+
+void GeneCoder::End( void )
+	{
+	if( !mLoading )
+		{
+		if( mText )
+			{
+			Print( "\n" );
+			// Terminate the text if there is room, but don't count it.
+			if( mLength < mRoom ) mOut[ mLength ] = 0;
+			}
+		}
+	else
+		{
+		// Trailing white space is harmless in text; anything else is not.
+		while( mText && mLeft > 0 && isspace( *mIn ) )
+			{
+			mIn++;
+			mLeft--;
+			}
+		if( mText && mLeft == 1 && *mIn == 0 ) mLeft = 0;
+		if( mLeft ) mFailed = true;
+		}
+	}
+
+#pragma mark -
+
+static LinearWave* NewLinearWave( unsigned int complexity = 10 )
+	{
+	LinearWave* out;
+	int selector;
+	// Start with one of our root waves.
+	selector = (int) floor( rnd() * 3.0 );
+	switch( selector )
+		{
+		case 0: out = new Coswave; break;
+		case 1: out = new Sawtooth; break;
+		case 2: out = new Ess; break;
+		default: assert(0);
+		}
+	// Encrust our simple wave with a random assortment of
+	// modifier waves. Each of these accepts another wave as 
 	// input and modify its output according to some random
 	// parameters.
 	while( complexity > 0 )
@@ -2141,48 +3467,447 @@ static PlanarWave* NewPlanarWave( unsigned int complexity = 20 )
 				} break;
 			case 8:
 				{
-				// Tile the image using a hexagon.
-				out = new Hexatesselator( out );
-				modifierComplexity = modifierComplexity / 2;
-				} break;
-			case 9:
+				// Tile the image using a hexagon.
+				out = new Hexatesselator( out );
+				modifierComplexity = modifierComplexity / 2;
+				} break;
+			case 9:
+				{
+				// Warp the image around a point.
+				subwaveComplexity = (int) (modifierComplexity * rnd());
+				out = new Rotawarp( new Mixmaster( out ), NewLinearWave( subwaveComplexity ) );
+				modifierComplexity = modifierComplexity - subwaveComplexity;
+				} break;
+			}
+		}
+	// We always give away one mixmaster layer for free.
+	// This rotates, translates, and axis-adjusts the
+	// target layer: a standard package of transformations
+	// so that the output doesn't look like it's sitting
+	// on a cartesian grid in the middle of the display.
+	out = new Mixmaster( out );
+	return out;
+	}
+
+static ImageLayer* NewImageLayer( const StarfishPalette* colours, unsigned int complexity = 50 )
+	{
+	// We have two choices:
+	// Create a gradient based on a planar wave.
+	// Or, composite two other image layers.
+	// The more complexity available, the more likely it is we will create a composite
+	// layer instead of a single layer. This recurses, of course, so we can have
+	// composition layered arbitrarily deep.
+	if(pow( rnd(), 4.0 ) > 1.0 / complexity )
+		{
+		PlanarWave* mask = NewPlanarWave( complexity / 4 );
+		complexity -= (complexity / 4);
+		ImageLayer* a = NewImageLayer( colours, complexity / 2 );
+		ImageLayer* b = NewImageLayer( colours, complexity / 2 );
+		return new Compositor( a, mask, b );
+		}
+	else
+		{
+		return new Gradientor( NewPlanarWave( complexity ), colours );
+		}
+	}
+
+#pragma mark -
+#pragma mark Cost model
+
+/*
+What one evaluation of each kind of node costs, not counting its
+children, in nanoseconds. These were measured by CalibrateStarfishCosts
+on an ordinary x86-64 desktop; they are here so that the same seed and
+budget pick the same pattern everywhere, and calibrating trades that for
+figures that fit the machine at hand.
+*/
+static float gNodeCost[ kNodeKinds ] =
+	{
+	12.0f,		// Coswave
+	10.0f,		// Sawtooth
+	7.0f,		// Ess
+	1.0f,		// InvertWave
+	9.0f,		// InsertWavePeaks
+	2.0f,		// Modulator
+	2.0f,		// MixLinear
+	2.0f,		// MinimaxLinear
+	2.0f,		// MultiplyLinear
+	32.0f,		// GammaLinear
+	4.0f,		// Pebbledrop
+	1.0f,		// Curtain
+	7.0f,		// Zigzag
+	46.0f,		// Starfish
+	84.0f,		// Spinflake
+	2.0f,		// InvertPlane
+	2.0f,		// MinimaxPlanar
+	2.0f,		// MixPlanar
+	4.0f,		// WarpPlane
+	3.0f,		// Reflector
+	30.0f,		// GammaPlanar
+	2.0f,		// MultiplyPlanar
+	20.0f,		// Quadratesselator
+	24.0f,		// Hexatesselator
+	72.0f,		// Rotawarp
+	75.0f,		// Mixmaster
+	16.0f,		// Gradientor
+	12.0f,		// Compositor
+	3.0f,		// AntialiasImage
+	};
+
+// How many patterns MakeStarfishWithin tries before settling for the cheapest.
+static const int kBudgetAttempts = 64;
+
+static double TreeCost( const StarfishNode* node )
+	{
+	StarfishNode* children[ kMaxChildren ];
+	int count = node->Children( children );
+	int kind = node->Kind();
+	// Everything evaluates each child once, except the antialiaser,
+	// which takes four samples.
+	double each = (kind == kAntialiasImage) ? 4.0 : 1.0;
+	double cost = gNodeCost[ kind ];
+	for( int i = 0; i < count; i++ )
+		{
+		cost += each * TreeCost( children[ i ] );
+		}
+	return cost;
+	}
+
+static double Seconds( void )
+	{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec + now.tv_nsec * 1e-9;
+	}
+
+/*
+Stand-ins for a node's children, for timing the node on its own. Each
+returns something that moves with its input, so that the node's branches
+go both ways, and counts how often it is called so that what the calls
+cost can be taken back out. A stub can call another stub and do the same
+work on what it gets back, which is how a call is timed (see
+TimeLoneNode).
+*/
+static inline float Fold( float d )
+	{
+	return d > 1.0f ? 2.0f - d : (d < -1.0f ? -2.0f - d : d);
+	}
+
+class StubLinear : public LinearWave
+	{
+	public:
+		StubLinear( StubLinear* inner = NULL ) { mInner = inner; mCalls = 0; }
+		~StubLinear() { delete mInner; }
+		int Kind() const { return kFirstLinear; }
+		void Genes( GeneCoder& genes ) {}
+		float Value( float d ) const
+			{
+			mCalls++;
+			return Fold( mInner ? mInner->Value( d ) : d );
+			}
+		StubLinear* mInner;
+		mutable long mCalls;
+	};
+
+class StubPlanar : public PlanarWave
+	{
+	public:
+		StubPlanar( StubPlanar* inner = NULL ) { mInner = inner; mCalls = 0; }
+		~StubPlanar() { delete mInner; }
+		int Kind() const { return kFirstPlanar; }
+		void Genes( GeneCoder& genes ) {}
+		float Value( float x, float y ) const
+			{
+			mCalls++;
+			return Fold( mInner ? mInner->Value( x, y ) : x - y );
+			}
+		StubPlanar* mInner;
+		mutable long mCalls;
+	};
+
+class StubImage : public ImageLayer
+	{
+	public:
+		StubImage( StubImage* inner = NULL ) { mInner = inner; mCalls = 0; }
+		~StubImage() { delete mInner; }
+		int Kind() const { return kFirstImage; }
+		void Genes( GeneCoder& genes ) {}
+		pixel Value( float x, float y ) const
+			{
+			pixel out;
+			mCalls++;
+			float v = mInner ? mInner->Value( x, y ).red * (1.0f / 128.0f) - 1.0f : x;
+			out.red = (unsigned char) ((Fold( v ) + 1.0f) * 127.0f);
+			out.green = (unsigned char) ((Fold( y ) + 1.0f) * 127.0f);
+			out.blue = (unsigned char) ((Fold( v + y ) + 1.0f) * 127.0f);
+			out.alpha = 255;
+			return out;
+			}
+		StubImage* mInner;
+		mutable long mCalls;
+	};
+
+static int Family( int kind )
+	{
+	return kind < kFirstPlanar ? kFirstLinear : (kind < kFirstImage ? kFirstPlanar : kFirstImage);
+	}
+
+static int FamilyIndex( int kind )
+	{
+	return kind < kFirstPlanar ? 0 : (kind < kFirstImage ? 1 : 2);
+	}
+
+static void CountStubCalls( const StarfishNode* node, long calls[ 3 ] )
+	{
+	// A lone node's children are all stubs, each of its family's kind.
+	StarfishNode* children[ kMaxChildren ];
+	int count = node->Children( children );
+	calls[ 0 ] = calls[ 1 ] = calls[ 2 ] = 0;
+	for( int i = 0; i < count; i++ )
+		{
+		int kind = children[ i ]->Kind();
+		if( kind == kFirstLinear ) calls[ 0 ] += ((StubLinear*) children[ i ])->mCalls;
+		else if( kind == kFirstPlanar ) calls[ 1 ] += ((StubPlanar*) children[ i ])->mCalls;
+		else calls[ 2 ] += ((StubImage*) children[ i ])->mCalls;
+		}
+	}
+
+static void CalibrationPalette( StarfishPalette* palette )
+	{
+	palette->colourcount = 2;
+	palette->colour[ 0 ].red = palette->colour[ 0 ].green = palette->colour[ 0 ].blue = 0;
+	palette->colour[ 1 ].red = palette->colour[ 1 ].green = palette->colour[ 1 ].blue = 255;
+	palette->colour[ 0 ].alpha = palette->colour[ 1 ].alpha = 255;
+	}
+
+// A node of the given kind, with stubs for children.
+static StarfishNode* NewLoneNode( int kind, const StarfishPalette* palette )
+	{
+	switch( kind )
+		{
+		case kCoswave: return new Coswave;
+		case kSawtooth: return new Sawtooth;
+		case kEss: return new Ess;
+		case kInvertWave: return new InvertWave( new StubLinear );
+		case kInsertWavePeaks: return new InsertWavePeaks( new StubLinear );
+		case kModulator: return new Modulator( new StubLinear, new StubLinear );
+		case kMixLinear: return new MixLinear( new StubLinear, new StubLinear );
+		case kMinimaxLinear: return new MinimaxLinear( new StubLinear, new StubLinear );
+		case kMultiplyLinear: return new MultiplyLinear( new StubLinear, new StubLinear );
+		case kGammaLinear: return new GammaLinear( new StubLinear );
+		case kPebbledrop: return new Pebbledrop( new StubLinear );
+		case kCurtain: return new Curtain( new StubLinear );
+		case kZigzag: return new Zigzag( new StubLinear, new StubLinear );
+		case kStarfish: return new Starfish( new StubLinear, new StubLinear );
+		case kSpinflake: return new Spinflake( new StubLinear );
+		case kInvertPlane: return new InvertPlane( new StubPlanar );
+		case kMinimaxPlanar: return new MinimaxPlanar( new StubPlanar, new StubPlanar );
+		case kMixPlanar: return new MixPlanar( new StubPlanar, new StubPlanar );
+		case kWarpPlane: return new WarpPlane( new StubPlanar, new StubLinear );
+		case kReflector: return new Reflector( new StubPlanar );
+		case kGammaPlanar: return new GammaPlanar( new StubPlanar );
+		case kMultiplyPlanar: return new MultiplyPlanar( new StubPlanar, new StubPlanar );
+		case kQuadratesselator: return new Quadratesselator( new StubPlanar );
+		case kHexatesselator: return new Hexatesselator( new StubPlanar );
+		case kRotawarp: return new Rotawarp( new StubPlanar, new StubLinear );
+		case kMixmaster: return new Mixmaster( new StubPlanar );
+		case kGradientor: return new Gradientor( new StubPlanar, palette );
+		case kCompositor: return new Compositor( new StubImage, new StubPlanar, new StubImage );
+		case kAntialiasImage: return new AntialiasImage( new StubImage, 0.001, 0.001 );
+		}
+	return NULL;
+	}
+
+static void SampleCoordinates( int distribution, int count, float* xs, float* ys )
+	{
+	// A generator of our own, so as not to disturb random().
+	unsigned int state = 2003;
+	int side = (int) ceil( sqrt( (double) count ) );
+	float range = (distribution == STARFISH_SAMPLES_WRAPPED) ? 2.0f : 1.0f;
+	for( int i = 0; i < count; i++ )
+		{
+		if( distribution == STARFISH_SAMPLES_GRID )
+			{
+			xs[ i ] = (i % side) * (2.0f / side) - 1.0f;
+			ys[ i ] = (i / side) * (2.0f / side) - 1.0f;
+			}
+		else
+			{
+			state = state * 1103515245u + 12345u;
+			xs[ i ] = ((state >> 8) * (2.0f / 16777216.0f) - 1.0f) * range;
+			state = state * 1103515245u + 12345u;
+			ys[ i ] = ((state >> 8) * (2.0f / 16777216.0f) - 1.0f) * range;
+			}
+		}
+	}
+
+struct NodeTime
+	{
+	double mSeconds;
+	double mCycles;
+	double mCallSeconds;	// what calling a node of the family costs, as a stub
+	};
+
+// Evaluate a node at every coordinate. Family is the first kind of its
+// family, which says what kind of Value it has.
+static NodeTime TimeSamples( const StarfishNode* node, int family, const float* xs, const float* ys,
+		int count, bool useVector )
+	{
+	volatile float sink = 0;
+	NodeTime spent;
+	spent.mCallSeconds = 0;
+	double start = Seconds();
+	unsigned long long startCycles = CycleCount();
+#if BUILD_ALTIVEC
+	if( useVector )
+		{
+		vector_accessor x4, y4;
+		vector signed int red, green, blue;
+		for( int i = 0; i + 4 <= count; i += 4 )
+			{
+			for( int k = 0; k < 4; k++ )
+				{
+				x4.f[ k ] = xs[ i + k ];
+				y4.f[ k ] = ys[ i + k ];
+				}
+			if( family == kFirstLinear ) x4.vf = ((const LinearWave*) node)->Value_AV( x4.vf );
+			else if( family == kFirstPlanar ) x4.vf = ((const PlanarWave*) node)->Value_AV( x4.vf, y4.vf );
+			else
 				{
-				// Warp the image around a point.
-				subwaveComplexity = (int) (modifierComplexity * rnd());
-				out = new Rotawarp( new Mixmaster( out ), NewLinearWave( subwaveComplexity ) );
-				modifierComplexity = modifierComplexity - subwaveComplexity;
-				} break;
+				((const ImageLayer*) node)->Value_AV( x4.vf, y4.vf, red, green, blue );
+				x4.vsl = red;
+				}
+			sink = sink + x4.f[ 0 ];
 			}
 		}
-	// We always give away one mixmaster layer for free.
-	// This rotates, translates, and axis-adjusts the
-	// target layer: a standard package of transformations
-	// so that the output doesn't look like it's sitting
-	// on a cartesian grid in the middle of the display.
-	out = new Mixmaster( out );
-	return out;
+	else
+#endif
+	for( int i = 0; i < count; i++ )
+		{
+		if( family == kFirstLinear ) sink = sink + ((const LinearWave*) node)->Value( xs[ i ] );
+		else if( family == kFirstPlanar ) sink = sink + ((const PlanarWave*) node)->Value( xs[ i ], ys[ i ] );
+		else sink = sink + ((const ImageLayer*) node)->Value( xs[ i ], ys[ i ] ).red;
+		}
+	spent.mCycles = (double) (CycleCount() - startCycles);
+	spent.mSeconds = Seconds() - start;
+	return spent;
 	}
 
-static ImageLayer* NewImageLayer( const StarfishPalette* colours, unsigned int complexity = 50 )
+// An interrupt or a slow stretch only ever adds time, so the quickest
+// of a few timings is the nearest to the truth.
+static NodeTime FastestSamples( const StarfishNode* node, int family, const float* xs, const float* ys,
+		int count, bool useVector )
 	{
-	// We have two choices:
-	// Create a gradient based on a planar wave.
-	// Or, composite two other image layers.
-	// The more complexity available, the more likely it is we will create a composite
-	// layer instead of a single layer. This recurses, of course, so we can have
-	// composition layered arbitrarily deep.
-	if(pow( rnd(), 4.0 ) > 1.0 / complexity )
+	const int kRepeats = 5;
+	NodeTime fastest = TimeSamples( node, family, xs, ys, count, useVector );
+	for( int i = 1; i < kRepeats; i++ )
 		{
-		PlanarWave* mask = NewPlanarWave( complexity / 4 );
-		complexity -= (complexity / 4);
-		ImageLayer* a = NewImageLayer( colours, complexity / 2 );
-		ImageLayer* b = NewImageLayer( colours, complexity / 2 );
-		return new Compositor( a, mask, b );
+		NodeTime spent = TimeSamples( node, family, xs, ys, count, useVector );
+		if( spent.mSeconds < fastest.mSeconds ) fastest.mSeconds = spent.mSeconds;
+		if( spent.mCycles < fastest.mCycles ) fastest.mCycles = spent.mCycles;
 		}
-	else
+	return fastest;
+	}
+
+/*
+Time a kind of node alone: a number of instances, since each is made with
+random parameters, with stubs for children, over the same coordinates.
+Timing a stub alone gives the loop's overhead plus one call, and timing
+a stub that calls another gives the overhead plus two: between them they
+say what to take away for the loop and for each call to a child. A node
+hardly dearer than the stubs can still come out at nothing or less, so
+it is measured again; one that never comes out above nothing can't be
+told from a stub, and is given what calling a stub costs (or, should
+that come out at nothing too, a lone stub, loop and all).
+*/
+static bool TimeLoneNode( int kind, int distribution, int samples, bool useVector, NodeTime* each )
+	{
+	const int kInstances = 16;
+	const int kAttempts = 4;
+	int count = samples / kInstances;
+	if( kind < 0 || kind >= kNodeKinds || distribution < STARFISH_SAMPLES_GRID
+			|| distribution > STARFISH_SAMPLES_WRAPPED )
 		{
-		return new Gradientor( NewPlanarWave( complexity ), colours );
+		return false;
+		}
+#if BUILD_ALTIVEC
+	bool usedAltivec = gUseAltivec;
+	gUseAltivec = useVector;
+#else
+	if( useVector ) return false;
+#endif
+	if( count < 64 ) count = 64;
+	// Nodes draw random numbers as they are made; keep them from
+	// disturbing whatever sequence the caller has seeded.
+	static char state[ 256 ];
+	char* saved = initstate( 1, state, sizeof( state ) );
+	float* xs = new float[ count ];
+	float* ys = new float[ count ];
+	SampleCoordinates( distribution, count, xs, ys );
+	StarfishPalette palette;
+	CalibrationPalette( &palette );
+
+	int family = FamilyIndex( kind );
+	int evaluated = useVector ? count / 4 * 4 : count;
+	double seconds = 0, cycles = 0;
+	NodeTime call[ 3 ], loop[ 3 ], lone = { 0, 0, 0 };
+	for( int attempt = 0; attempt < kAttempts; attempt++ )
+		{
+		StarfishNode* single[ 3 ] = { new StubLinear, new StubPlanar, new StubImage };
+		StarfishNode* twice[ 3 ] =
+			{
+			new StubLinear( new StubLinear ),
+			new StubPlanar( new StubPlanar ),
+			new StubImage( new StubImage )
+			};
+		for( int f = 0; f < 3; f++ )
+			{
+			NodeTime one = FastestSamples( single[ f ], single[ f ]->Kind(), xs, ys, count, useVector );
+			NodeTime two = FastestSamples( twice[ f ], twice[ f ]->Kind(), xs, ys, count, useVector );
+			call[ f ].mSeconds = (two.mSeconds - one.mSeconds) / count;
+			call[ f ].mCycles = (two.mCycles - one.mCycles) / count;
+			loop[ f ].mSeconds = (2 * one.mSeconds - two.mSeconds) / count;
+			loop[ f ].mCycles = (2 * one.mCycles - two.mCycles) / count;
+			if( f == family )
+				{
+				lone.mSeconds = one.mSeconds / count;
+				lone.mCycles = one.mCycles / count;
+				}
+			delete single[ f ];
+			delete twice[ f ];
+			}
+
+		seconds = cycles = 0;
+		for( int i = 0; i < kInstances; i++ )
+			{
+			StarfishNode* node = NewLoneNode( kind, &palette );
+			NodeTime spent = FastestSamples( node, Family( kind ), xs, ys, count, useVector );
+			long calls[ 3 ];
+			CountStubCalls( node, calls );
+			seconds += spent.mSeconds - evaluated * loop[ family ].mSeconds;
+			cycles += spent.mCycles - evaluated * loop[ family ].mCycles;
+			for( int f = 0; f < 3; f++ )
+				{
+				seconds -= calls[ f ] * call[ f ].mSeconds;
+				cycles -= calls[ f ] * call[ f ].mCycles;
+				}
+			delete node;
+			}
+		if( seconds > 0 && (cycles > 0 || !kHaveCycleCount) ) break;
 		}
+	each->mSeconds = seconds / ((double) kInstances * evaluated);
+	each->mCycles = cycles / ((double) kInstances * evaluated);
+	if( !(each->mSeconds > 0) ) each->mSeconds = call[ family ].mSeconds > 0 ? call[ family ].mSeconds : lone.mSeconds;
+	if( !(each->mCycles > 0) ) each->mCycles = call[ family ].mCycles > 0 ? call[ family ].mCycles : lone.mCycles;
+	each->mCallSeconds = max( call[ family ].mSeconds, 0.0 );
+
+	delete[] xs;
+	delete[] ys;
+	setstate( saved );
+#if BUILD_ALTIVEC
+	gUseAltivec = usedAltivec;
+#endif
+	return true;
 	}
 
 #pragma mark -
@@ -2191,7 +3916,9 @@ static ImageLayer* NewImageLayer( const StarfishPalette* colours, unsigned int c
 struct StarfishGeneratorRec
 	{
 	StarfishGeneratorRec( int width, int height, const StarfishPalette* palette, bool wrapEdges );
+	StarfishGeneratorRec( int width, int height, ImageLayer* pattern, bool wrapEdges );
 	void Pixel( int x, int y, pixel* out );
+	void Sample( float fx, float fy, float xbackmask, float ybackmask, pixel* out );
 #if BUILD_ALTIVEC
 	void Init_AV(void);
 	void Pixel(int x, int y, vector unsigned char *pixels);
@@ -2200,6 +3927,7 @@ struct StarfishGeneratorRec
 
 	int mWidth, mHeight;
 	ImageLayer* mSource;
+	ImageLayer* mPattern;		// mSource without the antialiasing, which depends on size
 	bool mWrapEdges;
 #if BUILD_ALTIVEC
 	vector float	mWidthRecipV, mHeightRecipV;
@@ -2219,8 +3947,28 @@ StarfishGeneratorRec::StarfishGeneratorRec( int width, int height, const Starfis
 #if BUILD_ALTIVEC
 			if (gUseAltivec) Init_AV();
 #endif
-	mSource = NewImageLayer( palette, complexity );
-	mSource = new AntialiasImage( mSource, 0.5/width, 0.5/height );
+	mPattern = NewImageLayer( palette, complexity );
+	mSource = new AntialiasImage( mPattern, 0.5/width, 0.5/height );
+#if STARFISH_PROFILE
+	GeneCoder instrument( kInstrument );
+	instrument.Image( mSource );
+#endif
+	}
+
+StarfishGeneratorRec::StarfishGeneratorRec( int width, int height, ImageLayer* pattern, bool wrapEdges )
+	{
+	mWidth = width;
+	mHeight = height;
+	mWrapEdges = wrapEdges;
+#if BUILD_ALTIVEC
+			if (gUseAltivec) Init_AV();
+#endif
+	mPattern = pattern;
+	mSource = new AntialiasImage( mPattern, 0.5/width, 0.5/height );
+#if STARFISH_PROFILE
+	GeneCoder instrument( kInstrument );
+	instrument.Image( mSource );
+#endif
 	}
 
 
@@ -2242,9 +3990,18 @@ void StarfishGeneratorRec::Pixel( int x, int y, pixel* out )
 	float fx, fy;
 	fx = (x * 2.0) / mWidth - 1.0;
 	fy = (y * 2.0) / mHeight - 1.0;
+	Sample( fx, fy, (x*1.0) / (mWidth*1.0), (y*1.0) / (mHeight*1.0), out );
+	}
+
+void StarfishGeneratorRec::Sample( float fx, float fy, float xbackmask, float ybackmask, pixel* out )
+	{
+	/*
+	fx and fy are image layer coordinates in the -1..1 range. The backmask values
+	are the same location in 0..1 texture units; we only need them when we are
+	blending the four copies of the pattern that make the edges wrap.
+	*/
 	if( mWrapEdges )
 		{
-		float xbackmask = (x*1.0) / (mWidth*1.0);
 		float xmask = 1.0 - xbackmask;
 		pixel topleft = mSource->Value( fx + 1.0, fy );
 		pixel topright = mSource->Value( fx - 1.0, fy );
@@ -2258,7 +4015,6 @@ void StarfishGeneratorRec::Pixel( int x, int y, pixel* out )
 		bottom.red   = (unsigned char) ((bottomleft.red * xmask) + (bottomright.red * xbackmask));
 		bottom.green = (unsigned char) ((bottomleft.green * xmask) + (bottomright.green * xbackmask));
 		bottom.blue  = (unsigned char) ((bottomleft.blue * xmask) + (bottomright.blue * xbackmask));
-		float ybackmask = (y*1.0) / (mHeight*1.0);
 		float ymask = 1.0 - ybackmask;
 		out->red   = (unsigned char) ((top.red * ymask) + (bottom.red * ybackmask));
 		out->green = (unsigned char) ((top.green * ymask) + (bottom.green * ybackmask));
@@ -2375,7 +4131,10 @@ StarfishRef MakeStarfish( int width, int height, const StarfishPalette* palette,
 		dummy.colour[3].green = (unsigned char) (rnd() * 256.0);
 		dummy.colour[3].blue  = (unsigned char) (rnd() * 256.0);
 		}
-	return new StarfishGeneratorRec( width, height, palette, wrapEdges );
+	double start = StarfishTraceClock();
+	StarfishRef texture = new StarfishGeneratorRec( width, height, palette, wrapEdges );
+	StarfishTraceSpan( "engine", "generate", start, NULL, 0, NULL, 0 );
+	return texture;
 	}
 
 void GetStarfishPixel( int x, int y, StarfishRef texture, pixel* out )
@@ -2392,7 +4151,442 @@ void GetStarfishPixel_AV(int x, int y, StarfishRef texture, vector unsigned char
 #endif
 
 
+void GetStarfishSample( double u, double v, StarfishRef texture, pixel* out )
+	{
+	// The same arithmetic as Pixel, so that nothing is rounded to single
+	// precision any earlier than there.
+	texture->Sample( u * 2.0 - 1.0, v * 2.0 - 1.0, u, v, out );
+	}
+
+void AnimateStarfish( StarfishRef texture, float phase )
+	{
+	AnimateTree( texture->mSource, phase - floor( phase ) );
+	}
+
+double StarfishCost( StarfishRef texture )
+	{
+	// Edges that wrap take four samples of the pattern per pixel.
+	return TreeCost( texture->mSource ) * (texture->mWrapEdges ? 4.0 : 1.0);
+	}
+
+double MeasureStarfishCost( StarfishRef texture, int samples )
+	{
+	// Spread the samples over the whole texture, since the cost of a
+	// pixel can depend a great deal on where it is.
+	int side = (int) ceil( sqrt( (double) (samples > 0 ? samples : 1) ) );
+	pixel out;
+	double start = Seconds();
+	for( int j = 0; j < side; j++ )
+		{
+		for( int i = 0; i < side; i++ )
+			{
+			GetStarfishSample( (i + 0.5) / side, (j + 0.5) / side, texture, &out );
+			}
+		}
+	return (Seconds() - start) * 1e9 / (side * side);
+	}
+
+bool MapStarfishCost( StarfishRef texture, int step, float* costs )
+	{
+	if( step < 1 ) step = 1;
+	int across = (texture->mWidth + step - 1) / step;
+	int down = (texture->mHeight + step - 1) / step;
+	pixel out;
+	// Reading the clock takes time too; the least it ever takes is the
+	// nearest thing to its cost alone.
+	double overhead = 0;
+	for( int i = 0; i < 64; i++ )
+		{
+		double spent;
+		if( kHaveCycleCount )
+			{
+			unsigned long long start = CycleCount();
+			spent = (double) (CycleCount() - start);
+			}
+		else
+			{
+			double start = Seconds();
+			spent = (Seconds() - start) * 1e9;
+			}
+		if( !i || spent < overhead ) overhead = spent;
+		}
+	// Time everything twice, in two scrambled orders, and keep the
+	// quicker: a sample that caught an interrupt, or a stretch of time
+	// when the processor ran slow, shows up as speckle rather than as a
+	// pattern across the map. Stepping through the samples by a number
+	// with no factor in common with their count visits each just once.
+	long count = (long) across * down;
+	long strides[ 2 ] = { 7919, 104729 };
+	for( int pass = 0; pass < 2; pass++ )
+		{
+		long a = strides[ pass ], b = count;
+		while( b ) { long r = a % b; a = b; b = r; }
+		if( a != 1 ) strides[ pass ] = 1;
+		}
+	for( int pass = 0; pass < 2; pass++ )
+		{
+		for( long n = 0; n < count; n++ )
+			{
+			int sample = (int) ((n * strides[ pass ]) % count);
+			int x = (sample % across) * step + step / 2;
+			int y = (sample / across) * step + step / 2;
+			double spent;
+			if( x >= texture->mWidth ) x = texture->mWidth - 1;
+			if( y >= texture->mHeight ) y = texture->mHeight - 1;
+			if( kHaveCycleCount )
+				{
+				unsigned long long start = CycleCount();
+				texture->Pixel( x, y, &out );
+				spent = (double) (CycleCount() - start);
+				}
+			else
+				{
+				double start = Seconds();
+				texture->Pixel( x, y, &out );
+				spent = (Seconds() - start) * 1e9;
+				}
+			spent = spent > overhead ? spent - overhead : 0;
+			if( !pass || spent < costs[ sample ] ) costs[ sample ] = (float) spent;
+			}
+		}
+	return kHaveCycleCount;
+	}
+
+void CalibrateStarfishCosts( void )
+	{
+	// Building the test patterns draws random numbers too.
+	static char state[ 256 ];
+	char* saved = initstate( 1, state, sizeof( state ) );
+	const int kPatterns = 16;
+	for( int kind = 0; kind < kNodeKinds; kind++ )
+		{
+		// Real trees hand nodes all sorts of inputs, in no order. In a
+		// tree, a node also costs its parent the call.
+		NodeTime each;
+		TimeLoneNode( kind, STARFISH_SAMPLES_SCATTER, 262144, false, &each );
+		gNodeCost[ kind ] = (float) max( (each.mSeconds + each.mCallSeconds) * 1e9, 0.1 );
+		}
+	// Nodes cost more in a real tree than alone, with their children
+	// spoiling each other's caches and branch predictions. Scale every
+	// cost so that the model agrees with some whole patterns.
+	double modelled = 0, measured = 0;
+	for( int i = 0; i < kPatterns; i++ )
+		{
+#if BUILD_ALTIVEC
+		StarfishRef texture = MakeStarfish( 256, 256, NULL, false, gUseAltivec );
+#else
+		StarfishRef texture = MakeStarfish( 256, 256, NULL, false );
+#endif
+		modelled += StarfishCost( texture );
+		measured += MeasureStarfishCost( texture, 256 );
+		delete texture;
+		}
+	for( int kind = 0; kind < kNodeKinds; kind++ )
+		{
+		gNodeCost[ kind ] = (float) (gNodeCost[ kind ] * measured / modelled);
+		}
+	setstate( saved );
+	}
+
+int StarfishNodeKinds( void )
+	{
+	return kNodeKinds;
+	}
+
+const char* StarfishNodeName( int kind )
+	{
+	return (kind >= 0 && kind < kNodeKinds) ? kNodeNames[ kind ] : NULL;
+	}
+
+double StarfishNodeCost( int kind )
+	{
+	return (kind >= 0 && kind < kNodeKinds) ? gNodeCost[ kind ] : 0;
+	}
+
+void SetStarfishNodeCost( int kind, double nanoseconds )
+	{
+	if( kind >= 0 && kind < kNodeKinds && nanoseconds > 0 ) gNodeCost[ kind ] = (float) nanoseconds;
+	}
+
+bool TimeStarfishNode( int kind, int distribution, int samples, bool useVector, double* nanoseconds, double* cycles )
+	{
+	NodeTime each;
+	if( !TimeLoneNode( kind, distribution, samples, useVector, &each ) ) return false;
+	if( nanoseconds ) *nanoseconds = each.mSeconds * 1e9;
+	if( cycles ) *cycles = kHaveCycleCount ? each.mCycles : 0;
+	return true;
+	}
+
+void DumpStarfishCosts( FILE* out )
+	{
+	for( int kind = 0; kind < kNodeKinds; kind++ )
+		{
+		fprintf( out, "%-18s %8.1f ns\n", kNodeNames[ kind ], gNodeCost[ kind ] );
+		}
+	}
+
+#if BUILD_ALTIVEC
+StarfishRef MakeStarfishWithin( int width, int height, const StarfishPalette* palette, bool wrapEdges, double seconds, int threads, bool useAltivec )
+#else
+StarfishRef MakeStarfishWithin( int width, int height, const StarfishPalette* palette, bool wrapEdges, double seconds, int threads )
+#endif
+	{
+	StarfishRef best = NULL;
+	double bestTime = 0;
+	double scale = (double) width * height * 1e-9 / (threads > 0 ? threads : 1);
+	for( int attempt = 0; attempt < kBudgetAttempts; attempt++ )
+		{
+#if BUILD_ALTIVEC
+		StarfishRef texture = MakeStarfish( width, height, palette, wrapEdges, useAltivec );
+#else
+		StarfishRef texture = MakeStarfish( width, height, palette, wrapEdges );
+#endif
+		double time = StarfishCost( texture ) * scale;
+		if( !best || time < bestTime )
+			{
+			delete best;
+			best = texture;
+			bestTime = time;
+			}
+		else
+			{
+			delete texture;
+			}
+		if( bestTime <= seconds ) break;
+		}
+	return best;
+	}
+
+long SaveStarfish( StarfishRef texture, int format, void* buffer, long size )
+	{
+	GeneCoder genes( format, (unsigned char*) buffer, size );
+	bool wrapEdges = texture->mWrapEdges;
+	genes.Header( wrapEdges );
+	genes.Image( texture->mPattern );
+	genes.End();
+	return genes.Failed() ? -1 : genes.Length();
+	}
+
+StarfishRef LoadStarfish( const void* genome, long size, int width, int height )
+	{
+	GeneCoder genes( (const unsigned char*) genome, size );
+	bool wrapEdges = false;
+	ImageLayer* pattern = NULL;
+	if( width <= 0 || height <= 0 ) return NULL;
+	double start = StarfishTraceClock();
+	genes.Header( wrapEdges );
+	genes.Image( pattern );
+	genes.End();
+	if( genes.Failed() )
+		{
+		delete pattern;
+		return NULL;
+		}
+	StarfishRef texture = new StarfishGeneratorRec( width, height, pattern, wrapEdges );
+	StarfishTraceSpan( "engine", "load genome", start, "bytes", size, NULL, 0 );
+	return texture;
+	}
+
+int StarfishWidth( StarfishRef texture )
+	{
+	return texture->mWidth;
+	}
+
+int StarfishHeight( StarfishRef texture )
+	{
+	return texture->mHeight;
+	}
+
+#if STARFISH_PROFILE
+#pragma mark -
+#pragma mark Profile report
+
+// How many of the most expensive subtrees a report names.
+static const int kHottestSubtrees = 10;
+
+// Every node of every texture dumped so far, by kind.
+static unsigned long long gKindNodes[ kNodeKinds ];
+static unsigned long long gKindCalls[ kNodeKinds ];
+static unsigned long long gKindSelf[ kNodeKinds ];
+static unsigned long long gProfileCycles;
+static unsigned long long gProfilePatterns;
+
+struct ProfileEntry
+	{
+	int mKind;
+	int mDepth;
+	int mSize;		// nodes in the subtree, this one included
+	unsigned long long mCalls;
+	unsigned long long mCycles;
+	unsigned long long mSelf;
+	};
+
+static int CountNodes( const StarfishNode* node )
+	{
+	StarfishNode* children[ kMaxChildren ];
+	int count = node->Children( children );
+	int total = 1;
+	for( int i = 0; i < count; i++ )
+		{
+		total += CountNodes( children[ i ] );
+		}
+	return total;
+	}
+
+static int ListNodes( const StarfishNode* node, int depth, ProfileEntry* list, int at )
+	{
+	// Prefix order, so that a subtree is the run of entries starting at
+	// its root. A node's time is worked out again from its own, less the
+	// profiler's, and its children's, so that the shares add up.
+	StarfishNode* children[ kMaxChildren ];
+	int count = node->Children( children );
+	const NodeProfile* profile = node->Profile();
+	const ProfileOverhead& overhead = GetProfileOverhead();
+	int index = at++;
+	unsigned long long childCalls = 0, childCycles = 0;
+	for( int i = 0; i < count; i++ )
+		{
+		int child = at;
+		at = ListNodes( children[ i ], depth + 1, list, at );
+		childCalls += list[ child ].mCalls;
+		childCycles += list[ child ].mCycles;
+		}
+	double self = 0;
+	list[ index ].mCalls = 0;
+	if( profile )
+		{
+		self = (double) profile->mCycles - profile->mChildCycles
+				- overhead.mInside * profile->mCalls - overhead.mAround * childCalls;
+		list[ index ].mCalls = profile->mCalls;
+		}
+	list[ index ].mKind = node->Kind();
+	list[ index ].mDepth = depth;
+	list[ index ].mSize = at - index;
+	list[ index ].mSelf = self > 0 ? (unsigned long long) self : 0;
+	list[ index ].mCycles = list[ index ].mSelf + childCycles;
+	return at;
+	}
+
+static double Percent( unsigned long long part, unsigned long long whole )
+	{
+	return whole ? 100.0 * part / whole : 0.0;
+	}
+
+static void PrintKinds( FILE* out, const unsigned long long* nodes, const unsigned long long* calls,
+		const unsigned long long* self, unsigned long long total )
+	{
+	// Most expensive first.
+	int order[ kNodeKinds ];
+	for( int i = 0; i < kNodeKinds; i++ )
+		{
+		int at = i;
+		while( at > 0 && self[ order[ at - 1 ] ] < self[ i ] )
+			{
+			order[ at ] = order[ at - 1 ];
+			at--;
+			}
+		order[ at ] = i;
+		}
+	fprintf( out, "%-18s %6s %14s %7s %15s\n", "class", "nodes", "calls", "self", "self per call" );
+	for( int i = 0; i < kNodeKinds; i++ )
+		{
+		int kind = order[ i ];
+		if( !nodes[ kind ] ) continue;
+		fprintf( out, "%-18s %6llu %14llu %6.1f%% %15.1f\n", kNodeNames[ kind ], nodes[ kind ],
+				calls[ kind ], Percent( self[ kind ], total ),
+				calls[ kind ] ? (double) self[ kind ] / calls[ kind ] : 0.0 );
+		}
+	}
+
+void ReportStarfishProfile( StarfishRef texture, FILE* out )
+	{
+	int count = CountNodes( texture->mSource );
+	ProfileEntry* list = new ProfileEntry[ count ];
+	ListNodes( texture->mSource, 0, list, 0 );
+	unsigned long long total = list[ 0 ].mCycles;
+	unsigned long long nodes[ kNodeKinds ], calls[ kNodeKinds ], self[ kNodeKinds ];
+	memset( nodes, 0, sizeof( nodes ) );
+	memset( calls, 0, sizeof( calls ) );
+	memset( self, 0, sizeof( self ) );
+	for( int i = 0; i < count; i++ )
+		{
+		nodes[ list[ i ].mKind ]++;
+		calls[ list[ i ].mKind ] += list[ i ].mCalls;
+		self[ list[ i ].mKind ] += list[ i ].mSelf;
+		}
+	fprintf( out, "starfish profile: %d nodes, %llu samples, %llu %s"
+			" less %.0f+%.0f per call for profiling\n\n", count, list[ 0 ].mCalls, total,
+			kProfileUnit, GetProfileOverhead().mInside, GetProfileOverhead().mAround );
+	PrintKinds( out, nodes, calls, self, total );
+
+	fprintf( out, "\n%5s %14s %7s %7s  %s\n", "#", "calls", "self", "total", "tree" );
+	for( int i = 0; i < count; i++ )
+		{
+		fprintf( out, "%5d %14llu %6.1f%% %6.1f%%  %*s%s\n", i, list[ i ].mCalls,
+				Percent( list[ i ].mSelf, total ), Percent( list[ i ].mCycles, total ),
+				2 * list[ i ].mDepth, "", kNodeNames[ list[ i ].mKind ] );
+		}
+
+	// The root is the whole render, so leave it out.
+	int hottest[ kHottestSubtrees ];
+	int found = 0;
+	for( int i = 1; i < count; i++ )
+		{
+		int at = found < kHottestSubtrees ? found++ : kHottestSubtrees;
+		while( at > 0 && list[ hottest[ at - 1 ] ].mCycles < list[ i ].mCycles )
+			{
+			if( at < kHottestSubtrees ) hottest[ at ] = hottest[ at - 1 ];
+			at--;
+			}
+		if( at < kHottestSubtrees ) hottest[ at ] = i;
+		}
+	fprintf( out, "\nhottest subtrees:\n" );
+	for( int i = 0; i < found; i++ )
+		{
+		const ProfileEntry& entry = list[ hottest[ i ] ];
+		fprintf( out, "%5d %6.1f%%  %s, %d node%s\n", hottest[ i ], Percent( entry.mCycles, total ),
+				kNodeNames[ entry.mKind ], entry.mSize, entry.mSize == 1 ? "" : "s" );
+		}
+	delete[] list;
+	}
+
+void ReportStarfishProfileTotals( FILE* out )
+	{
+	unsigned long long nodes[ kNodeKinds ], calls[ kNodeKinds ], self[ kNodeKinds ];
+	for( int i = 0; i < kNodeKinds; i++ )
+		{
+		nodes[ i ] = __atomic_load_n( &gKindNodes[ i ], __ATOMIC_RELAXED );
+		calls[ i ] = __atomic_load_n( &gKindCalls[ i ], __ATOMIC_RELAXED );
+		self[ i ] = __atomic_load_n( &gKindSelf[ i ], __ATOMIC_RELAXED );
+		}
+	unsigned long long total = __atomic_load_n( &gProfileCycles, __ATOMIC_RELAXED );
+	fprintf( out, "starfish profile: %llu patterns, %llu %s\n\n",
+			__atomic_load_n( &gProfilePatterns, __ATOMIC_RELAXED ), total, kProfileUnit );
+	PrintKinds( out, nodes, calls, self, total );
+	}
+
+static void AddToProfileTotals( StarfishRef texture )
+	{
+	// Textures may be dumped on any thread.
+	int count = CountNodes( texture->mSource );
+	ProfileEntry* list = new ProfileEntry[ count ];
+	ListNodes( texture->mSource, 0, list, 0 );
+	for( int i = 0; i < count; i++ )
+		{
+		__atomic_fetch_add( &gKindNodes[ list[ i ].mKind ], 1, __ATOMIC_RELAXED );
+		__atomic_fetch_add( &gKindCalls[ list[ i ].mKind ], list[ i ].mCalls, __ATOMIC_RELAXED );
+		__atomic_fetch_add( &gKindSelf[ list[ i ].mKind ], list[ i ].mSelf, __ATOMIC_RELAXED );
+		}
+	__atomic_fetch_add( &gProfileCycles, list[ 0 ].mCycles, __ATOMIC_RELAXED );
+	__atomic_fetch_add( &gProfilePatterns, 1, __ATOMIC_RELAXED );
+	delete[] list;
+	}
+#endif
+
 void DumpStarfish( StarfishRef it )
 	{
+#if STARFISH_PROFILE
+	AddToProfileTotals( it );
+#endif
 	delete it;
 	}
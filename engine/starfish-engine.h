@@ -22,8 +22,20 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #ifndef STARFISH_ENGINE_H
 #define STARFISH_ENGINE_H
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stdio.h>
+
 typedef struct StarfishGeneratorRec		*StarfishRef;
 
+/*
+Bump this whenever a change means some seed no longer makes exactly the
+pixels it used to, so that anything kept from an older engine is
+recognised as stale.
+*/
+#define STARFISH_ENGINE_VERSION 2
+
 struct pixel
 	{
 	unsigned char red;
@@ -53,12 +65,132 @@ extern "C" {
 
 void GetStarfishPixel( int x, int y, StarfishRef texture, pixel* out );
 void DumpStarfish( StarfishRef it );
+int StarfishWidth( StarfishRef texture );
+int StarfishHeight( StarfishRef texture );
+
+/*
+Sample the texture at a resolution-independent location.
+u and v run from 0 to 1 across the texture's width and height, so you can
+render the same pattern at any size without rebuilding it. Pixel x,y of a
+w by h rendering lives at u = x/w, v = y/h; worked out in double precision,
+those give exactly the colour GetStarfishPixel does.
+*/
+void GetStarfishSample( double u, double v, StarfishRef texture, pixel* out );
+
+/*
+Move the texture's drifting parameters (wave phases, rotations, warp
+strengths) to a point on a closed loop. Phase 0 is the texture as it was
+made, and the motion comes back round to it at phase 1, so stepping the
+phase steadily makes an animation that repeats without a seam. Don't
+animate a texture while something else is reading pixels from it.
+*/
+void AnimateStarfish( StarfishRef texture, float phase );
+
+/*
+A texture's genome is its whole tree of waves with every parameter, which
+is all it takes to draw the same pattern again: at any size, in another
+process, or after the generator has changed the way it spends random
+numbers. The binary form is compact; the text form can be read and
+edited. Either way the genome holds the pattern as it was made, not as
+animated, and says whether its edges wrap.
+SaveStarfish writes the genome into buffer and returns its length, or -1
+for an unknown format. Like snprintf, it returns the whole length even if
+only part of it fits, so pass a NULL buffer to find out how much room it
+needs; text is NUL-terminated when there is room, not counted in the
+length.
+LoadStarfish makes a texture of any size from a genome in either form.
+It returns NULL if the genome is damaged or from a newer engine.
+*/
+#define STARFISH_GENOME_BINARY 0
+#define STARFISH_GENOME_TEXT 1
+
+long SaveStarfish( StarfishRef texture, int format, void* buffer, long size );
+StarfishRef LoadStarfish( const void* genome, long size, int width, int height );
+
+/*
+Some patterns take many times longer to render than others, since a tree
+can grow far bigger than the average. StarfishCost estimates what a
+texture costs without rendering it: nanoseconds of one thread's time per
+pixel, added up from a cost for each kind of node in its tree.
+MeasureStarfishCost times about that many samples spread across the
+texture instead, which is slower but takes in everything the model
+doesn't. The built-in costs are the same on every machine;
+CalibrateStarfishCosts replaces them with costs measured here, taking
+a fraction of a second, and DumpStarfishCosts lists them.
+MakeStarfishWithin keeps making patterns until one is expected to render
+at width by height on that many threads within the given number of
+seconds, and returns the cheapest it found if none is.
+*/
+double StarfishCost( StarfishRef texture );
+double MeasureStarfishCost( StarfishRef texture, int samples );
+void CalibrateStarfishCosts( void );
+void DumpStarfishCosts( FILE* out );
+
+/*
+The cost of a pattern varies from place to place across it, wherever a
+mask, a plateau or a cell decides how much of the tree a pixel needs.
+MapStarfishCost times one pixel in the middle of every step by step
+square of the texture and puts what it took into costs, row by row,
+(width + step - 1) / step of them across. The times are time-stamp
+counter cycles, with the counter's own overhead taken off, where there
+is a counter, and nanoseconds where not; it returns whether they are
+cycles. Each pixel is timed twice, in scrambled orders, and the quicker
+time kept. That costs about two pixels in step * step of a render, all
+on the calling thread, so that threads don't disturb each other's
+timings.
+*/
+bool MapStarfishCost( StarfishRef texture, int step, float* costs );
+
+/*
+TimeStarfishNode times one kind of node by itself, with stand-ins for
+its children, over about that many samples: a grid across the pattern,
+points scattered at random over it, or points scattered over the wider
+area that wrapped edges reach. It averages over several nodes, since
+each is made with random parameters, and gives what one evaluation cost
+in nanoseconds and in time-stamp counter cycles, or zero cycles where
+there is no counter to read. A kind too cheap to tell from the
+stand-ins is given what calling one costs, never nothing. With useVector it times the AltiVec Value,
+four samples at a time, and fails where there is no AltiVec. Kinds run
+from 0 to StarfishNodeKinds()-1, in the order of the genome's node
+names, which StarfishNodeName gives. CalibrateStarfishCosts is built on
+the same measurements. StarfishNodeCost and SetStarfishNodeCost read and
+replace the cost model's nanoseconds for a kind, so that a calibration
+can be kept and used again.
+*/
+#define STARFISH_SAMPLES_GRID 0
+#define STARFISH_SAMPLES_SCATTER 1
+#define STARFISH_SAMPLES_WRAPPED 2
+
+int StarfishNodeKinds( void );
+const char* StarfishNodeName( int kind );
+double StarfishNodeCost( int kind );
+void SetStarfishNodeCost( int kind, double nanoseconds );
+bool TimeStarfishNode( int kind, int distribution, int samples, bool useVector, double* nanoseconds, double* cycles );
+
+/*
+Built with STARFISH_PROFILE defined to 1, the engine counts the calls to
+every node of every texture and the cycles they take, which makes
+rendering a good deal slower; otherwise none of this exists.
+ReportStarfishProfile prints what a texture has cost so far: time by
+class of node, its tree with each node's calls and share of the time,
+and the subtrees that took longest. DumpStarfish adds a texture's counts
+to running totals by class, which ReportStarfishProfileTotals prints, to
+profile a whole mix of seeds at once.
+*/
+#if STARFISH_PROFILE
+void ReportStarfishProfile( StarfishRef texture, FILE* out );
+void ReportStarfishProfileTotals( FILE* out );
+#endif
 
 #if BUILD_ALTIVEC
 void GetStarfishPixel_AV(int x, int y, StarfishRef texture, vector unsigned char *pixels);
 StarfishRef MakeStarfish( int width, int height, const StarfishPalette* palette, bool wrapEdges, bool useAltivec );
+StarfishRef MakeStarfishWithin( int width, int height, const StarfishPalette* palette, bool wrapEdges,
+	double seconds, int threads, bool useAltivec );
 #else
 StarfishRef MakeStarfish( int width, int height, const StarfishPalette* palette, bool wrapEdges );
+StarfishRef MakeStarfishWithin( int width, int height, const StarfishPalette* palette, bool wrapEdges,
+	double seconds, int threads );
 #endif
 
 #ifdef __cplusplus
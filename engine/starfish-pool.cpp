@@ -0,0 +1,348 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "starfish-pool.h"
+#include "starfish-trace.h"
+
+/*
+Every call to StartStarfishTasks makes a task set and hangs it on the pool's
+queue, behind every set of the same or higher priority. Workers hand out
+indices from the first set that still has some left and is not already
+running on as many threads as its lane allows; a set leaves the queue as
+soon as its last index has been handed out, and its owner is woken when
+the last index has finished. Since every thread goes back to the queue
+between indices, a new high priority set gets the next free thread.
+*/
+struct StarfishTaskSet
+	{
+	StarfishPoolRec* mPool;
+	StarfishTaskProc mProc;
+	void* mContext;
+	int mCount;
+	int mNext;
+	int mFinished;
+	int mPriority;
+	int mLimit;
+	int mRunning;
+	pthread_cond_t mDone;
+	StarfishTaskSet* mLink;
+	};
+
+#pragma mark struct StarfishPoolRec
+struct StarfishPoolRec
+	{
+	StarfishPoolRec( int threads, bool idle );
+	StarfishPoolRec( StarfishPoolRec* root, int priority, int limit );
+	~StarfishPoolRec();
+	void Start( StarfishTaskSet* set );
+	void Finish( StarfishTaskSet* set );
+	void Work( void );
+
+	bool Claim( StarfishTaskSet* set, int* index );
+	StarfishTaskSet* ClaimAny( int above, int* index );
+	void Done( StarfishTaskSet* set );
+
+	// A lane shares its root's threads and queue, and has none of its own.
+	StarfishPoolRec* mRoot;
+	int mPriority;
+	int mLimit;
+
+	pthread_mutex_t mLock;
+	pthread_cond_t mWake;
+	StarfishTaskSet* mQueue;
+	pthread_t* mWorkers;
+	int mWorkerCount;
+	bool mIdle;
+	bool mQuit;
+	};
+
+static void* PoolWorker( void* pool )
+	{
+	NameStarfishTraceThread( "pool worker" );
+	if( ((StarfishPoolRec*) pool)->mIdle ) LowerStarfishThreadPriority();
+	((StarfishPoolRec*) pool)->Work();
+	return NULL;
+	}
+
+static int ProcessorCount( void )
+	{
+	long count = sysconf( _SC_NPROCESSORS_ONLN );
+	return count > 0 ? (int) count : 1;
+	}
+
+StarfishPoolRec::StarfishPoolRec( int threads, bool idle )
+	{
+	mRoot = this;
+	mPriority = STARFISH_PRIORITY_BATCH;
+	mLimit = 0;
+	pthread_mutex_init( &mLock, NULL );
+	pthread_cond_init( &mWake, NULL );
+	mQueue = NULL;
+	mIdle = idle;
+	mQuit = false;
+	if( threads <= 0 ) threads = ProcessorCount();
+	// The thread which runs a task set always works on it too.
+	mWorkerCount = 0;
+	mWorkers = new pthread_t[ threads ];
+	for( int i = 1; i < threads; i++ )
+		{
+		if( pthread_create( &mWorkers[ mWorkerCount ], NULL, PoolWorker, this ) == 0 )
+			{
+			mWorkerCount++;
+			}
+		}
+	}
+
+StarfishPoolRec::StarfishPoolRec( StarfishPoolRec* root, int priority, int limit )
+	{
+	mRoot = root->mRoot;
+	mPriority = priority;
+	mLimit = limit > 0 ? limit : 0;
+	mQueue = NULL;
+	mWorkers = NULL;
+	mWorkerCount = 0;
+	mIdle = root->mIdle;
+	mQuit = false;
+	}
+
+StarfishPoolRec::~StarfishPoolRec()
+	{
+	if( mRoot != this ) return;
+	pthread_mutex_lock( &mLock );
+	mQuit = true;
+	pthread_cond_broadcast( &mWake );
+	pthread_mutex_unlock( &mLock );
+	for( int i = 0; i < mWorkerCount; i++ )
+		{
+		pthread_join( mWorkers[ i ], NULL );
+		}
+	delete[] mWorkers;
+	pthread_cond_destroy( &mWake );
+	pthread_mutex_destroy( &mLock );
+	}
+
+bool StarfishPoolRec::Claim( StarfishTaskSet* set, int* index )
+	{
+	// Call with the lock held.
+	if( set->mNext >= set->mCount ) return false;
+	if( set->mLimit && set->mRunning >= set->mLimit ) return false;
+	*index = set->mNext++;
+	set->mRunning++;
+	if( set->mNext == set->mCount )
+		{
+		// Nobody else needs to see this set. Unhook it from the queue.
+		StarfishTaskSet** link = &mQueue;
+		while( *link && *link != set ) link = &(*link)->mLink;
+		if( *link ) *link = set->mLink;
+		}
+	return true;
+	}
+
+StarfishTaskSet* StarfishPoolRec::ClaimAny( int above, int* index )
+	{
+	// Call with the lock held. The queue is in priority order, so the first
+	// set that will hand out an index is the one that should.
+	for( StarfishTaskSet* set = mQueue; set && set->mPriority > above; set = set->mLink )
+		{
+		if( Claim( set, index ) ) return set;
+		}
+	return NULL;
+	}
+
+void StarfishPoolRec::Done( StarfishTaskSet* set )
+	{
+	// Call with the lock held.
+	bool wasFull = set->mLimit && set->mRunning == set->mLimit;
+	set->mRunning--;
+	set->mFinished++;
+	if( set->mFinished == set->mCount )
+		{
+		pthread_cond_signal( &set->mDone );
+		}
+	else if( wasFull && set->mNext < set->mCount )
+		{
+		// A thread's worth of quota has come free; whoever is waiting for it
+		// can have it.
+		pthread_cond_signal( &set->mDone );
+		pthread_cond_broadcast( &mWake );
+		}
+	}
+
+void StarfishPoolRec::Work( void )
+	{
+	pthread_mutex_lock( &mLock );
+	while( !mQuit )
+		{
+		int index;
+		StarfishTaskSet* set = ClaimAny( STARFISH_PRIORITY_BATCH - 1, &index );
+		if( set )
+			{
+			pthread_mutex_unlock( &mLock );
+			set->mProc( set->mContext, index );
+			pthread_mutex_lock( &mLock );
+			Done( set );
+			}
+		else
+			{
+			double idle = StarfishTraceClock();
+			pthread_cond_wait( &mWake, &mLock );
+			StarfishTraceSpan( "pool", "wait for work", idle, NULL, 0, NULL, 0 );
+			}
+		}
+	pthread_mutex_unlock( &mLock );
+	}
+
+void StarfishPoolRec::Start( StarfishTaskSet* set )
+	{
+	pthread_mutex_lock( &mLock );
+	// Go behind everything of the same priority, so that earlier task sets
+	// get served first, but ahead of anything less urgent.
+	StarfishTaskSet** link = &mQueue;
+	while( *link && (*link)->mPriority >= set->mPriority ) link = &(*link)->mLink;
+	set->mLink = *link;
+	*link = set;
+	pthread_cond_broadcast( &mWake );
+	pthread_mutex_unlock( &mLock );
+	}
+
+void StarfishPoolRec::Finish( StarfishTaskSet* set )
+	{
+	// Pitch in until every index has been handed out, then wait for the
+	// stragglers on the worker threads. Anything more urgent that turns up
+	// meanwhile comes first: the owner is one of the pool's threads too, as
+	// far as the processors are concerned.
+	pthread_mutex_lock( &mLock );
+	while( set->mFinished < set->mCount )
+		{
+		int index;
+		StarfishTaskSet* run = ClaimAny( set->mPriority, &index );
+		if( !run && Claim( set, &index ) ) run = set;
+		if( run )
+			{
+			pthread_mutex_unlock( &mLock );
+			run->mProc( run->mContext, index );
+			pthread_mutex_lock( &mLock );
+			Done( run );
+			}
+		else
+			{
+			// Everything has been handed out; this is the time lost to
+			// whichever tasks finish last.
+			double idle = StarfishTraceClock();
+			pthread_cond_wait( &set->mDone, &mLock );
+			StarfishTraceSpan( "pool", "wait for stragglers", idle,
+					"running", set->mRunning, NULL, 0 );
+			}
+		}
+	pthread_mutex_unlock( &mLock );
+	}
+
+static StarfishTaskSet* NewTaskSet( StarfishPoolRec* pool, StarfishTaskProc proc, void* context, int count )
+	{
+	StarfishTaskSet* set = new StarfishTaskSet;
+	set->mPool = pool ? pool->mRoot : NULL;
+	set->mPriority = pool ? pool->mPriority : STARFISH_PRIORITY_BATCH;
+	set->mLimit = pool ? pool->mLimit : 0;
+	set->mRunning = 0;
+	set->mProc = proc;
+	set->mContext = context;
+	set->mCount = count;
+	set->mNext = 0;
+	set->mFinished = 0;
+	set->mLink = NULL;
+	pthread_cond_init( &set->mDone, NULL );
+	return set;
+	}
+
+StarfishPoolRef MakeStarfishPool( int threads )
+	{
+	return new StarfishPoolRec( threads, false );
+	}
+
+StarfishPoolRef MakeStarfishIdlePool( int threads )
+	{
+	return new StarfishPoolRec( threads, true );
+	}
+
+StarfishPoolRef MakeStarfishPoolLane( StarfishPoolRef pool, int priority, int maxThreads )
+	{
+	return pool ? new StarfishPoolRec( pool, priority, maxThreads ) : NULL;
+	}
+
+void LowerStarfishThreadPriority( void )
+	{
+#ifdef SCHED_IDLE
+	// Linux can run a thread only when the processor would otherwise idle.
+	struct sched_param param;
+	param.sched_priority = 0;
+	if( pthread_setschedparam( pthread_self(), SCHED_IDLE, &param ) == 0 ) return;
+#endif
+	// Everywhere else, settle for being as nice as possible. On Linux this
+	// only affects the calling thread; elsewhere it is the whole process,
+	// which is still what a background renderer wants.
+	setpriority( PRIO_PROCESS, 0, 19 );
+	}
+
+int StarfishPoolThreads( StarfishPoolRef pool )
+	{
+	if( !pool ) return 1;
+	int threads = pool->mRoot->mWorkerCount + 1;
+	return pool->mLimit && pool->mLimit < threads ? pool->mLimit : threads;
+	}
+
+void RunStarfishTasks( StarfishPoolRef pool, StarfishTaskProc proc, void* context, int count )
+	{
+	FinishStarfishTasks( StartStarfishTasks( pool, proc, context, count ) );
+	}
+
+StarfishTasksRef StartStarfishTasks( StarfishPoolRef pool, StarfishTaskProc proc, void* context, int count )
+	{
+	StarfishTaskSet* set = NewTaskSet( pool, proc, context, count > 0 ? count : 0 );
+	// No pool means run everything right here, in order.
+	if( !pool )
+		{
+		for( int i = 0; i < count; i++ ) proc( context, i );
+		set->mNext = set->mFinished = set->mCount;
+		}
+	else if( set->mCount > 0 )
+		{
+		pool->mRoot->Start( set );
+		}
+	return set;
+	}
+
+void FinishStarfishTasks( StarfishTasksRef set )
+	{
+	if( set->mPool ) set->mPool->Finish( set );
+	pthread_cond_destroy( &set->mDone );
+	delete set;
+	}
+
+void DumpStarfishPool( StarfishPoolRef pool )
+	{
+	delete pool;
+	}
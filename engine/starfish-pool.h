@@ -0,0 +1,85 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef STARFISH_POOL_H
+#define STARFISH_POOL_H
+
+typedef struct StarfishPoolRec			*StarfishPoolRef;
+typedef struct StarfishTaskSet			*StarfishTasksRef;
+
+/*
+A task proc is called once for every index from 0 to count-1.
+The calls happen on whatever threads the pool has available, in no
+particular order, so the proc must only touch state that belongs to
+its own index (a tile, a row, a file).
+*/
+typedef void (*StarfishTaskProc)( void* context, int index );
+
+/*
+Make a pool of worker threads.
+Pass zero for one thread per processor. The thread that hands work to
+the pool always helps out, so a pool of N threads starts N-1 workers.
+A pool may be shared: several threads can run task sets on it at once.
+
+RunStarfishTasks returns when every task has finished.
+StartStarfishTasks returns at once and leaves the tasks to the workers, so
+the caller can get on with something else; FinishStarfishTasks then helps
+with whatever is left, waits for the rest, and disposes of the task set.
+Every started task set must be finished exactly once.
+
+An idle pool's workers only run when nothing else wants the processor,
+which suits rendering ahead of time in the background. A thread that runs
+tasks on an idle pool should call LowerStarfishThreadPriority first, since
+it works on its own tasks too.
+
+A lane is a way into a pool for work of one priority, with a cap on how
+many threads any one of its task sets may run on at once; pass zero for
+no cap. Lanes share the pool's threads, and they are passed anywhere a
+pool is. Whenever a thread finishes a task it takes its next one from the
+highest priority task set waiting, so a STARFISH_PRIORITY_INTERACTIVE
+render starts within a tile of being handed to a pool that is busy with
+STARFISH_PRIORITY_BATCH work, and a capped batch lane leaves threads over
+that are ready for it at once. A plain pool has batch priority and no
+cap. Dump a pool's lanes before the pool itself.
+*/
+
+#define STARFISH_PRIORITY_BATCH 0
+#define STARFISH_PRIORITY_INTERACTIVE 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+StarfishPoolRef MakeStarfishPool( int threads );
+StarfishPoolRef MakeStarfishIdlePool( int threads );
+StarfishPoolRef MakeStarfishPoolLane( StarfishPoolRef pool, int priority, int maxThreads );
+void LowerStarfishThreadPriority( void );
+int StarfishPoolThreads( StarfishPoolRef pool );
+void RunStarfishTasks( StarfishPoolRef pool, StarfishTaskProc proc, void* context, int count );
+StarfishTasksRef StartStarfishTasks( StarfishPoolRef pool, StarfishTaskProc proc, void* context, int count );
+void FinishStarfishTasks( StarfishTasksRef tasks );
+void DumpStarfishPool( StarfishPoolRef pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //STARFISH_POOL_H
@@ -0,0 +1,400 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "starfish-render.h"
+#include "starfish-trace.h"
+
+void RenderStarfishRect( StarfishRef texture, pixel* dest, int rowPixels, int left, int top, int width, int height )
+	{
+	for( int y = 0; y < height; y++ )
+		{
+		pixel* row = dest + y * rowPixels;
+		for( int x = 0; x < width; x++ )
+			{
+			GetStarfishPixel( left + x, top + y, texture, &row[ x ] );
+			row[ x ].alpha = 0xFF;
+			}
+		}
+	}
+
+void RenderStarfishScaled( StarfishRef texture, int levelWidth, int levelHeight, pixel* dest, int rowPixels, int left, int top, int width, int height )
+	{
+	// At the texture's own size, take the exact path.
+	if( levelWidth == StarfishWidth( texture ) && levelHeight == StarfishHeight( texture ) )
+		{
+		RenderStarfishRect( texture, dest, rowPixels, left, top, width, height );
+		return;
+		}
+	double uScale = 1.0 / levelWidth;
+	double vScale = 1.0 / levelHeight;
+	for( int y = 0; y < height; y++ )
+		{
+		pixel* row = dest + y * rowPixels;
+		double v = (top + y) * vScale;
+		for( int x = 0; x < width; x++ )
+			{
+			GetStarfishSample( (left + x) * uScale, v, texture, &row[ x ] );
+			row[ x ].alpha = 0xFF;
+			}
+		}
+	}
+
+/*
+A job keeps the tile size it started with, whatever happens to the
+setting meanwhile.
+*/
+struct TileJob
+	{
+	StarfishRef mTexture;
+	pixel* mDest;
+	int mRowPixels;
+	int mWidth, mHeight;
+	int mTileSize;
+	int mAcross;
+	};
+
+static int SetUpTiles( TileJob* job, StarfishRef texture, pixel* dest, int rowPixels, int width, int height )
+	{
+	job->mTexture = texture;
+	job->mDest = dest;
+	job->mRowPixels = rowPixels;
+	job->mWidth = width;
+	job->mHeight = height;
+	job->mTileSize = StarfishTileSize();
+	job->mAcross = (width + job->mTileSize - 1) / job->mTileSize;
+	return job->mAcross * ((height + job->mTileSize - 1) / job->mTileSize);
+	}
+
+static void RenderTile( void* context, int index )
+	{
+	TileJob* job = (TileJob*) context;
+	int size = job->mTileSize;
+	int left = (index % job->mAcross) * size;
+	int top = (index / job->mAcross) * size;
+	int width = job->mWidth - left;
+	int height = job->mHeight - top;
+	if( width > size ) width = size;
+	if( height > size ) height = size;
+	double start = StarfishTraceClock();
+	RenderStarfishScaled( job->mTexture, job->mWidth, job->mHeight, job->mDest + top * job->mRowPixels + left, job->mRowPixels, left, top, width, height );
+	StarfishTraceSpan( "render", "tile", start, "left", left, "top", top );
+	}
+
+void RenderStarfish( StarfishRef texture, pixel* dest, int rowPixels, StarfishPoolRef pool )
+	{
+	RenderStarfishLevel( texture, StarfishWidth( texture ), StarfishHeight( texture ), dest, rowPixels, pool );
+	}
+
+void RenderStarfishLevel( StarfishRef texture, int levelWidth, int levelHeight, pixel* dest, int rowPixels, StarfishPoolRef pool )
+	{
+	TileJob job;
+	int tiles = SetUpTiles( &job, texture, dest, rowPixels, levelWidth, levelHeight );
+	double start = StarfishTraceClock();
+	RunStarfishTasks( pool, RenderTile, &job, tiles );
+	StarfishTraceSpan( "render", "render", start, "width", levelWidth, "height", levelHeight );
+	}
+
+struct PassJob
+	{
+	TileJob mTiles;
+	int mStep;
+	bool mFirst;
+	};
+
+static void RenderPassTile( void* context, int index )
+	{
+	PassJob* pass = (PassJob*) context;
+	TileJob* job = &pass->mTiles;
+	int step = pass->mStep;
+	int left = (index % job->mAcross) * job->mTileSize;
+	int top = (index / job->mAcross) * job->mTileSize;
+	int right = left + job->mTileSize;
+	int bottom = top + job->mTileSize;
+	if( right > job->mWidth ) right = job->mWidth;
+	if( bottom > job->mHeight ) bottom = job->mHeight;
+	double start = StarfishTraceClock();
+	// Tiles are a whole number of first steps across, so every tile
+	// starts on the grid of every pass.
+	for( int y = top; y < bottom; y += step )
+		{
+		pixel* row = job->mDest + y * job->mRowPixels;
+		// The pixels on the previous pass's grid are done already: that
+		// is every other one on even rows of this pass, and none on odd.
+		bool evenRow = ((y - top) / step) % 2 == 0;
+		for( int x = left; x < right; x += step )
+			{
+			if( !pass->mFirst && evenRow && ((x - left) / step) % 2 == 0 ) continue;
+			GetStarfishPixel( x, y, job->mTexture, &row[ x ] );
+			row[ x ].alpha = 0xFF;
+			}
+		}
+	StarfishTraceSpan( "render", "pass tile", start, "left", left, "top", top );
+	if( step == 1 ) return;
+	// Spread each known pixel over the square it stands for, until a
+	// later pass works out the rest.
+	for( int y = top; y < bottom; y++ )
+		{
+		pixel* row = job->mDest + y * job->mRowPixels;
+		const pixel* known = job->mDest + (y - (y - top) % step) * job->mRowPixels;
+		for( int x = left; x < right; x++ )
+			{
+			row[ x ] = known[ x - (x - left) % step ];
+			}
+		}
+	}
+
+int RenderStarfishProgressive( StarfishRef texture, pixel* dest, int rowPixels, StarfishPoolRef pool, StarfishRefineProc refine, void* context )
+	{
+	PassJob pass;
+	TileJob* job = &pass.mTiles;
+	int tiles = SetUpTiles( job, texture, dest, rowPixels, StarfishWidth( texture ), StarfishHeight( texture ) );
+	pass.mFirst = true;
+	for( pass.mStep = STARFISH_FIRST_STEP; pass.mStep >= 1; pass.mStep /= 2 )
+		{
+		double start = StarfishTraceClock();
+		RunStarfishTasks( pool, RenderPassTile, &pass, tiles );
+		StarfishTraceSpan( "render", "pass", start, "step", pass.mStep, NULL, 0 );
+		pass.mFirst = false;
+		if( refine && !refine( context, pass.mStep, 0, 0, job->mWidth, job->mHeight ) ) return 0;
+		}
+	return 1;
+	}
+
+/*
+A job hands out its tiles in order. The counters are shared between the
+threads working on it and whoever is watching, so they are only ever
+touched atomically.
+*/
+struct StarfishRenderJob
+	{
+	TileJob mTiles;
+	int mTileCount;
+	int mNext;
+	int mDone;
+	int mCancelled;
+	double mDeadline;
+	};
+
+static double Seconds( void )
+	{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec + now.tv_nsec * 1e-9;
+	}
+
+// Every thread's slice is alike: each takes tiles until time runs out.
+static void RenderJobSlice( void* context, int )
+	{
+	StarfishRenderJob* job = (StarfishRenderJob*) context;
+	while( !__atomic_load_n( &job->mCancelled, __ATOMIC_RELAXED ) && Seconds() < job->mDeadline )
+		{
+		int tile = __atomic_fetch_add( &job->mNext, 1, __ATOMIC_RELAXED );
+		if( tile >= job->mTileCount )
+			{
+			// Leave the counter where it belongs for the next call.
+			__atomic_fetch_sub( &job->mNext, 1, __ATOMIC_RELAXED );
+			break;
+			}
+		RenderTile( &job->mTiles, tile );
+		__atomic_fetch_add( &job->mDone, 1, __ATOMIC_RELEASE );
+		}
+	}
+
+StarfishJobRef MakeStarfishJob( StarfishRef texture, pixel* dest, int rowPixels )
+	{
+	StarfishRenderJob* job = new StarfishRenderJob;
+	job->mTileCount = SetUpTiles( &job->mTiles, texture, dest, rowPixels, StarfishWidth( texture ), StarfishHeight( texture ) );
+	job->mNext = 0;
+	job->mDone = 0;
+	job->mCancelled = 0;
+	return job;
+	}
+
+int RenderStarfishFor( StarfishJobRef job, int milliseconds, StarfishPoolRef pool )
+	{
+	job->mDeadline = Seconds() + milliseconds / 1000.0;
+	// One slice per thread; each keeps taking tiles until time is up.
+	RunStarfishTasks( pool, RenderJobSlice, job, StarfishPoolThreads( pool ) );
+	return !__atomic_load_n( &job->mCancelled, __ATOMIC_RELAXED ) &&
+		__atomic_load_n( &job->mDone, __ATOMIC_ACQUIRE ) == job->mTileCount;
+	}
+
+void CancelStarfishJob( StarfishJobRef job )
+	{
+	__atomic_store_n( &job->mCancelled, 1, __ATOMIC_RELAXED );
+	}
+
+int StarfishJobCancelled( StarfishJobRef job )
+	{
+	return __atomic_load_n( &job->mCancelled, __ATOMIC_RELAXED );
+	}
+
+void StarfishJobProgress( StarfishJobRef job, int* done, int* total )
+	{
+	*done = __atomic_load_n( &job->mDone, __ATOMIC_ACQUIRE );
+	*total = job->mTileCount;
+	}
+
+void DumpStarfishJob( StarfishJobRef job )
+	{
+	delete job;
+	}
+
+#pragma mark -
+#pragma mark Tuning
+
+static pthread_once_t gTuningOnce = PTHREAD_ONCE_INIT;
+static int gTileSize = STARFISH_TILE_SIZE;
+static int gTunedThreads;
+static char gTuningPath[ 1024 ];
+
+static int RoundTileSize( int size )
+	{
+	size = (size + STARFISH_FIRST_STEP / 2) / STARFISH_FIRST_STEP * STARFISH_FIRST_STEP;
+	if( size < STARFISH_FIRST_STEP ) size = STARFISH_FIRST_STEP;
+	return size > STARFISH_MAX_TILE_SIZE ? STARFISH_MAX_TILE_SIZE : size;
+	}
+
+static bool TuningDirectory( char* path, size_t size, bool make )
+	{
+	const char* base = getenv( "XDG_CONFIG_HOME" );
+	int length;
+	if( base && *base ) length = snprintf( path, size, "%s", base );
+	else
+		{
+		const char* home = getenv( "HOME" );
+		if( !home || !*home ) return false;
+		length = snprintf( path, size, "%s/.config", home );
+		}
+	if( length < 0 || (size_t) length >= size ) return false;
+	if( make ) mkdir( path, 0755 );
+	length += snprintf( path + length, size - length, "/starfish" );
+	if( (size_t) length >= size ) return false;
+	return !make || !mkdir( path, 0755 ) || errno == EEXIST;
+	}
+
+static int ReadTuning( const char* path, bool useCosts )
+	{
+	char line[ 256 ], name[ 64 ];
+	int version = 0, threads = 0, tileSize = 0;
+	double cost;
+	FILE* in = path ? fopen( path, "r" ) : NULL;
+	if( !in ) return 0;
+	while( fgets( line, sizeof( line ), in ) )
+		{
+		// Anything not understood is passed over, for the sake of
+		// tunings from later versions.
+		if( sscanf( line, "version %d", &version ) == 1 ) continue;
+		if( sscanf( line, "threads %d", &threads ) == 1 ) continue;
+		if( sscanf( line, "tile-size %d", &tileSize ) == 1 ) continue;
+		if( useCosts && version == STARFISH_TUNING_VERSION
+				&& sscanf( line, "cost %63s %lf", name, &cost ) == 2 )
+			{
+			for( int kind = 0; kind < StarfishNodeKinds(); kind++ )
+				{
+				if( !strcmp( name, StarfishNodeName( kind ) ) ) SetStarfishNodeCost( kind, cost );
+				}
+			}
+		}
+	fclose( in );
+	if( version != STARFISH_TUNING_VERSION ) return 0;
+	if( tileSize > 0 ) gTileSize = RoundTileSize( tileSize );
+	if( threads > 0 ) gTunedThreads = threads;
+	return 1;
+	}
+
+static void ReadUsualTuning( void )
+	{
+	if( TuningDirectory( gTuningPath, sizeof( gTuningPath ) - 8, false ) )
+		{
+		strcat( gTuningPath, "/tuning" );
+		ReadTuning( gTuningPath, false );
+		}
+	else gTuningPath[ 0 ] = 0;
+	}
+
+int StarfishTileSize( void )
+	{
+	pthread_once( &gTuningOnce, ReadUsualTuning );
+	return gTileSize;
+	}
+
+void SetStarfishTileSize( int size )
+	{
+	// Read the tuning first, so that it can't overrule this later.
+	pthread_once( &gTuningOnce, ReadUsualTuning );
+	gTileSize = RoundTileSize( size );
+	}
+
+int StarfishTunedThreads( void )
+	{
+	pthread_once( &gTuningOnce, ReadUsualTuning );
+	return gTunedThreads;
+	}
+
+const char* StarfishTuningPath( void )
+	{
+	pthread_once( &gTuningOnce, ReadUsualTuning );
+	return gTuningPath[ 0 ] ? gTuningPath : NULL;
+	}
+
+int LoadStarfishTuning( const char* path, int useCosts )
+	{
+	pthread_once( &gTuningOnce, ReadUsualTuning );
+	return ReadTuning( path ? path : StarfishTuningPath(), useCosts );
+	}
+
+int SaveStarfishTuning( const char* path, int threads )
+	{
+	char directory[ 1024 ], temporary[ 1100 ];
+	if( !path )
+		{
+		if( !TuningDirectory( directory, sizeof( directory ), true ) ) return 0;
+		path = StarfishTuningPath();
+		if( !path ) return 0;
+		}
+	// Write it whole under another name and rename it into place, so that
+	// a render starting meanwhile reads the old tuning or the new one.
+	snprintf( temporary, sizeof( temporary ), "%s.%d", path, (int) getpid() );
+	FILE* out = fopen( temporary, "w" );
+	if( !out ) return 0;
+	fprintf( out, "# what renders fastest here, as found by starfish-tune\n" );
+	fprintf( out, "version %d\n", STARFISH_TUNING_VERSION );
+	fprintf( out, "threads %d\n", threads );
+	fprintf( out, "tile-size %d\n", StarfishTileSize() );
+	for( int kind = 0; kind < StarfishNodeKinds(); kind++ )
+		{
+		fprintf( out, "cost %s %.2f\n", StarfishNodeName( kind ), StarfishNodeCost( kind ) );
+		}
+	bool ok = !ferror( out );
+	if( fclose( out ) ) ok = false;
+	if( ok ) ok = !rename( temporary, path );
+	if( !ok ) unlink( temporary );
+	return ok;
+	}
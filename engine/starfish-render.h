@@ -0,0 +1,129 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef STARFISH_RENDER_H
+#define STARFISH_RENDER_H
+
+#include "starfish-engine.h"
+#include "starfish-pool.h"
+
+/*
+Fill pixel buffers from a starfish texture.
+dest always points at the slot for the rectangle's top left pixel, and
+rowPixels is the distance in pixels from one row of dest to the next.
+Rendered pixels are always opaque.
+
+RenderStarfishRect renders part of the texture at its own size, pixel for
+pixel identical to GetStarfishPixel.
+RenderStarfishScaled renders part of the texture as though it were
+levelWidth by levelHeight pixels, using resolution-independent samples.
+RenderStarfish renders the whole texture, one tile per task on the pool;
+RenderStarfishLevel does the same at levelWidth by levelHeight.
+A NULL pool renders on the calling thread.
+*/
+
+/*
+Tiles are StarfishTileSize() pixels on a side: STARFISH_TILE_SIZE, unless
+the tuning (below) or SetStarfishTileSize says otherwise. A size is
+rounded to a whole number of STARFISH_FIRST_STEP pixels, from 8 to 1024.
+A render keeps the tile size it started with.
+*/
+#define STARFISH_TILE_SIZE 64
+#define STARFISH_MAX_TILE_SIZE 1024
+
+/*
+RenderStarfishProgressive renders the whole texture in interlaced passes,
+so that a usable picture of all of it is there almost at once. The first
+pass works out one pixel in every STARFISH_FIRST_STEP square and fills
+the square with it; each pass after that halves the step and works out
+only the pixels that no earlier pass did, filling in the smaller squares,
+until the last pass at step 1 leaves every pixel exact. Nothing is
+evaluated twice, so the whole thing costs about what RenderStarfish does.
+After each pass, refine is called on the calling thread with that pass's
+step and the region that changed; it can show the picture so far, and it
+returns zero to stop the render there.
+*/
+#define STARFISH_FIRST_STEP 8
+
+typedef int (*StarfishRefineProc)( void* context, int step, int left, int top, int width, int height );
+
+/*
+A render job renders a whole texture a slice at a time, for callers that
+have other things to do in between, such as answering X events.
+RenderStarfishFor works on the job for about the given number of
+milliseconds, then returns; the next call carries on where it stopped.
+It returns nonzero once every pixel is done. Time is measured in whole
+tiles, so a call can run over by about one tile's worth.
+CancelStarfishJob can be called from any thread, even during
+RenderStarfishFor, which then returns as soon as the tiles in hand are
+finished; a cancelled job never finishes. StarfishJobProgress can also
+be called from any thread, and reports how many tiles are done out of
+how many there are.
+*/
+typedef struct StarfishRenderJob *StarfishJobRef;
+
+/*
+A tuning is what starfish-tune found renders fastest on this machine:
+the tile size, how many threads, and what each kind of node costs. It
+lives in $XDG_CONFIG_HOME/starfish/tuning, or ~/.config/starfish/tuning,
+one setting to a line. The first call that needs a tile size reads it,
+and StarfishTunedThreads then gives the thread count it found best for
+a pool, or zero if there is none. The costs are only put to use when
+asked for, since the cost model decides which pattern
+MakeStarfishWithin makes from a seed.
+LoadStarfishTuning reads a tuning from path, or the usual place for
+NULL, and returns zero if there is none; pass nonzero useCosts to put
+its costs into the cost model as well. SaveStarfishTuning writes the
+tile size, the given thread count and the cost model's costs as they
+are now, making the directory if need be. StarfishTuningPath gives the
+usual place, or NULL if there is no home directory to put it in.
+*/
+#define STARFISH_TUNING_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void RenderStarfishRect( StarfishRef texture, pixel* dest, int rowPixels, int left, int top, int width, int height );
+void RenderStarfishScaled( StarfishRef texture, int levelWidth, int levelHeight, pixel* dest, int rowPixels, int left, int top, int width, int height );
+void RenderStarfish( StarfishRef texture, pixel* dest, int rowPixels, StarfishPoolRef pool );
+void RenderStarfishLevel( StarfishRef texture, int levelWidth, int levelHeight, pixel* dest, int rowPixels, StarfishPoolRef pool );
+int RenderStarfishProgressive( StarfishRef texture, pixel* dest, int rowPixels, StarfishPoolRef pool, StarfishRefineProc refine, void* context );
+
+StarfishJobRef MakeStarfishJob( StarfishRef texture, pixel* dest, int rowPixels );
+int RenderStarfishFor( StarfishJobRef job, int milliseconds, StarfishPoolRef pool );
+void CancelStarfishJob( StarfishJobRef job );
+int StarfishJobCancelled( StarfishJobRef job );
+void StarfishJobProgress( StarfishJobRef job, int* done, int* total );
+void DumpStarfishJob( StarfishJobRef job );
+
+int StarfishTileSize( void );
+void SetStarfishTileSize( int size );
+int StarfishTunedThreads( void );
+int LoadStarfishTuning( const char* path, int useCosts );
+int SaveStarfishTuning( const char* path, int threads );
+const char* StarfishTuningPath( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //STARFISH_RENDER_H
@@ -0,0 +1,182 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "starfish-trace.h"
+
+#define kDefaultEvents (1 << 20)
+#define kMaxThreads 1024
+
+/*
+Spans go into one array, each thread claiming its next slot with an
+atomic increment, and marking the slot ready once it has filled it in,
+so that the writer never sees half a span.
+*/
+struct TraceEvent
+	{
+	const char* mCategory;
+	const char* mName;
+	double mStart;
+	double mDuration;
+	long mThread;
+	const char* mArgs[ 2 ];
+	long mValues[ 2 ];
+	int mReady;
+	};
+
+struct ThreadName
+	{
+	long mThread;
+	const char* mName;
+	int mReady;
+	};
+
+static int gTracing;
+static double gEpoch;
+static TraceEvent* gEvents;
+static int gCapacity;
+static int gNext;
+static int gDropped;
+static ThreadName gThreads[ kMaxThreads ];
+static int gThreadCount;
+
+static double Microseconds( void )
+	{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec * 1e6 + now.tv_nsec * 1e-3;
+	}
+
+static long ThreadID( void )
+	{
+	static __thread long tThread;
+	if( !tThread ) tThread = syscall( SYS_gettid );
+	return tThread;
+	}
+
+void StartStarfishTrace( int maxEvents )
+	{
+	if( gTracing ) return;
+	gCapacity = maxEvents > 0 ? maxEvents : kDefaultEvents;
+	gEvents = new TraceEvent[ gCapacity ];
+	for( int i = 0; i < gCapacity; i++ ) gEvents[ i ].mReady = 0;
+	gNext = 0;
+	gDropped = 0;
+	gThreadCount = 0;
+	gEpoch = Microseconds();
+	__atomic_store_n( &gTracing, 1, __ATOMIC_RELEASE );
+	}
+
+double StarfishTraceClock( void )
+	{
+	if( !__atomic_load_n( &gTracing, __ATOMIC_RELAXED ) ) return 0;
+	// Never zero, which means nothing is being traced.
+	double now = Microseconds() - gEpoch;
+	return now > 0 ? now : 1e-3;
+	}
+
+void StarfishTraceSpan( const char* category, const char* name, double start,
+		const char* arg1, long value1, const char* arg2, long value2 )
+	{
+	if( start <= 0 || !__atomic_load_n( &gTracing, __ATOMIC_ACQUIRE ) ) return;
+	double end = Microseconds() - gEpoch;
+	int slot = __atomic_fetch_add( &gNext, 1, __ATOMIC_RELAXED );
+	if( slot >= gCapacity )
+		{
+		__atomic_fetch_add( &gDropped, 1, __ATOMIC_RELAXED );
+		return;
+		}
+	TraceEvent* event = &gEvents[ slot ];
+	event->mCategory = category;
+	event->mName = name;
+	event->mStart = start;
+	event->mDuration = end - start;
+	event->mThread = ThreadID();
+	event->mArgs[ 0 ] = arg1;
+	event->mValues[ 0 ] = value1;
+	event->mArgs[ 1 ] = arg2;
+	event->mValues[ 1 ] = value2;
+	__atomic_store_n( &event->mReady, 1, __ATOMIC_RELEASE );
+	}
+
+void NameStarfishTraceThread( const char* name )
+	{
+	if( !__atomic_load_n( &gTracing, __ATOMIC_ACQUIRE ) ) return;
+	int slot = __atomic_fetch_add( &gThreadCount, 1, __ATOMIC_RELAXED );
+	if( slot >= kMaxThreads ) return;
+	gThreads[ slot ].mThread = ThreadID();
+	gThreads[ slot ].mName = name;
+	__atomic_store_n( &gThreads[ slot ].mReady, 1, __ATOMIC_RELEASE );
+	}
+
+static void WriteArgs( FILE* out, const TraceEvent* event )
+	{
+	bool any = false;
+	for( int i = 0; i < 2; i++ )
+		{
+		if( !event->mArgs[ i ] ) continue;
+		fprintf( out, "%s\"%s\": %ld", any ? ", " : ", \"args\": {", event->mArgs[ i ], event->mValues[ i ] );
+		any = true;
+		}
+	if( any ) fputc( '}', out );
+	}
+
+int FinishStarfishTrace( const char* path )
+	{
+	if( !__atomic_load_n( &gTracing, __ATOMIC_ACQUIRE ) ) return 0;
+	// Stop first, so that nothing new turns up while writing.
+	__atomic_store_n( &gTracing, 0, __ATOMIC_RELEASE );
+	FILE* out = fopen( path, "w" );
+	int pid = (int) getpid();
+	int count = __atomic_load_n( &gNext, __ATOMIC_ACQUIRE );
+	int threads = __atomic_load_n( &gThreadCount, __ATOMIC_ACQUIRE );
+	if( count > gCapacity ) count = gCapacity;
+	if( threads > kMaxThreads ) threads = kMaxThreads;
+	if( out )
+		{
+		fprintf( out, "{\"displayTimeUnit\": \"ms\",\n\"otherData\": {\"dropped_spans\": %d},\n\"traceEvents\": [\n",
+			__atomic_load_n( &gDropped, __ATOMIC_RELAXED ) );
+		fprintf( out, "{\"ph\": \"M\", \"pid\": %d, \"name\": \"process_name\", \"args\": {\"name\": \"starfish\"}}", pid );
+		for( int i = 0; i < threads; i++ )
+			{
+			if( !__atomic_load_n( &gThreads[ i ].mReady, __ATOMIC_ACQUIRE ) ) continue;
+			fprintf( out, ",\n{\"ph\": \"M\", \"pid\": %d, \"tid\": %ld, \"name\": \"thread_name\", \"args\": {\"name\": \"%s\"}}",
+				pid, gThreads[ i ].mThread, gThreads[ i ].mName );
+			}
+		for( int i = 0; i < count; i++ )
+			{
+			const TraceEvent* event = &gEvents[ i ];
+			if( !__atomic_load_n( &event->mReady, __ATOMIC_ACQUIRE ) ) continue;
+			fprintf( out, ",\n{\"ph\": \"X\", \"pid\": %d, \"tid\": %ld, \"cat\": \"%s\", \"name\": \"%s\", \"ts\": %.3f, \"dur\": %.3f",
+				pid, event->mThread, event->mCategory, event->mName, event->mStart, event->mDuration );
+			WriteArgs( out, event );
+			fputc( '}', out );
+			}
+		fprintf( out, "\n]}\n" );
+		}
+	// Threads that were in the middle of a span when tracing stopped may
+	// still be writing to their slots; leave the array be.
+	return out && fclose( out ) == 0;
+	}
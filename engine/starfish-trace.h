@@ -0,0 +1,66 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef STARFISH_TRACE_H
+#define STARFISH_TRACE_H
+
+/*
+A trace is a timeline of what each thread spent its time on: building
+trees, rendering tiles, waiting for work, encoding, uploading. It is
+written as Chrome trace-event JSON, which Perfetto (ui.perfetto.dev)
+and chrome://tracing open offline, one track per thread.
+
+StartStarfishTrace begins recording, with room for maxEvents spans, or
+a generous default for zero; any more than that are dropped and counted.
+FinishStarfishTrace writes everything recorded to the file, stops, and
+returns zero if the file could not be written. Threads that are still
+running may keep calling in meanwhile; their spans just go unrecorded.
+
+StarfishTraceClock gives the time at which a span starts, or zero when
+nothing is being recorded, which makes spans cost next to nothing when
+it isn't. StarfishTraceSpan records a span on the calling thread from
+start until now, with up to two named numbers; pass NULL for a name to
+leave it out. Only the pointers to names are kept, so they must be
+string constants. NameStarfishTraceThread names the calling thread's
+track.
+
+The engine itself only records its spans, building and loading trees,
+when it is built with STARFISH_TRACE defined to 1. Otherwise it needs
+nothing from here, which this file's Linux thread ids would not allow
+on other systems.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void StartStarfishTrace( int maxEvents );
+int FinishStarfishTrace( const char* path );
+double StarfishTraceClock( void );
+void StarfishTraceSpan( const char* category, const char* name, double start,
+		const char* arg1, long value1, const char* arg2, long value2 );
+void NameStarfishTraceThread( const char* name );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //STARFISH_TRACE_H
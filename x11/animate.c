@@ -0,0 +1,116 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "starfish-engine.h"
+#include "starfish-render.h"
+#include "setdesktop.h"
+#include "animate.h"
+
+/* never render at less than this fraction of the target's width */
+#define MIN_SCALE 0.125
+
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Pause(double seconds)
+{
+	struct timespec wait;
+	if(seconds <= 0.0) return;
+	wait.tv_sec = (time_t) seconds;
+	wait.tv_nsec = (long) ((seconds - wait.tv_sec) * 1e9);
+	nanosleep(&wait, NULL);
+}
+
+/*
+The cost of a frame goes with its area, so to bring the next frame in on
+budget we scale each side by the square root of how far off this one
+was. Going down happens at once; coming back up is limited to a tenth per
+frame, so one quick frame doesn't throw the next one over budget.
+*/
+static double NextScale(double scale, double frameTime, double budget)
+{
+	double wanted;
+	if(frameTime <= 0.0) return 1.0;
+	wanted = scale * sqrt(budget / frameTime);
+	if(frameTime > budget * 1.1) scale = wanted;
+	else if(frameTime < budget * 0.8) scale = (wanted < scale * 1.1) ? wanted : scale * 1.1;
+	if(scale > 1.0) scale = 1.0;
+	if(scale < MIN_SCALE) scale = MIN_SCALE;
+	return scale;
+}
+
+int RunAnimation(StarfishRef texture, int inWindow, int width, int height,
+	double period, double fps, StarfishPoolRef pool)
+{
+	double budget = 1.0 / fps;
+	double scale = 1.0;
+	double start, frameStart, phase;
+	pixel* frame;
+	int frameWidth, frameHeight;
+
+	if(!BeginXAnimation(inWindow, width, height)) return 1;
+	if(!XAnimationEvents(&width, &height))
+	{
+		EndXAnimation();
+		return 0;
+	}
+	frame = malloc((size_t) width * height * sizeof(pixel));
+	if(!frame)
+	{
+		EndXAnimation();
+		return 1;
+	}
+	start = Now();
+	for(;;)
+	{
+		int oldWidth = width, oldHeight = height;
+		frameStart = Now();
+		if(!XAnimationEvents(&width, &height)) break;
+		if(width * height > oldWidth * oldHeight)
+		{
+			pixel* bigger = realloc(frame, (size_t) width * height * sizeof(pixel));
+			if(!bigger) break;
+			frame = bigger;
+		}
+		phase = fmod((frameStart - start) / period, 1.0);
+		AnimateStarfish(texture, phase);
+		frameWidth = (int) (width * scale);
+		frameHeight = (int) (height * scale);
+		if(frameWidth < 1) frameWidth = 1;
+		if(frameHeight < 1) frameHeight = 1;
+		RenderStarfishLevel(texture, frameWidth, frameHeight, frame, frameWidth, pool);
+		ShowXFrame(frame, frameWidth, frameHeight, pool);
+		scale = NextScale(scale, Now() - frameStart, budget);
+		Pause(budget - (Now() - frameStart));
+	}
+	free(frame);
+	EndXAnimation();
+	return 0;
+}
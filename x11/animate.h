@@ -0,0 +1,37 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "starfish-pool.h"
+
+#define ANIMATION_DEFAULT_FPS 30.0
+#define ANIMATION_DEFAULT_PERIOD 60.0	/* seconds for the pattern to come full circle */
+
+/*
+Play the texture as a looping animation, in a window of width by height
+or on the root window, until the window is closed. The desktop must be
+open. Frames are rendered at whatever fraction of the target's size
+lets them keep up with fps, and stretched to fit; the fraction climbs
+back towards full size whenever there is time to spare.
+*/
+int RunAnimation(StarfishRef texture, int inWindow, int width, int height,
+	double period, double fps, StarfishPoolRef pool);
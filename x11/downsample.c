@@ -0,0 +1,312 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "starfish-engine.h"
+#include "downsample.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* dest rows per task when reducing */
+#define REDUCE_BAND 16
+
+/* a Kaiser-windowed sinc reaches this many destination pixels each way */
+#define KAISER_RADIUS 3.0
+#define KAISER_BETA 4.0
+
+void HalvePixels(const pixel* src, int width, int height, int srcRow,
+	pixel* dest, int destRow, int firstRow, int rowCount)
+{
+	int x, y;
+	int halfWidth = HALF_SIZE(width);
+
+	for(y = firstRow; y < firstRow + rowCount; y++)
+	{
+		const pixel* top = src + (size_t) (y * 2) * srcRow;
+		const pixel* bottom = (y * 2 + 1 < height) ? top + srcRow : top;
+		pixel* out = dest + (size_t) y * destRow;
+		for(x = 0; x < halfWidth; x++)
+		{
+			int left = x * 2;
+			int right = (left + 1 < width) ? left + 1 : left;
+			out[x].red = (top[left].red + top[right].red +
+				bottom[left].red + bottom[right].red + 2) >> 2;
+			out[x].green = (top[left].green + top[right].green +
+				bottom[left].green + bottom[right].green + 2) >> 2;
+			out[x].blue = (top[left].blue + top[right].blue +
+				bottom[left].blue + bottom[right].blue + 2) >> 2;
+			out[x].alpha = 0xFF;
+		}
+	}
+}
+
+/*
+The general reducer is separable. For each destination column (and row)
+we precompute which source columns contribute and how much; the first
+tap may be negative or the last past the edge, and those wrap around.
+*/
+typedef struct
+{
+	int* first;
+	int* count;
+	float* weight;	/* maxTaps weights for each destination index */
+	int maxTaps;
+} Taps;
+
+typedef struct
+{
+	const pixel* src;
+	int width, height;
+	pixel* dest;
+	int destWidth, destHeight;
+	Taps xTaps, yTaps;
+	int failed;	/* a band couldn't get its memory */
+} Reduction;
+
+static double BesselI0(double x)
+{
+	/* the power series converges quickly for the betas we use */
+	double sum = 1.0, term = 1.0;
+	int k;
+	for(k = 1; k < 50 && term > sum * 1e-12; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static double KaiserSinc(double d, double scale)
+{
+	double t = d / (KAISER_RADIUS * scale);
+	double sinc;
+	if(t <= -1.0 || t >= 1.0) return 0.0;
+	d /= scale;
+	sinc = (d == 0.0) ? 1.0 : sin(M_PI * d) / (M_PI * d);
+	return sinc * BesselI0(KAISER_BETA * sqrt(1.0 - t * t)) / BesselI0(KAISER_BETA);
+}
+
+static int MakeTaps(Taps* taps, int n, int m, int filter)
+{
+	double scale = (double) n / m;
+	int i, j;
+
+	if(filter == MIP_FILTER_KAISER)
+		taps->maxTaps = 2 * (int) ceil(KAISER_RADIUS * scale) + 2;
+	else
+		taps->maxTaps = (int) ceil(scale) + 2;
+	taps->first = malloc(m * sizeof(int));
+	taps->count = malloc(m * sizeof(int));
+	taps->weight = malloc((size_t) m * taps->maxTaps * sizeof(float));
+	if(!taps->first || !taps->count || !taps->weight) return 0;
+
+	for(i = 0; i < m; i++)
+	{
+		float* weight = taps->weight + (size_t) i * taps->maxTaps;
+		double total = 0.0;
+		if(filter == MIP_FILTER_KAISER)
+		{
+			/* centre of this destination pixel, in source pixels */
+			double centre = (i + 0.5) * scale - 0.5;
+			double reach = KAISER_RADIUS * scale;
+			taps->first[i] = (int) ceil(centre - reach);
+			taps->count[i] = (int) floor(centre + reach) - taps->first[i] + 1;
+			if(taps->count[i] > taps->maxTaps) taps->count[i] = taps->maxTaps;
+			for(j = 0; j < taps->count[i]; j++)
+				weight[j] = KaiserSinc(taps->first[i] + j - centre, scale);
+		}
+		else
+		{
+			/* weight each source pixel by how much of it we cover */
+			double left = i * scale, right = (i + 1) * scale;
+			taps->first[i] = (int) floor(left);
+			taps->count[i] = (int) ceil(right) - taps->first[i];
+			for(j = 0; j < taps->count[i]; j++)
+			{
+				double lo = taps->first[i] + j, hi = lo + 1.0;
+				if(lo < left) lo = left;
+				if(hi > right) hi = right;
+				weight[j] = hi - lo;
+			}
+		}
+		for(j = 0; j < taps->count[i]; j++) total += weight[j];
+		for(j = 0; j < taps->count[i]; j++) weight[j] /= total;
+	}
+	return 1;
+}
+
+static void FreeTaps(Taps* taps)
+{
+	free(taps->first);
+	free(taps->count);
+	free(taps->weight);
+}
+
+static int Wrap(int i, int n)
+{
+	i %= n;
+	return i < 0 ? i + n : i;
+}
+
+static unsigned char Clamp(float f)
+{
+	if(f <= 0.0f) return 0;
+	if(f >= 255.0f) return 255;
+	return (unsigned char) (f + 0.5f);
+}
+
+static void ReduceTask(void* context, int index)
+{
+	Reduction* r = context;
+	int first = index * REDUCE_BAND;
+	int last = first + REDUCE_BAND;
+	float* row = malloc((size_t) r->width * 3 * sizeof(float));
+	int x, y, j;
+
+	if(!row)
+	{
+		r->failed = 1;
+		return;
+	}
+	if(last > r->destHeight) last = r->destHeight;
+	for(y = first; y < last; y++)
+	{
+		const float* yWeight = r->yTaps.weight + (size_t) y * r->yTaps.maxTaps;
+		pixel* out = r->dest + (size_t) y * r->destWidth;
+
+		/* vertical pass into a row of floats */
+		for(x = 0; x < r->width * 3; x++) row[x] = 0.0f;
+		for(j = 0; j < r->yTaps.count[y]; j++)
+		{
+			const pixel* in = r->src + (size_t) Wrap(r->yTaps.first[y] + j, r->height) * r->width;
+			float w = yWeight[j];
+			for(x = 0; x < r->width; x++)
+			{
+				row[x * 3] += in[x].red * w;
+				row[x * 3 + 1] += in[x].green * w;
+				row[x * 3 + 2] += in[x].blue * w;
+			}
+		}
+
+		/* then across */
+		for(x = 0; x < r->destWidth; x++)
+		{
+			const float* xWeight = r->xTaps.weight + (size_t) x * r->xTaps.maxTaps;
+			float red = 0.0f, green = 0.0f, blue = 0.0f;
+			for(j = 0; j < r->xTaps.count[x]; j++)
+			{
+				const float* in = row + Wrap(r->xTaps.first[x] + j, r->width) * 3;
+				red += in[0] * xWeight[j];
+				green += in[1] * xWeight[j];
+				blue += in[2] * xWeight[j];
+			}
+			out[x].red = Clamp(red);
+			out[x].green = Clamp(green);
+			out[x].blue = Clamp(blue);
+			out[x].alpha = 0xFF;
+		}
+	}
+	free(row);
+}
+
+/*
+Exact halving: every destination pixel is the rounded average of a 2x2
+block, so nothing ever wraps. This is the step every mip level after the
+first takes on power-of-two textures, so it gets the fast path.
+*/
+static void HalveTask(void* context, int index)
+{
+	Reduction* r = context;
+	int first = index * REDUCE_BAND;
+	int last = first + REDUCE_BAND;
+	int x, y;
+
+	if(last > r->destHeight) last = r->destHeight;
+	for(y = first; y < last; y++)
+	{
+		const pixel* top = r->src + (size_t) (y * 2) * r->width;
+		const pixel* bottom = top + r->width;
+		pixel* out = r->dest + (size_t) y * r->destWidth;
+		x = 0;
+#if defined(__SSE2__)
+		{
+		/* two destination pixels from four source pixels on each row */
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for(; x + 2 <= r->destWidth; x += 2)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*) (top + x * 2));
+			__m128i b = _mm_loadu_si128((const __m128i*) (bottom + x * 2));
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+			lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+			hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+			lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+			_mm_storel_epi64((__m128i*) (out + x), _mm_packus_epi16(lo, lo));
+		}
+		}
+#endif
+		for(; x < r->destWidth; x++)
+		{
+			const pixel* a = top + x * 2;
+			const pixel* b = bottom + x * 2;
+			out[x].red = (a[0].red + a[1].red + b[0].red + b[1].red + 2) >> 2;
+			out[x].green = (a[0].green + a[1].green + b[0].green + b[1].green + 2) >> 2;
+			out[x].blue = (a[0].blue + a[1].blue + b[0].blue + b[1].blue + 2) >> 2;
+			out[x].alpha = (a[0].alpha + a[1].alpha + b[0].alpha + b[1].alpha + 2) >> 2;
+		}
+	}
+}
+
+int ReduceWrappedPixels(const pixel* src, int width, int height,
+	pixel* dest, int destWidth, int destHeight, int filter, StarfishPoolRef pool)
+{
+	Reduction r;
+	int bands = (destHeight + REDUCE_BAND - 1) / REDUCE_BAND;
+
+	memset(&r, 0, sizeof(r));
+	r.src = src;
+	r.width = width;
+	r.height = height;
+	r.dest = dest;
+	r.destWidth = destWidth;
+	r.destHeight = destHeight;
+	if(filter == MIP_FILTER_BOX && width == destWidth * 2 && height == destHeight * 2)
+	{
+		RunStarfishTasks(pool, HalveTask, &r, bands);
+		return 1;
+	}
+	if(MakeTaps(&r.xTaps, width, destWidth, filter) &&
+		MakeTaps(&r.yTaps, height, destHeight, filter))
+	{
+		RunStarfishTasks(pool, ReduceTask, &r, bands);
+	}
+	else r.failed = 1;
+	FreeTaps(&r.xTaps);
+	FreeTaps(&r.yTaps);
+	return !r.failed;
+}
@@ -0,0 +1,54 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "starfish-pool.h"
+
+/* size of an image after halving: odd sizes round up */
+#define HALF_SIZE(n) (((n) + 1) / 2)
+
+/*
+Halve an image with a 2x2 box filter. The odd row or column at the
+bottom or right edge is clamped rather than averaged with nothing.
+Only dest rows firstRow .. firstRow+rowCount-1 are produced, so callers
+can split the work into bands.
+*/
+void HalvePixels(const pixel* src, int width, int height, int srcRow,
+	pixel* dest, int destRow, int firstRow, int rowCount);
+
+/*
+Mip chains use the usual graphics API sizes: each level is half the size
+of the one above, rounded down, and never less than one pixel.
+*/
+#define MIP_SIZE(n) ((n) > 1 ? (n) / 2 : 1)
+
+#define MIP_FILTER_BOX 0	/* area average */
+#define MIP_FILTER_KAISER 1	/* Kaiser-windowed sinc: sharper, a little slower */
+
+/*
+Shrink a tileable image to destWidth by destHeight. The filter wraps
+around the edges, so the result tiles as seamlessly as the source did.
+An exact halving with the box filter takes a SIMD fast path. Returns
+zero if there wasn't the memory for it, and dest is then unfinished.
+*/
+int ReduceWrappedPixels(const pixel* src, int width, int height,
+	pixel* dest, int destWidth, int destHeight, int filter, StarfishPoolRef pool);
@@ -0,0 +1,338 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include "starfish-engine.h"
+#include "starfish-render.h"
+#include "setdesktop.h"
+#include "hack.h"
+
+/* the background render checks in this often */
+#define SLICE_MILLISECONDS 100
+
+#define FADE_SECONDS 2.0
+#define FADE_FRAMES 40
+
+/* how often the event loop wakes up to look for a new frame */
+#define POLL_MILLISECONDS 10
+
+/*
+A frame is a buffer that can hold width by height pixels or more.
+Frames pass between the two threads only by swapping them, so neither
+thread ever reads a buffer the other is writing.
+*/
+typedef struct
+{
+	pixel* pixels;
+	int width, height;
+	size_t capacity;
+} Frame;
+
+/*
+The renderer thread builds and renders patterns and publishes frames;
+the main thread handles X events and shows whatever was published last.
+*/
+typedef struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	StarfishPoolRef pool;
+	int wrapEdges;
+	int cycle;
+	int width, height;	/* the window's size, from the main thread */
+	int resized;		/* start over at the new size */
+	int quit;
+	int ready;		/* pending holds a frame not yet shown */
+	Frame back, pending, showing;
+	StarfishJobRef job;	/* the background render, so it can be called off */
+	/* the renderer's own: the pattern on screen and the one after it */
+	Frame current, next;
+} Hack;
+
+static int SizeFrame(Frame* frame, int width, int height)
+{
+	size_t needed = (size_t) width * height;
+	if(needed > frame->capacity)
+	{
+		pixel* bigger = realloc(frame->pixels, needed * sizeof(pixel));
+		if(!bigger) return 0;
+		frame->pixels = bigger;
+		frame->capacity = needed;
+	}
+	frame->width = width;
+	frame->height = height;
+	return 1;
+}
+
+static void SwapFrames(Frame* a, Frame* b)
+{
+	Frame swap = *a;
+	*a = *b;
+	*b = swap;
+}
+
+/* hand the back frame to the main thread */
+static void Publish(Hack* hack)
+{
+	pthread_mutex_lock(&hack->lock);
+	SwapFrames(&hack->back, &hack->pending);
+	hack->ready = 1;
+	pthread_mutex_unlock(&hack->lock);
+}
+
+/*
+Is there a reason to stop what the renderer is doing? Waits up to the
+given time first, or not at all for zero.
+*/
+static int Interrupted(Hack* hack, double seconds)
+{
+	int stop;
+	pthread_mutex_lock(&hack->lock);
+	if(seconds > 0.0 && !hack->quit && !hack->resized)
+	{
+		struct timeval now;
+		struct timespec until;
+		double when;
+		gettimeofday(&now, NULL);
+		when = now.tv_sec + now.tv_usec * 1e-6 + seconds;
+		until.tv_sec = (time_t) when;
+		until.tv_nsec = (long) ((when - until.tv_sec) * 1e9);
+		while(!hack->quit && !hack->resized &&
+				pthread_cond_timedwait(&hack->wake, &hack->lock, &until) != ETIMEDOUT)
+			;
+	}
+	stop = hack->quit || hack->resized;
+	pthread_mutex_unlock(&hack->lock);
+	return stop;
+}
+
+typedef struct
+{
+	const Frame* from;
+	const Frame* to;
+	Frame* out;
+	int mix;	/* out of 256 */
+} Fade;
+
+static void FadeRow(void* context, int y)
+{
+	Fade* fade = context;
+	size_t offset = (size_t) y * fade->out->width;
+	const pixel* a = fade->from->pixels + offset;
+	const pixel* b = fade->to->pixels + offset;
+	pixel* out = fade->out->pixels + offset;
+	int x, mix = fade->mix;
+	for(x = 0; x < fade->out->width; x++)
+	{
+		out[x].red = (unsigned char) (a[x].red + (((b[x].red - a[x].red) * mix) >> 8));
+		out[x].green = (unsigned char) (a[x].green + (((b[x].green - a[x].green) * mix) >> 8));
+		out[x].blue = (unsigned char) (a[x].blue + (((b[x].blue - a[x].blue) * mix) >> 8));
+		out[x].alpha = 0xFF;
+	}
+}
+
+/*
+The engine renders the pattern in passes, each twice as fine as the one
+before, into hack->current; every pass goes up as soon as it is done.
+Only the region the pass changed is copied. The back frame is whichever
+one came round last, but each pass refines the whole texture, so that
+region always covers everything the frame is missing.
+*/
+static int ShowPass(void* context, int step, int left, int top, int width, int height)
+{
+	Hack* hack = context;
+	const Frame* current = &hack->current;
+	int y;
+	(void) step;
+	if(!SizeFrame(&hack->back, current->width, current->height)) return 0;
+	for(y = top; y < top + height; y++)
+	{
+		size_t offset = (size_t) y * current->width + left;
+		memcpy(hack->back.pixels + offset, current->pixels + offset, width * sizeof(pixel));
+	}
+	Publish(hack);
+	return !Interrupted(hack, 0.0);
+}
+
+static int RenderProgressively(Hack* hack, StarfishRef texture, int width, int height)
+{
+	if(!SizeFrame(&hack->current, width, height)) return 0;
+	return RenderStarfishProgressive(texture, hack->current.pixels, width, hack->pool, ShowPass, hack);
+}
+
+/*
+Render the next pattern as a job, so that a resize or a quit can call it
+off at once rather than waiting for the whole render to finish.
+*/
+static int RenderNext(Hack* hack, StarfishRef texture)
+{
+	StarfishJobRef job = MakeStarfishJob(texture, hack->next.pixels, hack->next.width);
+	int done = 0;
+	pthread_mutex_lock(&hack->lock);
+	hack->job = job;
+	if(hack->quit || hack->resized) CancelStarfishJob(job);
+	pthread_mutex_unlock(&hack->lock);
+	while(!done && !StarfishJobCancelled(job))
+		done = RenderStarfishFor(job, SLICE_MILLISECONDS, hack->pool);
+	pthread_mutex_lock(&hack->lock);
+	hack->job = NULL;
+	pthread_mutex_unlock(&hack->lock);
+	DumpStarfishJob(job);
+	return done;
+}
+
+static int FadeTo(Hack* hack)
+{
+	Fade fade;
+	int step;
+	if(!SizeFrame(&hack->back, hack->current.width, hack->current.height)) return 0;
+	fade.from = &hack->current;
+	fade.to = &hack->next;
+	fade.out = &hack->back;
+	for(step = 1; step <= FADE_FRAMES; step++)
+	{
+		fade.mix = step * 256 / FADE_FRAMES;
+		RunStarfishTasks(hack->pool, FadeRow, &fade, hack->back.height);
+		Publish(hack);
+		if(Interrupted(hack, FADE_SECONDS / FADE_FRAMES)) return 0;
+	}
+	SwapFrames(&hack->current, &hack->next);
+	return 1;
+}
+
+static void* Renderer(void* context)
+{
+	Hack* hack = context;
+	int width, height;
+	LowerStarfishThreadPriority();
+	for(;;)
+	{
+		StarfishRef texture;
+		int shown = 0;
+		pthread_mutex_lock(&hack->lock);
+		if(hack->quit)
+		{
+			pthread_mutex_unlock(&hack->lock);
+			break;
+		}
+		hack->resized = 0;
+		width = hack->width;
+		height = hack->height;
+		pthread_mutex_unlock(&hack->lock);
+
+		/* the first pattern at this size shows up coarse and sharpens */
+		texture = MakeStarfish(width, height, NULL, hack->wrapEdges);
+		if(texture)
+		{
+			shown = RenderProgressively(hack, texture, width, height);
+			DumpStarfish(texture);
+		}
+		/* after that, each one waits its turn and fades in */
+		while(shown)
+		{
+			texture = MakeStarfish(width, height, NULL, hack->wrapEdges);
+			if(!texture || !SizeFrame(&hack->next, width, height))
+			{
+				if(texture) DumpStarfish(texture);
+				break;
+			}
+			shown = RenderNext(hack, texture);
+			DumpStarfish(texture);
+			if(!shown || Interrupted(hack, hack->cycle)) break;
+			shown = FadeTo(hack);
+		}
+		if(!shown && !Interrupted(hack, 0.0)) Interrupted(hack, 1.0);
+	}
+	return NULL;
+}
+
+int RunHack(unsigned long window, int width, int height, int wrapEdges,
+	int cycle, StarfishPoolRef pool)
+{
+	Hack hack;
+	pthread_t renderer;
+	struct timespec poll;
+	int started = window ? BeginXAnimationIn(window) : BeginXAnimation(1, width, height);
+	if(!started || !XAnimationEvents(&width, &height)) return 1;
+
+	memset(&hack, 0, sizeof(hack));
+	pthread_mutex_init(&hack.lock, NULL);
+	pthread_cond_init(&hack.wake, NULL);
+	hack.pool = pool;
+	hack.wrapEdges = wrapEdges;
+	hack.cycle = cycle;
+	hack.width = width;
+	hack.height = height;
+	if(pthread_create(&renderer, NULL, Renderer, &hack))
+	{
+		EndXAnimation();
+		return 1;
+	}
+
+	poll.tv_sec = 0;
+	poll.tv_nsec = POLL_MILLISECONDS * 1000000L;
+	for(;;)
+	{
+		int alive = XAnimationEvents(&width, &height);
+		int show;
+		pthread_mutex_lock(&hack.lock);
+		if(!alive) hack.quit = 1;
+		else if(width != hack.width || height != hack.height)
+		{
+			hack.width = width;
+			hack.height = height;
+			hack.resized = 1;
+		}
+		if(hack.quit || hack.resized)
+		{
+			pthread_cond_broadcast(&hack.wake);
+			if(hack.job) CancelStarfishJob(hack.job);
+		}
+		show = hack.ready;
+		if(show)
+		{
+			SwapFrames(&hack.pending, &hack.showing);
+			hack.ready = 0;
+		}
+		pthread_mutex_unlock(&hack.lock);
+		if(!alive) break;
+		if(show) ShowXFrame(hack.showing.pixels, hack.showing.width, hack.showing.height, pool);
+		nanosleep(&poll, NULL);
+	}
+
+	pthread_join(renderer, NULL);
+	pthread_cond_destroy(&hack.wake);
+	pthread_mutex_destroy(&hack.lock);
+	free(hack.back.pixels);
+	free(hack.pending.pixels);
+	free(hack.showing.pixels);
+	free(hack.current.pixels);
+	free(hack.next.pixels);
+	EndXAnimation();
+	return 0;
+}
@@ -0,0 +1,37 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "starfish-pool.h"
+
+#define HACK_DEFAULT_CYCLE 30	/* seconds each pattern stays up */
+
+/*
+Run as a screensaver hack in the given window, or in a window of our
+own, width by height, when window is zero. A coarse version of each
+pattern appears at once and sharpens as the rendering catches up; the
+next pattern renders in the background and fades in cycle seconds
+later. The X events are handled throughout, and the hack stops when
+its window goes away or is closed.
+*/
+int RunHack(unsigned long window, int width, int height, int wrapEdges,
+	int cycle, StarfishPoolRef pool);
@@ -0,0 +1,159 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "starfish-engine.h"
+#include "starfish-render.h"
+#include "makepng.h"
+#include "heatmap.h"
+
+/* the inferno colour map, near enough, from cheap to dear */
+static const pixel stops[] =
+{
+	{ 0, 0, 4, 255 },
+	{ 87, 16, 110, 255 },
+	{ 188, 55, 84, 255 },
+	{ 249, 142, 9, 255 },
+	{ 252, 255, 164, 255 },
+};
+#define STOP_COUNT ((int) (sizeof(stops) / sizeof(stops[0])))
+
+static pixel HeatColour(double t)
+{
+	pixel out;
+	int stop;
+	double f;
+	if(t < 0) t = 0;
+	if(t > 1) t = 1;
+	stop = (int) (t * (STOP_COUNT - 1));
+	if(stop >= STOP_COUNT - 1) stop = STOP_COUNT - 2;
+	f = t * (STOP_COUNT - 1) - stop;
+	out.red = (unsigned char) (stops[stop].red + f * (stops[stop + 1].red - stops[stop].red) + 0.5);
+	out.green = (unsigned char) (stops[stop].green + f * (stops[stop + 1].green - stops[stop].green) + 0.5);
+	out.blue = (unsigned char) (stops[stop].blue + f * (stops[stop + 1].blue - stops[stop].blue) + 0.5);
+	out.alpha = 0xFF;
+	return out;
+}
+
+static int CompareCosts(const void* a, const void* b)
+{
+	float x = *(const float*) a, y = *(const float*) b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+Add up the samples in each render tile, to see how unevenly the work
+falls on the pool: a tile far dearer than the rest holds up the finish.
+Samples are capped at the ceiling for the same reason as the colours.
+*/
+static void ReportTiles(FILE* report, const float* costs, int across, int down, int step, double ceiling)
+{
+	int perTile = StarfishTileSize() / step > 0 ? StarfishTileSize() / step : 1;
+	int tilesAcross = (across + perTile - 1) / perTile;
+	int tilesDown = (down + perTile - 1) / perTile;
+	double total = 0, dearest = 0;
+	int i, j, worst = 0;
+	double* tiles = calloc((size_t) tilesAcross * tilesDown, sizeof(double));
+	if(!tiles) return;
+	for(j = 0; j < down; j++)
+		for(i = 0; i < across; i++)
+			tiles[(j / perTile) * tilesAcross + i / perTile] +=
+				costs[j * across + i] < ceiling ? costs[j * across + i] : ceiling;
+	for(i = 0; i < tilesAcross * tilesDown; i++)
+	{
+		total += tiles[i];
+		if(tiles[i] > dearest)
+		{
+			dearest = tiles[i];
+			worst = i;
+		}
+	}
+	if(total > 0)
+		fprintf(report, "heatmap: dearest tile at %d,%d costs %.1f times the mean of %d tiles\n",
+			(worst % tilesAcross) * perTile * step, (worst / tilesAcross) * perTile * step,
+			dearest * tilesAcross * tilesDown / total, tilesAcross * tilesDown);
+	free(tiles);
+}
+
+int MakeHeatmapFile(StarfishRef tex, const char* filename, int step, FILE* report)
+{
+	int width = StarfishWidth(tex), height = StarfishHeight(tex);
+	int across, down, count, x, y, ok;
+	float *costs, *sorted;
+	double low, high, scale;
+	pixel* pixels;
+	int cycles;
+
+	if(step < 1) step = 1;
+	across = (width + step - 1) / step;
+	down = (height + step - 1) / step;
+	count = across * down;
+	costs = malloc(count * sizeof(float));
+	sorted = malloc(count * sizeof(float));
+	pixels = malloc((size_t) width * height * sizeof(pixel));
+	if(!costs || !sorted || !pixels)
+	{
+		fprintf(stderr, "xstarfish: not enough memory for a %dx%d heatmap.\n", width, height);
+		free(costs);
+		free(sorted);
+		free(pixels);
+		return 0;
+	}
+	cycles = MapStarfishCost(tex, step, costs);
+
+	/*
+	Scale between the 1st and 99th percentiles, so that a sample which
+	happened to catch an interrupt doesn't wash out everything else.
+	*/
+	memcpy(sorted, costs, count * sizeof(float));
+	qsort(sorted, count, sizeof(float), CompareCosts);
+	low = sorted[count / 100];
+	high = sorted[count - 1 - count / 100];
+	if(low < 1) low = 1;
+	if(high < low) high = low;
+	scale = high > low ? 1 / log(high / low) : 0;
+	for(y = 0; y < height; y++)
+	{
+		const float* row = costs + (y / step) * across;
+		for(x = 0; x < width; x++)
+		{
+			double cost = row[x / step];
+			pixels[y * width + x] = HeatColour(scale > 0 && cost > low ? log(cost / low) * scale : 0);
+		}
+	}
+	ok = WritePNGFile(filename, pixels, width, height, width);
+
+	if(report)
+	{
+		const char* unit = cycles ? "cycles" : "ns";
+		fprintf(report, "heatmap: %d samples, %s per pixel: min %.0f, median %.0f, 99%% %.0f, max %.0f\n",
+			count, unit, sorted[0], sorted[count / 2], sorted[count - 1 - count / 100], sorted[count - 1]);
+		ReportTiles(report, costs, across, down, step, high);
+	}
+	free(costs);
+	free(sorted);
+	free(pixels);
+	return ok;
+}
@@ -0,0 +1,39 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+#include "starfish-engine.h"
+
+/*
+A heatmap shows where a pattern is expensive: every step by step square
+of it coloured by what its middle pixel took to evaluate (see
+MapStarfishCost), from black for the cheapest through purple, red and
+orange to pale yellow for the dearest, on a logarithmic scale. It is
+the texture's size, so that it lies over the image. A summary of the
+spread of costs goes to report, if there is one. Returns zero if the
+file could not be written.
+*/
+
+#define HEATMAP_DEFAULT_STEP 4
+
+int MakeHeatmapFile(StarfishRef tex, const char* filename, int step, FILE* report);
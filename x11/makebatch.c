@@ -0,0 +1,196 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "starfish-engine.h"
+#include "starfish-render.h"
+#include "makepng.h"
+#include "makebatch.h"
+
+/*
+Each pattern passes through three stages: its tree is built, its tiles
+are rendered, and it is encoded. While one pattern is being built, the
+one before it is rendering and the ENCODE_AHEAD before that may still be
+encoding, so there is a batch item for each.
+*/
+#define ENCODE_AHEAD 2
+#define BATCH_SLOTS (ENCODE_AHEAD + 2)
+
+typedef struct
+{
+	StarfishRef texture;
+	pixel* pixels;
+	int width, height;
+	int tileSize;
+	int across;		/* tiles in a row */
+	unsigned int seed;
+	char name[4096];
+	int failed;
+	StarfishTasksRef render;
+	StarfishTasksRef encode;
+} BatchItem;
+
+static void RenderBatchTile(void* context, int index)
+{
+	BatchItem* item = context;
+	int left = (index % item->across) * item->tileSize;
+	int top = (index / item->across) * item->tileSize;
+	int width = item->width - left;
+	int height = item->height - top;
+	if(width > item->tileSize) width = item->tileSize;
+	if(height > item->tileSize) height = item->tileSize;
+	RenderStarfishRect(item->texture, item->pixels + (size_t) top * item->width + left,
+		item->width, left, top, width, height);
+}
+
+static void EncodeBatchItem(void* context, int index)
+{
+	BatchItem* item = context;
+	(void) index;
+	if(!WritePNGFile(item->name, item->pixels, item->width, item->height, item->width))
+		item->failed = 1;
+}
+
+static int BuildItem(BatchItem* item, unsigned int seed, const char* dir, int wrapEdges,
+	BatchSizeProc size, void* sizeContext)
+{
+	item->seed = seed;
+	item->failed = 0;
+	item->render = item->encode = NULL;
+	/* the same seed as -r, so any pattern in the batch can be made again */
+	srand(seed);
+	size(sizeContext, &item->width, &item->height);
+	item->texture = MakeStarfish(item->width, item->height, NULL, wrapEdges);
+	item->pixels = malloc((size_t) item->width * item->height * sizeof(pixel));
+	snprintf(item->name, sizeof(item->name), "%s/starfish-%u.png", dir, seed);
+	if(!item->texture || !item->pixels)
+	{
+		fprintf(stderr, "xstarfish: was not able to create texture %u\n", seed);
+		if(item->texture) DumpStarfish(item->texture);
+		free(item->pixels);
+		item->texture = NULL;
+		item->pixels = NULL;
+		return 0;
+	}
+	item->tileSize = StarfishTileSize();
+	item->across = (item->width + item->tileSize - 1) / item->tileSize;
+	return 1;
+}
+
+static int FinishEncoding(BatchItem* item)
+{
+	int failed = 1;
+	if(item->encode)
+	{
+		FinishStarfishTasks(item->encode);
+		failed = item->failed;
+		free(item->pixels);
+		item->pixels = NULL;
+		item->encode = NULL;
+	}
+	return failed;
+}
+
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int MakeBatch(int count, unsigned int firstSeed, const char* dir, int wrapEdges,
+	BatchSizeProc size, void* sizeContext, StarfishPoolRef pool)
+{
+	BatchItem* items;
+	BatchItem* rendering = NULL;
+	int made, failures = 0;
+	double pixels = 0.0, start, elapsed;
+
+	if(mkdir(dir, 0777) && errno != EEXIST)
+	{
+		fprintf(stderr, "xstarfish: could not make directory %s.\n", dir);
+		return count;
+	}
+	items = calloc(BATCH_SLOTS, sizeof(BatchItem));
+	if(!items) return count;
+
+	start = Now();
+	for(made = 0; made <= count; made++)
+	{
+		BatchItem* building = NULL;
+		/*
+		The slot we are about to build into was last used ENCODE_AHEAD
+		patterns ago. Its encoding has to be out of the way first.
+		*/
+		if(made < count)
+		{
+			building = &items[made % BATCH_SLOTS];
+			if(building->encode)
+			{
+				failures += FinishEncoding(building);
+			}
+			if(!BuildItem(building, firstSeed + made, dir, wrapEdges, size, sizeContext))
+			{
+				failures++;
+				building = NULL;
+			}
+		}
+		/* the pattern before this one has been rendering meanwhile */
+		if(rendering)
+		{
+			FinishStarfishTasks(rendering->render);
+			rendering->render = NULL;
+			DumpStarfish(rendering->texture);
+			rendering->texture = NULL;
+			pixels += (double) rendering->width * rendering->height;
+			rendering->encode = StartStarfishTasks(pool, EncodeBatchItem, rendering, 1);
+		}
+		rendering = building;
+		if(rendering)
+		{
+			rendering->render = StartStarfishTasks(pool, RenderBatchTile, rendering,
+				rendering->across * ((rendering->height + rendering->tileSize - 1) / rendering->tileSize));
+		}
+	}
+	for(made = 0; made < BATCH_SLOTS; made++)
+	{
+		if(items[made].encode)
+		{
+			failures += FinishEncoding(&items[made]);
+		}
+	}
+	free(items);
+
+	elapsed = Now() - start;
+	if(elapsed <= 0.0) elapsed = 1e-9;
+	fprintf(stderr, "xstarfish: %d patterns in %.2f s on %d threads: %.2f patterns/s, %.2f Mpixels/s",
+		count - failures, elapsed, StarfishPoolThreads(pool), (count - failures) / elapsed, pixels / elapsed / 1e6);
+	if(failures) fprintf(stderr, ", %d failed", failures);
+	fputc('\n', stderr);
+	return failures;
+}
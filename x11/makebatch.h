@@ -0,0 +1,41 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "starfish-pool.h"
+
+/*
+Picks the size of the next pattern. It is called right after the seed
+has been planted, so a size drawn at random repeats along with the seed.
+*/
+typedef void (*BatchSizeProc)(void* context, int* width, int* height);
+
+/*
+Make count patterns, seeded firstSeed, firstSeed+1 and so on, and write
+each to dir/starfish-SEED.png; `xstarfish -r SEED` makes the same one.
+Trees are built one at a time, since they draw on the one random number
+generator, but the next tree is built while the pool renders the last,
+and finished patterns are encoded on the pool while later ones render.
+Prints the throughput at the end; returns how many could not be written.
+*/
+int MakeBatch(int count, unsigned int firstSeed, const char* dir, int wrapEdges,
+	BatchSizeProc size, void* sizeContext, StarfishPoolRef pool);
@@ -22,126 +22,131 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <png.h>
 #include "starfish-engine.h"
+#include "starfish-render.h"
+#include "starfish-trace.h"
+#include "makepng.h"
 
-/* takes a StarfishRef and returns a ptr to a 24-bit RGBA pixmap */
-png_byte** PixFromStarfishTex(StarfishRef tex);
+void MakePNGFile(StarfishRef tex, const char* filename, StarfishPoolRef pool)
+{
+	int width, height;
+	pixel* pixmap;
 
-/* frees a pixmap created by the above function */
-void DestroyPix(png_byte** pixmap, int height);
+	/* turn the StarfishRef into something useable */
+	width = StarfishWidth(tex);
+	height = StarfishHeight(tex);
+	pixmap = malloc((size_t) width * height * sizeof(pixel));
+	if(!pixmap)
+	{
+		fprintf(stderr, "xstarfish: not enough memory for a %dx%d image.\n", width, height);
+		return;
+	}
+	RenderStarfish(tex, pixmap, width, pool);
+
+	WritePNGFile(filename, pixmap, width, height, width);
 
-void MakePNGFile(StarfishRef tex, const char* filename)
+	/* clean up our stuff */
+	free(pixmap);
+}
+
+int WritePNGFile(const char* filename, const pixel* pixels, int width, int height, int rowPixels)
 {
 	FILE* theFile;
-	int width, height, x, y;
-	png_byte** pixmap = NULL;
-	png_infop theInfoPtr = NULL;
-	png_structp theWritePtr = NULL;
+	int ok;
 
 	/* create the file */
 	theFile = fopen(filename, "wb");
 	if(!theFile)
 	{
-		fprintf(stderr, "xstarfish: could not open output file.\n");
-		return;
+		fprintf(stderr, "xstarfish: could not open output file %s.\n", filename);
+		return 0;
 	}
-	
-	/* turn the StarfishRef into something useable */
-	width = StarfishWidth(tex);
-	height = StarfishHeight(tex);
-	pixmap = PixFromStarfishTex(tex);
-	
+	ok = WritePNGStream(theFile, pixels, width, height, rowPixels);
+	if(fclose(theFile) == EOF) ok = 0;
+	return ok;
+}
+
+/* rows handed to libpng at a time, each chunk a span in a trace */
+#define ENCODE_ROWS 64
+
+int WritePNGStream(FILE* theFile, const pixel* pixels, int width, int height, int rowPixels)
+{
+	int y, ok;
+	double start = StarfishTraceClock();
+	png_bytep* rows = NULL;
+	png_infop theInfoPtr = NULL;
+	png_structp theWritePtr = NULL;
+
+	/* libpng wants a pointer to every row */
+	rows = malloc(height * sizeof(png_bytep));
+	if(!rows)
+	{
+		fprintf(stderr, "xstarfish: not enough memory to write a png.\n");
+		return 0;
+	}
+	for(y = 0; y < height; y++)
+		rows[y] = (png_bytep) (pixels + (size_t) y * rowPixels);
+
 	/* set up libpng */
-	if(pixmap)
+	theWritePtr = png_create_write_struct
+		(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, NULL, NULL);
+	if(!theWritePtr)
 	{
-		theWritePtr = png_create_write_struct
-			(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, NULL, NULL);
-		if(!theWritePtr)
-		{
-			fprintf(stderr, "xstarfish: could not allocate png write struct\n");
-			return;
-		}
+		fprintf(stderr, "xstarfish: could not allocate png write struct\n");
+		free(rows);
+		return 0;
 	}
 
-	if(theWritePtr)
+	theInfoPtr = png_create_info_struct(theWritePtr);
+	if(!theInfoPtr)
 	{
-		theInfoPtr = png_create_info_struct(theWritePtr);
-		if(!theInfoPtr)
-		{
-			fprintf(stderr, "xstarfish: could not allocate png info struct\n");
-			png_destroy_write_struct(&theWritePtr,
-				(png_infopp)NULL);
-			return;
-		}
-	}	
-
-	if(theInfoPtr)
+		fprintf(stderr, "xstarfish: could not allocate png info struct\n");
+		png_destroy_write_struct(&theWritePtr,
+			(png_infopp)NULL);
+		free(rows);
+		return 0;
+	}
+
+	/* set up the png error handling. */
+	if (setjmp(png_jmpbuf(theWritePtr)))
 	{
-		/* set up the png error handling. */
-		if (setjmp(theWritePtr->jmpbuf))
-		{
-			png_destroy_write_struct(&theWritePtr, &theInfoPtr);
-			fclose(theFile);
-			fprintf(stderr, "xstarfish: there was an error writing the PNG file.\n");
-			return;
-		}
-	
-		/* tell libpng about the output file. */
-		png_init_io(theWritePtr, theFile);
-	
-		/* set up the image info... */
-		png_set_IHDR(theWritePtr, theInfoPtr, width, height, 8,
-			PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-		
-		/* ... and write it to the file. */
-		png_write_info(theWritePtr, theInfoPtr);
-		
-		/* now write the image data. */
-		png_write_image(theWritePtr, pixmap);
-		
-		/* clean up after libpng */
-		png_write_end(theWritePtr, NULL);
 		png_destroy_write_struct(&theWritePtr, &theInfoPtr);
+		free(rows);
+		fprintf(stderr, "xstarfish: there was an error writing the PNG file.\n");
+		return 0;
 	}
-	
-	/* clean up our stuff */
-	DestroyPix(pixmap, height);
-	fclose(theFile);
-	
-	return;
-}
 
-png_byte** PixFromStarfishTex(StarfishRef tex)
-{
-	png_byte** pixmap;
-	int height = StarfishHeight(tex), width = StarfishWidth(tex);
-	int curRow, curPixel;
-	pixel thePixel;
-	
-	pixmap = malloc(height * sizeof(png_byte*));
-	if( pixmap )
+	/* tell libpng about the output file. */
+	png_init_io(theWritePtr, theFile);
+
+	/* set up the image info... */
+	png_set_IHDR(theWritePtr, theInfoPtr, width, height, 8,
+		PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+	/* ... and write it to the file. */
+	png_write_info(theWritePtr, theInfoPtr);
+
+	/* our pixels carry an alpha byte; the file doesn't want it. */
+	png_set_filler(theWritePtr, 0, PNG_FILLER_AFTER);
+
+	/* now write the image data. */
+	for(y = 0; y < height; y += ENCODE_ROWS)
 	{
-		for(curRow = 0; curRow < height; curRow++)
-		{
-			pixmap[curRow] = malloc(width * sizeof(png_byte) * 3);
-			for(curPixel = 0; curPixel < width; curPixel++)
-			{
-				GetStarfishPixel(curPixel, curRow, tex, &thePixel);
-				pixmap[curRow][curPixel * 3] = thePixel.red;
-				pixmap[curRow][curPixel * 3 + 1] = thePixel.green;
-				pixmap[curRow][curPixel * 3 + 2] = thePixel.blue;
-			}
-		}
+		int count = height - y < ENCODE_ROWS ? height - y : ENCODE_ROWS;
+		double chunk = StarfishTraceClock();
+		png_write_rows(theWritePtr, rows + y, count);
+		StarfishTraceSpan("encode", "png rows", chunk, "top", y, "rows", count);
 	}
-	return pixmap;
-}
 
-void DestroyPix(png_byte** pixmap, int height)
-{
-	int curRow;
-	for(curRow = 0; curRow < height; curRow++)
-		free(pixmap[curRow]);
-	free(pixmap);
+	/* clean up after libpng */
+	png_write_end(theWritePtr, NULL);
+	png_destroy_write_struct(&theWritePtr, &theInfoPtr);
+
+	free(rows);
+	ok = fflush(theFile) != EOF;
+	StarfishTraceSpan("encode", "png", start, "width", width, "height", height);
+	return ok;
 }
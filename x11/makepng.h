@@ -21,4 +21,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
-void MakePNGFile(StarfishRef tex, const char* filename);
+#include <stdio.h>
+#include "starfish-pool.h"
+
+/* renders the whole texture, on the pool if there is one, and writes it out */
+void MakePNGFile(StarfishRef tex, const char* filename, StarfishPoolRef pool);
+
+/* writes rows of pixels; returns zero if the file could not be written */
+int WritePNGFile(const char* filename, const pixel* pixels, int width, int height, int rowPixels);
+
+/* the same, to a stream that is already open; the stream is left open */
+int WritePNGStream(FILE* file, const pixel* pixels, int width, int height, int rowPixels);
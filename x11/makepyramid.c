@@ -0,0 +1,284 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "starfish-engine.h"
+#include "starfish-render.h"
+#include "makepng.h"
+#include "downsample.h"
+#include "makepyramid.h"
+
+/*
+Levels up to this many pixels are kept in memory, which is what lets us
+build the next level down with a cheap 2x2 average instead of going back
+to the texture. Anything bigger is rendered a tile at a time and never
+exists in one piece, so a gigapixel pyramid doesn't need gigabytes.
+*/
+#define PYRAMID_MEMORY_PIXELS (64 * 1024 * 1024)
+
+/* rows of the downsampled level per task */
+#define PYRAMID_BAND 32
+
+typedef struct
+{
+	StarfishRef tex;
+	int format;
+	int tileSize;
+	const char* tileRoot;
+	int number;		/* the level's number in file names */
+	int width, height;
+	int across, down;
+	pixel* buffer;		/* the whole level, or NULL to stream tiles */
+	int renderTiles;	/* tiles must be rendered before they're written */
+	pixel* source;		/* the bigger level, when downsampling */
+	int sourceWidth, sourceHeight;
+	int failed;
+} PyramidLevel;
+
+static int MakeDirectories(const char* path)
+{
+	char buf[PATH_MAX];
+	char* slash;
+
+	if(strlen(path) >= sizeof(buf)) return 0;
+	strcpy(buf, path);
+	for(slash = strchr(buf + 1, '/'); slash; slash = strchr(slash + 1, '/'))
+	{
+		*slash = 0;
+		if(mkdir(buf, 0777) && errno != EEXIST) return 0;
+		*slash = '/';
+	}
+	if(mkdir(buf, 0777) && errno != EEXIST) return 0;
+	return 1;
+}
+
+/* did snprintf's output fit? a cut-off path would put files elsewhere */
+static int Fits(int length, size_t size)
+{
+	return length >= 0 && (size_t) length < size;
+}
+
+static int TileName(PyramidLevel* level, int col, int row, char* name, size_t size)
+{
+	if(level->format == PYRAMID_DZI)
+		return Fits(snprintf(name, size, "%s/%d/%d_%d.png", level->tileRoot, level->number, col, row), size);
+	return Fits(snprintf(name, size, "%s/%d/%d/%d.png", level->tileRoot, level->number, col, row), size);
+}
+
+static void TileTask(void* context, int index)
+{
+	PyramidLevel* level = context;
+	int col = index % level->across;
+	int row = index / level->across;
+	int left = col * level->tileSize;
+	int top = row * level->tileSize;
+	int width = level->width - left;
+	int height = level->height - top;
+	pixel* pixels;
+	int rowPixels;
+	char name[PATH_MAX];
+
+	if(width > level->tileSize) width = level->tileSize;
+	if(height > level->tileSize) height = level->tileSize;
+	if(!TileName(level, col, row, name, sizeof(name)))
+	{
+		level->failed = 1;
+		return;
+	}
+	if(level->buffer)
+	{
+		pixels = level->buffer + (size_t) top * level->width + left;
+		rowPixels = level->width;
+	}
+	else
+	{
+		pixels = malloc((size_t) width * height * sizeof(pixel));
+		rowPixels = width;
+		if(!pixels)
+		{
+			level->failed = 1;
+			return;
+		}
+	}
+	if(level->renderTiles)
+	{
+		RenderStarfishScaled(level->tex, level->width, level->height,
+			pixels, rowPixels, left, top, width, height);
+	}
+	if(!WritePNGFile(name, pixels, width, height, rowPixels))
+		level->failed = 1;
+	if(!level->buffer) free(pixels);
+}
+
+static void HalveTask(void* context, int index)
+{
+	PyramidLevel* level = context;
+	int first = index * PYRAMID_BAND;
+	int count = level->height - first;
+	if(count > PYRAMID_BAND) count = PYRAMID_BAND;
+	HalvePixels(level->source, level->sourceWidth, level->sourceHeight, level->sourceWidth,
+		level->buffer, level->width, first, count);
+}
+
+static int WriteDZIHeader(const char* name, int tileSize, int width, int height)
+{
+	FILE* theFile = fopen(name, "w");
+	if(!theFile)
+	{
+		fprintf(stderr, "xstarfish: could not open output file %s.\n", name);
+		return 0;
+	}
+	fprintf(theFile,
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\"\n"
+		"  Format=\"png\" Overlap=\"0\" TileSize=\"%d\">\n"
+		"  <Size Width=\"%d\" Height=\"%d\"/>\n"
+		"</Image>\n", tileSize, width, height);
+	return fclose(theFile) == 0;
+}
+
+int MakeTilePyramid(StarfishRef tex, const char* path, int format, int tileSize, StarfishPoolRef pool)
+{
+	PyramidLevel level;
+	char root[PATH_MAX];
+	char name[PATH_MAX];
+	int width = StarfishWidth(tex);
+	int height = StarfishHeight(tex);
+	int topLevel, lowLevel, k, x;
+	pixel* held = NULL;
+	int heldWidth = 0, heldHeight = 0;
+	size_t len;
+
+	if(tileSize < 1) tileSize = PYRAMID_DEFAULT_TILE;
+
+	/* Level topLevel is full size; each level below is half the size,
+	   rounded up, until we get to a single pixel. */
+	topLevel = 0;
+	while((1 << topLevel) < width || (1 << topLevel) < height) topLevel++;
+	lowLevel = 0;
+
+	/* work out where things go */
+	len = strlen(path);
+	if(format == PYRAMID_DZI)
+	{
+		if(len > 4 && !strcmp(path + len - 4, ".dzi")) len -= 4;
+		if(!Fits(snprintf(root, sizeof(root), "%.*s_files", (int) len, path), sizeof(root)) ||
+			!Fits(snprintf(name, sizeof(name), "%.*s.dzi", (int) len, path), sizeof(name)))
+		{
+			fprintf(stderr, "xstarfish: the path %s is too long.\n", path);
+			return 0;
+		}
+		if(!WriteDZIHeader(name, tileSize, width, height)) return 0;
+	}
+	else
+	{
+		/* the xyz scheme starts at the biggest level that fits in one tile */
+		if(!Fits(snprintf(root, sizeof(root), "%s", path), sizeof(root)))
+		{
+			fprintf(stderr, "xstarfish: the path %s is too long.\n", path);
+			return 0;
+		}
+		lowLevel = topLevel;
+		while(lowLevel > 0 &&
+			(((width + (1 << (topLevel - lowLevel)) - 1) >> (topLevel - lowLevel)) > tileSize ||
+			((height + (1 << (topLevel - lowLevel)) - 1) >> (topLevel - lowLevel)) > tileSize))
+			lowLevel--;
+	}
+
+	level.tex = tex;
+	level.format = format;
+	level.tileSize = tileSize;
+	level.tileRoot = root;
+	level.failed = 0;
+	for(k = topLevel; k >= lowLevel && !level.failed; k--)
+	{
+		int shift = topLevel - k;
+		level.number = (format == PYRAMID_DZI) ? k : k - lowLevel;
+		level.width = (width + (1 << shift) - 1) >> shift;
+		level.height = (height + (1 << shift) - 1) >> shift;
+		level.across = (level.width + tileSize - 1) / tileSize;
+		level.down = (level.height + tileSize - 1) / tileSize;
+		level.buffer = NULL;
+		level.renderTiles = 1;
+
+		if(!Fits(snprintf(name, sizeof(name), "%s/%d", root, level.number), sizeof(name)))
+		{
+			fprintf(stderr, "xstarfish: the path %s is too long.\n", root);
+			level.failed = 1;
+			break;
+		}
+		if(!MakeDirectories(name))
+		{
+			fprintf(stderr, "xstarfish: could not create directory %s.\n", name);
+			level.failed = 1;
+			break;
+		}
+		if(format == PYRAMID_XYZ)
+		{
+			for(x = 0; x < level.across; x++)
+			{
+				if(!Fits(snprintf(name, sizeof(name), "%s/%d/%d", root, level.number, x), sizeof(name)) ||
+					(mkdir(name, 0777) && errno != EEXIST))
+					level.failed = 1;
+			}
+		}
+
+		if(held)
+		{
+			/* downsample the level we already have */
+			level.buffer = malloc((size_t) level.width * level.height * sizeof(pixel));
+			if(level.buffer)
+			{
+				level.source = held;
+				level.sourceWidth = heldWidth;
+				level.sourceHeight = heldHeight;
+				RunStarfishTasks(pool, HalveTask, &level,
+					(level.height + PYRAMID_BAND - 1) / PYRAMID_BAND);
+				level.renderTiles = 0;
+			}
+			free(held);
+			held = NULL;
+		}
+		else if((double) level.width * level.height <= PYRAMID_MEMORY_PIXELS)
+		{
+			/* small enough to keep around for the levels below */
+			level.buffer = malloc((size_t) level.width * level.height * sizeof(pixel));
+		}
+
+		RunStarfishTasks(pool, TileTask, &level, level.across * level.down);
+
+		held = level.buffer;
+		heldWidth = level.width;
+		heldHeight = level.height;
+	}
+	free(held);
+	if(level.failed)
+		fprintf(stderr, "xstarfish: the tile pyramid in %s is incomplete.\n", root);
+	return !level.failed;
+}
@@ -0,0 +1,38 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "starfish-pool.h"
+
+#define PYRAMID_DZI 0	/* foo.dzi plus foo_files/level/col_row.png */
+#define PYRAMID_XYZ 1	/* dir/z/x/y.png, z 0 being a single tile */
+
+#define PYRAMID_DEFAULT_TILE 256
+
+/*
+Write a complete multi-resolution tile pyramid for a texture.
+The full resolution level is rendered from the texture; smaller levels
+are rendered straight from the texture too until one fits in memory, and
+every level below that is downsampled from its bigger neighbour.
+Returns zero if something could not be written.
+*/
+int MakeTilePyramid(StarfishRef tex, const char* path, int format, int tileSize, StarfishPoolRef pool);
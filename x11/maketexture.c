@@ -0,0 +1,243 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "starfish-engine.h"
+#include "starfish-render.h"
+#include "downsample.h"
+#include "maketexture.h"
+
+#define MAX_MIP_LEVELS 32
+
+/* Vulkan's number for R8G8B8A8_SRGB, which is what KTX2 files name formats by */
+#define VK_FORMAT_R8G8B8A8_SRGB 43
+
+typedef struct
+{
+	int count;
+	int width[MAX_MIP_LEVELS];
+	int height[MAX_MIP_LEVELS];
+	pixel* pixels[MAX_MIP_LEVELS];
+} MipChain;
+
+int TextureContainerForName(const char* filename)
+{
+	size_t len = strlen(filename);
+	if(len > 5 && !strcasecmp(filename + len - 5, ".ktx2")) return TEXTURE_KTX2;
+	if(len > 4 && !strcasecmp(filename + len - 4, ".dds")) return TEXTURE_DDS;
+	return TEXTURE_NONE;
+}
+
+static void FreeMipChain(MipChain* chain)
+{
+	int i;
+	for(i = 0; i < chain->count; i++) free(chain->pixels[i]);
+	chain->count = 0;
+}
+
+static int BuildMipChain(StarfishRef tex, MipChain* chain, int filter, StarfishPoolRef pool)
+{
+	int width = StarfishWidth(tex);
+	int height = StarfishHeight(tex);
+
+	chain->count = 0;
+	for(;;)
+	{
+		int i = chain->count;
+		chain->width[i] = width;
+		chain->height[i] = height;
+		chain->pixels[i] = malloc((size_t) width * height * sizeof(pixel));
+		if(!chain->pixels[i])
+		{
+			FreeMipChain(chain);
+			return 0;
+		}
+		chain->count++;
+		if(i == 0)
+			RenderStarfish(tex, chain->pixels[0], width, pool);
+		else if(!ReduceWrappedPixels(chain->pixels[i - 1], chain->width[i - 1], chain->height[i - 1],
+				chain->pixels[i], width, height, filter, pool))
+		{
+			FreeMipChain(chain);
+			return 0;
+		}
+		if((width == 1 && height == 1) || chain->count == MAX_MIP_LEVELS) break;
+		width = MIP_SIZE(width);
+		height = MIP_SIZE(height);
+	}
+	return 1;
+}
+
+/* both containers are little-endian throughout */
+static void Put32(FILE* f, unsigned long v)
+{
+	putc(v & 0xFF, f);
+	putc((v >> 8) & 0xFF, f);
+	putc((v >> 16) & 0xFF, f);
+	putc((v >> 24) & 0xFF, f);
+}
+
+static void Put64(FILE* f, unsigned long long v)
+{
+	Put32(f, (unsigned long) (v & 0xFFFFFFFFUL));
+	Put32(f, (unsigned long) (v >> 32));
+}
+
+static size_t LevelBytes(const MipChain* chain, int i)
+{
+	return (size_t) chain->width[i] * chain->height[i] * sizeof(pixel);
+}
+
+static void WriteKTX2(FILE* f, const MipChain* chain)
+{
+	static const unsigned char identifier[12] =
+		{ 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	static const char writerKey[] = "KTXwriter";
+	static const char writerValue[] = "xstarfish";
+	/* a basic data format descriptor for four 8-bit sRGB samples */
+	const unsigned long dfdLength = 4 + 24 + 4 * 16;
+	const unsigned long kvdEntry = sizeof(writerKey) + sizeof(writerValue);
+	const unsigned long kvdLength = 4 + ((kvdEntry + 3) & ~3UL);
+	unsigned long dfdOffset = 80 + 24 * chain->count;
+	unsigned long kvdOffset = dfdOffset + dfdLength;
+	unsigned long long offset[MAX_MIP_LEVELS];
+	unsigned long long next = kvdOffset + kvdLength;
+	int i, c;
+
+	/* the file stores the smallest level first; offsets stay 4-aligned */
+	for(i = chain->count - 1; i >= 0; i--)
+	{
+		offset[i] = next;
+		next += LevelBytes(chain, i);
+	}
+
+	fwrite(identifier, 1, sizeof(identifier), f);
+	Put32(f, VK_FORMAT_R8G8B8A8_SRGB);
+	Put32(f, 1);		/* typeSize */
+	Put32(f, chain->width[0]);
+	Put32(f, chain->height[0]);
+	Put32(f, 0);		/* pixelDepth */
+	Put32(f, 0);		/* layerCount */
+	Put32(f, 1);		/* faceCount */
+	Put32(f, chain->count);
+	Put32(f, 0);		/* no supercompression */
+	Put32(f, dfdOffset);
+	Put32(f, dfdLength);
+	Put32(f, kvdOffset);
+	Put32(f, kvdLength);
+	Put64(f, 0);		/* no supercompression global data */
+	Put64(f, 0);
+	for(i = 0; i < chain->count; i++)
+	{
+		Put64(f, offset[i]);
+		Put64(f, LevelBytes(chain, i));
+		Put64(f, LevelBytes(chain, i));
+	}
+
+	Put32(f, dfdLength);
+	Put32(f, 0);				/* Khronos, basic descriptor block */
+	Put32(f, 2 | ((dfdLength - 4) << 16));	/* version 2, block size */
+	Put32(f, 1 | (1 << 8) | (2 << 16));	/* RGBSDA model, BT.709 primaries, sRGB transfer */
+	Put32(f, 0);				/* 1x1x1x1 texel blocks */
+	Put32(f, 4);				/* four bytes in plane 0 */
+	Put32(f, 0);
+	for(c = 0; c < 4; c++)
+	{
+		/* red, green, blue, then alpha, which is always linear */
+		unsigned long channel = (c < 3) ? c : (15 | 0x10);
+		Put32(f, (c * 8) | (7 << 16) | (channel << 24));
+		Put32(f, 0);
+		Put32(f, 0);
+		Put32(f, 255);
+	}
+
+	Put32(f, kvdEntry);
+	fwrite(writerKey, 1, sizeof(writerKey), f);
+	fwrite(writerValue, 1, sizeof(writerValue), f);
+	for(i = kvdEntry; i & 3; i++) putc(0, f);
+
+	for(i = chain->count - 1; i >= 0; i--)
+		fwrite(chain->pixels[i], 1, LevelBytes(chain, i), f);
+}
+
+static void WriteDDS(FILE* f, const MipChain* chain)
+{
+	int i;
+
+	fwrite("DDS ", 1, 4, f);
+	Put32(f, 124);		/* header size */
+	/* caps, height, width, pitch, pixel format, mip count */
+	Put32(f, 0x1 | 0x2 | 0x4 | 0x8 | 0x1000 | 0x20000);
+	Put32(f, chain->height[0]);
+	Put32(f, chain->width[0]);
+	Put32(f, chain->width[0] * 4);
+	Put32(f, 0);		/* depth */
+	Put32(f, chain->count);
+	for(i = 0; i < 11; i++) Put32(f, 0);
+	/* the pixel format: 32-bit RGBA, red in the lowest byte */
+	Put32(f, 32);
+	Put32(f, 0x1 | 0x40);	/* alpha pixels, RGB */
+	Put32(f, 0);		/* no FourCC */
+	Put32(f, 32);
+	Put32(f, 0x000000FFUL);
+	Put32(f, 0x0000FF00UL);
+	Put32(f, 0x00FF0000UL);
+	Put32(f, 0xFF000000UL);
+	Put32(f, 0x8 | 0x1000 | 0x400000);	/* complex, texture, mipmap */
+	Put32(f, 0);
+	Put32(f, 0);
+	Put32(f, 0);
+	Put32(f, 0);
+	for(i = 0; i < chain->count; i++)
+		fwrite(chain->pixels[i], 1, LevelBytes(chain, i), f);
+}
+
+int MakeTextureFile(StarfishRef tex, const char* filename, int container, int filter, StarfishPoolRef pool)
+{
+	MipChain chain;
+	FILE* theFile;
+	int ok;
+
+	if(!BuildMipChain(tex, &chain, filter, pool))
+	{
+		fprintf(stderr, "xstarfish: not enough memory for the mip chain.\n");
+		return 0;
+	}
+	theFile = fopen(filename, "wb");
+	if(!theFile)
+	{
+		fprintf(stderr, "xstarfish: could not open output file %s.\n", filename);
+		FreeMipChain(&chain);
+		return 0;
+	}
+	if(container == TEXTURE_DDS) WriteDDS(theFile, &chain);
+	else WriteKTX2(theFile, &chain);
+	ok = !ferror(theFile);
+	if(fclose(theFile)) ok = 0;
+	if(!ok) fprintf(stderr, "xstarfish: there was an error writing %s.\n", filename);
+	FreeMipChain(&chain);
+	return ok;
+}
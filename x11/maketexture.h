@@ -0,0 +1,39 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "starfish-pool.h"
+
+#define TEXTURE_NONE 0
+#define TEXTURE_KTX2 1
+#define TEXTURE_DDS 2
+
+/* guesses the container from the file name's extension */
+int TextureContainerForName(const char* filename);
+
+/*
+Write the texture with its complete mip chain, as uncompressed RGBA8.
+The base level comes from the engine; every smaller level is filtered
+down from the one above it (see ReduceWrappedPixels). Returns zero if
+the file could not be written.
+*/
+int MakeTextureFile(StarfishRef tex, const char* filename, int container, int filter, StarfishPoolRef pool);
@@ -0,0 +1,318 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "starfish-engine.h"
+#include "starfish-render.h"
+#include "makevideo.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* frames rendered but not yet written, at most */
+#define VIDEO_QUEUE 3
+
+/*
+Frames travel in a ring. The renderer fills slots and the writer empties
+them; filled counts the slots waiting for the writer.
+*/
+typedef struct
+{
+	FILE* out;
+	int format;
+	int width, height;
+	pixel* frames[VIDEO_QUEUE];
+	int head, filled;
+	int finished;	/* no more frames are coming */
+	int failed;	/* the writer could not write */
+	unsigned char* buffer;	/* one converted frame */
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} Video;
+
+int VideoFormatForName(const char* name)
+{
+	if(!strcmp(name, "y4m")) return VIDEO_Y4M;
+	if(!strcmp(name, "rgb")) return VIDEO_RGB;
+	return VIDEO_NONE;
+}
+
+/*
+BT.601 studio range, in 8.8 fixed point:
+	Y = ( 66 R + 129 G +  25 B) / 256 + 16
+	U = (-38 R -  74 G + 112 B) / 256 + 128
+	V = (112 R -  94 G -  18 B) / 256 + 128
+Chroma is taken from the average of each 2x2 block; a block hanging off
+the right or bottom edge repeats its last column or row.
+*/
+static unsigned char LumaOf(const pixel* p)
+{
+	return (unsigned char) (((66 * p->red + 129 * p->green + 25 * p->blue + 128) >> 8) + 16);
+}
+
+static void ChromaOf(int red, int green, int blue, unsigned char* u, unsigned char* v)
+{
+	*u = (unsigned char) (((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+	*v = (unsigned char) (((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+}
+
+#if defined(__SSE2__)
+/* split eight pixels into 16-bit red, green and blue */
+static void Deinterleave(const pixel* in, __m128i* red, __m128i* green, __m128i* blue)
+{
+	__m128i mask = _mm_set1_epi32(0xFF);
+	__m128i a = _mm_loadu_si128((const __m128i*) in);
+	__m128i b = _mm_loadu_si128((const __m128i*) (in + 4));
+	*red = _mm_packs_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+	*green = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), mask),
+		_mm_and_si128(_mm_srli_epi32(b, 8), mask));
+	*blue = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), mask),
+		_mm_and_si128(_mm_srli_epi32(b, 16), mask));
+}
+
+static __m128i LumaOf8(const pixel* in)
+{
+	__m128i red, green, blue, sum;
+	Deinterleave(in, &red, &green, &blue);
+	/* the sum stays under 65536, so unsigned 16-bit arithmetic will do */
+	sum = _mm_add_epi16(_mm_mullo_epi16(red, _mm_set1_epi16(66)),
+		_mm_mullo_epi16(green, _mm_set1_epi16(129)));
+	sum = _mm_add_epi16(sum, _mm_mullo_epi16(blue, _mm_set1_epi16(25)));
+	sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+	return _mm_add_epi16(sum, _mm_set1_epi16(16));
+}
+
+/* sums of horizontally adjacent pairs, from two runs of eight values */
+static __m128i PairSums(__m128i a, __m128i b)
+{
+	__m128i ones = _mm_set1_epi16(1);
+	return _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+}
+
+/* eight chroma samples from a 16x2 block, averaged per 2x2 */
+static void ChromaOf16(const pixel* top, const pixel* bottom, unsigned char* u, unsigned char* v)
+{
+	__m128i r[4], g[4], b[4], red, green, blue, cu, cv;
+	__m128i two = _mm_set1_epi16(2), zero = _mm_setzero_si128();
+	Deinterleave(top, &r[0], &g[0], &b[0]);
+	Deinterleave(top + 8, &r[1], &g[1], &b[1]);
+	Deinterleave(bottom, &r[2], &g[2], &b[2]);
+	Deinterleave(bottom + 8, &r[3], &g[3], &b[3]);
+	red = _mm_add_epi16(PairSums(r[0], r[1]), PairSums(r[2], r[3]));
+	green = _mm_add_epi16(PairSums(g[0], g[1]), PairSums(g[2], g[3]));
+	blue = _mm_add_epi16(PairSums(b[0], b[1]), PairSums(b[2], b[3]));
+	red = _mm_srli_epi16(_mm_add_epi16(red, two), 2);
+	green = _mm_srli_epi16(_mm_add_epi16(green, two), 2);
+	blue = _mm_srli_epi16(_mm_add_epi16(blue, two), 2);
+	/* these fit in signed 16 bits; the shift has to keep the sign */
+	cu = _mm_sub_epi16(_mm_mullo_epi16(blue, _mm_set1_epi16(112)),
+		_mm_add_epi16(_mm_mullo_epi16(red, _mm_set1_epi16(38)),
+			_mm_mullo_epi16(green, _mm_set1_epi16(74))));
+	cv = _mm_sub_epi16(_mm_mullo_epi16(red, _mm_set1_epi16(112)),
+		_mm_add_epi16(_mm_mullo_epi16(green, _mm_set1_epi16(94)),
+			_mm_mullo_epi16(blue, _mm_set1_epi16(18))));
+	cu = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(cu, _mm_set1_epi16(128)), 8), _mm_set1_epi16(128));
+	cv = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(cv, _mm_set1_epi16(128)), 8), _mm_set1_epi16(128));
+	_mm_storel_epi64((__m128i*) u, _mm_packus_epi16(cu, zero));
+	_mm_storel_epi64((__m128i*) v, _mm_packus_epi16(cv, zero));
+}
+#endif
+
+static void ConvertToYUV(const pixel* in, int width, int height, unsigned char* out)
+{
+	int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	unsigned char* lumaPlane = out;
+	unsigned char* uPlane = out + (size_t) width * height;
+	unsigned char* vPlane = uPlane + (size_t) chromaWidth * chromaHeight;
+	int x, y;
+
+	for(y = 0; y < height; y++)
+	{
+		const pixel* row = in + (size_t) y * width;
+		unsigned char* luma = lumaPlane + (size_t) y * width;
+		x = 0;
+#if defined(__SSE2__)
+		for(; x + 8 <= width; x += 8)
+		{
+			_mm_storel_epi64((__m128i*) (luma + x),
+				_mm_packus_epi16(LumaOf8(row + x), _mm_setzero_si128()));
+		}
+#endif
+		for(; x < width; x++) luma[x] = LumaOf(&row[x]);
+	}
+
+	for(y = 0; y < chromaHeight; y++)
+	{
+		const pixel* top = in + (size_t) (2 * y) * width;
+		const pixel* bottom = (2 * y + 1 < height) ? top + width : top;
+		unsigned char* u = uPlane + (size_t) y * chromaWidth;
+		unsigned char* v = vPlane + (size_t) y * chromaWidth;
+		x = 0;
+#if defined(__SSE2__)
+		for(; 2 * x + 16 <= width; x += 8) ChromaOf16(top + 2 * x, bottom + 2 * x, u + x, v + x);
+#endif
+		for(; x < chromaWidth; x++)
+		{
+			int left = 2 * x, right = (2 * x + 1 < width) ? 2 * x + 1 : 2 * x;
+			ChromaOf((top[left].red + top[right].red + bottom[left].red + bottom[right].red + 2) >> 2,
+				(top[left].green + top[right].green + bottom[left].green + bottom[right].green + 2) >> 2,
+				(top[left].blue + top[right].blue + bottom[left].blue + bottom[right].blue + 2) >> 2,
+				&u[x], &v[x]);
+		}
+	}
+}
+
+static void ConvertToRGB(const pixel* in, int width, int height, unsigned char* out)
+{
+	size_t i, count = (size_t) width * height;
+	for(i = 0; i < count; i++)
+	{
+		*out++ = in[i].red;
+		*out++ = in[i].green;
+		*out++ = in[i].blue;
+	}
+}
+
+static int WriteFrame(Video* video, const pixel* frame)
+{
+	size_t size;
+	if(video->format == VIDEO_Y4M)
+	{
+		size = (size_t) video->width * video->height +
+			2 * (size_t) ((video->width + 1) / 2) * ((video->height + 1) / 2);
+		ConvertToYUV(frame, video->width, video->height, video->buffer);
+		if(fputs("FRAME\n", video->out) == EOF) return 0;
+	}
+	else
+	{
+		size = (size_t) video->width * video->height * 3;
+		ConvertToRGB(frame, video->width, video->height, video->buffer);
+	}
+	return fwrite(video->buffer, 1, size, video->out) == size;
+}
+
+static void* VideoWriter(void* context)
+{
+	Video* video = context;
+	pthread_mutex_lock(&video->lock);
+	for(;;)
+	{
+		pixel* frame;
+		int ok;
+		while(!video->filled && !video->finished)
+			pthread_cond_wait(&video->changed, &video->lock);
+		if(!video->filled) break;
+		frame = video->frames[video->head];
+		pthread_mutex_unlock(&video->lock);
+
+		ok = video->failed ? 0 : WriteFrame(video, frame);
+
+		pthread_mutex_lock(&video->lock);
+		if(!ok) video->failed = 1;
+		video->head = (video->head + 1) % VIDEO_QUEUE;
+		video->filled--;
+		pthread_cond_broadcast(&video->changed);
+	}
+	pthread_mutex_unlock(&video->lock);
+	return NULL;
+}
+
+int MakeVideo(StarfishRef tex, FILE* out, int format, int frameCount,
+	double fps, StarfishPoolRef pool)
+{
+	Video video;
+	pthread_t writer;
+	int i, slot, ok, stop;
+	size_t frameSize;
+
+	memset(&video, 0, sizeof(video));
+	video.out = out;
+	video.format = format;
+	video.width = StarfishWidth(tex);
+	video.height = StarfishHeight(tex);
+	frameSize = (size_t) video.width * video.height;
+	video.buffer = malloc(frameSize * 3);
+	for(i = 0; i < VIDEO_QUEUE; i++) video.frames[i] = malloc(frameSize * sizeof(pixel));
+	for(i = 0, ok = (video.buffer != NULL); i < VIDEO_QUEUE; i++) ok = ok && video.frames[i];
+	if(!ok)
+	{
+		fprintf(stderr, "xstarfish: not enough memory for %dx%d video.\n", video.width, video.height);
+		for(i = 0; i < VIDEO_QUEUE; i++) free(video.frames[i]);
+		free(video.buffer);
+		return 0;
+	}
+
+	if(format == VIDEO_Y4M)
+	{
+		/* a whole number of frames per second if we can, milliframes if we can't */
+		if(fps == (int) fps) fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", video.width, video.height, (int) fps);
+		else fprintf(out, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg\n", video.width, video.height, (int) (fps * 1000.0 + 0.5));
+	}
+
+	pthread_mutex_init(&video.lock, NULL);
+	pthread_cond_init(&video.changed, NULL);
+	if(pthread_create(&writer, NULL, VideoWriter, &video))
+	{
+		fprintf(stderr, "xstarfish: could not start the video writer.\n");
+		video.failed = 1;
+	}
+	else
+	{
+		for(i = 0; i < frameCount; i++)
+		{
+			pthread_mutex_lock(&video.lock);
+			while(video.filled == VIDEO_QUEUE && !video.failed)
+				pthread_cond_wait(&video.changed, &video.lock);
+			slot = (video.head + video.filled) % VIDEO_QUEUE;
+			stop = video.failed;
+			pthread_mutex_unlock(&video.lock);
+			if(stop) break;
+
+			/* the writer only ever reads finished frames, never the tree */
+			AnimateStarfish(tex, (float) i / frameCount);
+			RenderStarfish(tex, video.frames[slot], video.width, pool);
+
+			pthread_mutex_lock(&video.lock);
+			video.filled++;
+			pthread_cond_broadcast(&video.changed);
+			pthread_mutex_unlock(&video.lock);
+		}
+		pthread_mutex_lock(&video.lock);
+		video.finished = 1;
+		pthread_cond_broadcast(&video.changed);
+		pthread_mutex_unlock(&video.lock);
+		pthread_join(writer, NULL);
+	}
+	pthread_cond_destroy(&video.changed);
+	pthread_mutex_destroy(&video.lock);
+
+	if(fflush(out) == EOF) video.failed = 1;
+	if(video.failed) fprintf(stderr, "xstarfish: could not write the video.\n");
+	for(i = 0; i < VIDEO_QUEUE; i++) free(video.frames[i]);
+	free(video.buffer);
+	return !video.failed;
+}
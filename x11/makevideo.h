@@ -0,0 +1,42 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+#include "starfish-pool.h"
+
+#define VIDEO_NONE 0
+#define VIDEO_Y4M 1	/* YUV4MPEG2, 4:2:0, BT.601 studio range */
+#define VIDEO_RGB 2	/* bare rgb24 frames, one after another */
+
+/* VIDEO_Y4M or VIDEO_RGB for "y4m" or "rgb", VIDEO_NONE for anything else */
+int VideoFormatForName(const char* name);
+
+/*
+Write one full loop of the texture's animation as frameCount frames.
+The next frame renders on the pool while the writer thread converts and
+writes the ones before it; at most a few frames wait in between, so a
+slow consumer holds up rendering rather than using up memory.
+Returns zero if the video could not be written.
+*/
+int MakeVideo(StarfishRef tex, FILE* out, int format, int frameCount,
+	double fps, StarfishPoolRef pool);
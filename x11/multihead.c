@@ -0,0 +1,156 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "starfish-engine.h"
+#include "starfish-render.h"
+#include "setdesktop.h"
+#include "multihead.h"
+#include "perfstats.h"
+
+/*
+One entry for each monitor. The pattern is rendered once, into the top
+left corner of the monitor's part of the screen, and copied from there
+over the rest of the monitor.
+*/
+typedef struct
+{
+	StarfishRef texture;
+	int left, top;		/* where the monitor starts on the screen */
+	int width, height;	/* the monitor, clipped to the screen */
+	int patchWidth, patchHeight;	/* how much of the pattern we render */
+	int across;		/* tiles in one row of the patch */
+	int firstTile;
+} Head;
+
+typedef struct
+{
+	Head* heads;
+	int count;
+	pixel* screen;
+	int screenWidth;
+	int tileSize;
+} Composite;
+
+static void RenderHeadTile(void* context, int index)
+{
+	Composite* job = context;
+	Head* head = job->heads;
+	int left, top, width, height;
+	while(head + 1 < job->heads + job->count && head[1].firstTile <= index) head++;
+	index -= head->firstTile;
+	left = (index % head->across) * job->tileSize;
+	top = (index / head->across) * job->tileSize;
+	width = head->patchWidth - left;
+	height = head->patchHeight - top;
+	if(width > job->tileSize) width = job->tileSize;
+	if(height > job->tileSize) height = job->tileSize;
+	RenderStarfishRect(head->texture,
+		job->screen + (size_t)(head->top + top) * job->screenWidth + head->left + left,
+		job->screenWidth, left, top, width, height);
+}
+
+static void RepeatPatch(Head* head, pixel* screen, int screenWidth)
+{
+	int x, y;
+	for(y = 0; y < head->height; y++)
+	{
+		pixel* row = screen + (size_t)(head->top + y) * screenWidth + head->left;
+		if(y >= head->patchHeight)
+		{
+			memcpy(row, row - (size_t) head->patchHeight * screenWidth,
+				head->width * sizeof(pixel));
+			continue;
+		}
+		for(x = head->patchWidth; x < head->width; x += head->patchWidth)
+		{
+			int span = head->width - x;
+			if(span > head->patchWidth) span = head->patchWidth;
+			memcpy(row + x, row, span * sizeof(pixel));
+		}
+	}
+}
+
+pixel* RenderMonitorPatterns(const DesktopRect* monitors, int count,
+	const int* widths, const int* heights, int wrapEdges, double budget,
+	int screenWidth, int screenHeight, StarfishPoolRef pool)
+{
+	Head heads[MAX_MONITORS];
+	Composite job;
+	int i, tiles = 0, ok = 1;
+	double area = 0;
+
+	if(count > MAX_MONITORS) count = MAX_MONITORS;
+	for(i = 0; i < count; i++)
+		if(widths[i] > 0 && heights[i] > 0) area += (double) widths[i] * heights[i];
+	job.heads = heads;
+	job.count = 0;
+	job.screenWidth = screenWidth;
+	job.tileSize = StarfishTileSize();
+	BeginPerfStage(STAGE_GENERATE);
+	for(i = 0; i < count; i++)
+	{
+		Head* head = &heads[job.count];
+		int right = monitors[i].x + monitors[i].width;
+		int bottom = monitors[i].y + monitors[i].height;
+		head->left = monitors[i].x > 0 ? monitors[i].x : 0;
+		head->top = monitors[i].y > 0 ? monitors[i].y : 0;
+		head->width = (right < screenWidth ? right : screenWidth) - head->left;
+		head->height = (bottom < screenHeight ? bottom : screenHeight) - head->top;
+		if(head->width <= 0 || head->height <= 0 || widths[i] <= 0 || heights[i] <= 0) continue;
+		if(budget > 0)
+		{
+			/* Each pattern gets its share of the time by area. */
+			head->texture = MakeStarfishWithin(widths[i], heights[i], NULL, wrapEdges,
+				budget * widths[i] * heights[i] / area, StarfishPoolThreads(pool));
+		}
+		else head->texture = MakeStarfish(widths[i], heights[i], NULL, wrapEdges);
+		if(!head->texture)
+		{
+			ok = 0;
+			break;
+		}
+		head->patchWidth = widths[i] < head->width ? widths[i] : head->width;
+		head->patchHeight = heights[i] < head->height ? heights[i] : head->height;
+		head->across = (head->patchWidth + job.tileSize - 1) / job.tileSize;
+		head->firstTile = tiles;
+		tiles += head->across *
+			((head->patchHeight + job.tileSize - 1) / job.tileSize);
+		job.count++;
+	}
+	EndPerfStage(STAGE_GENERATE);
+
+	job.screen = NULL;
+	if(ok && job.count)
+		job.screen = calloc((size_t) screenWidth * screenHeight, sizeof(pixel));
+	if(job.screen)
+	{
+		BeginPerfStage(STAGE_RENDER);
+		RunStarfishTasks(pool, RenderHeadTile, &job, tiles);
+		for(i = 0; i < job.count; i++) RepeatPatch(&heads[i], job.screen, screenWidth);
+		EndPerfStage(STAGE_RENDER);
+	}
+	for(i = 0; i < job.count; i++) DumpStarfish(heads[i].texture);
+	return job.screen;
+}
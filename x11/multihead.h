@@ -0,0 +1,42 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "starfish-pool.h"
+
+/* monitors past this many are left black */
+#define MAX_MONITORS 16
+
+/*
+Give each monitor its own pattern and render them all into one image the
+size of the whole screen, ready for SetXDesktopPixels. Pattern i is
+widths[i] by heights[i]; one smaller than its monitor is repeated across
+it, and one larger is cropped. Areas no monitor covers are left black.
+With a budget above zero, the patterns are picked to render within that
+many seconds between them.
+The patterns are built one after another, since building draws random
+numbers, but every tile of every pattern is rendered in one batch on the
+pool. Returns a malloc'd image, or NULL if something could not be made.
+*/
+pixel* RenderMonitorPatterns(const DesktopRect* monitors, int count,
+	const int* widths, const int* heights, int wrapEdges, double budget,
+	int screenWidth, int screenHeight, StarfishPoolRef pool);
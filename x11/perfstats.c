@@ -0,0 +1,237 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "perfstats.h"
+
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_BRANCH_MISSES 2
+#define COUNTER_L1D_MISSES 3
+#define COUNTER_LLC_MISSES 4
+#define COUNTER_COUNT 5
+
+static const char* const counterNames[COUNTER_COUNT] =
+{
+	"cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"
+};
+
+static const char* const stageNames[STAGE_COUNT] = { "generate", "render", "encode", "upload" };
+
+typedef struct
+{
+	double wall, cpu;
+	double counts[COUNTER_COUNT];
+} Reading;
+
+typedef struct
+{
+	int runs;
+	Reading spent;
+	Reading start;
+} Stage;
+
+static int opened;
+static int counters[COUNTER_COUNT] = { -1, -1, -1, -1, -1 };
+static Stage stages[STAGE_COUNT];
+
+#ifdef __linux__
+static int OpenCounter(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	/* Our own work, on every thread: what the kernel does is its business. */
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t CacheMisses(uint64_t cache)
+{
+	return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+static double ReadCounter(int fd)
+{
+#ifdef __linux__
+	/*
+	With more counters than the processor has, the kernel takes turns
+	with them; scale up by how much of the time this one was counting.
+	*/
+	uint64_t values[3];
+	if(fd < 0 || read(fd, values, sizeof(values)) != sizeof(values)) return 0;
+	if(!values[2]) return 0;
+	return (double) values[0] * values[1] / values[2];
+#else
+	(void) fd;
+	return 0;
+#endif
+}
+
+static void Read(Reading* reading)
+{
+	struct timespec now;
+	int i;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	reading->wall = now.tv_sec + now.tv_nsec * 1e-9;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	reading->cpu = now.tv_sec + now.tv_nsec * 1e-9;
+	for(i = 0; i < COUNTER_COUNT; i++) reading->counts[i] = ReadCounter(counters[i]);
+}
+
+int OpenPerfStats(void)
+{
+	int i, count = 0;
+#ifdef __linux__
+	counters[COUNTER_CYCLES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	counters[COUNTER_INSTRUCTIONS] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	counters[COUNTER_BRANCH_MISSES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	counters[COUNTER_L1D_MISSES] = OpenCounter(PERF_TYPE_HW_CACHE, CacheMisses(PERF_COUNT_HW_CACHE_L1D));
+	counters[COUNTER_LLC_MISSES] = OpenCounter(PERF_TYPE_HW_CACHE, CacheMisses(PERF_COUNT_HW_CACHE_LL));
+#endif
+	for(i = 0; i < COUNTER_COUNT; i++)
+		if(counters[i] >= 0) count++;
+	memset(stages, 0, sizeof(stages));
+	opened = 1;
+	return count;
+}
+
+void ClosePerfStats(void)
+{
+	int i;
+	for(i = 0; i < COUNTER_COUNT; i++)
+	{
+		if(counters[i] >= 0) close(counters[i]);
+		counters[i] = -1;
+	}
+	opened = 0;
+}
+
+void BeginPerfStage(int stage)
+{
+	if(!opened || stage < 0 || stage >= STAGE_COUNT) return;
+	Read(&stages[stage].start);
+}
+
+void EndPerfStage(int stage)
+{
+	Reading now;
+	Stage* it;
+	int i;
+	if(!opened || stage < 0 || stage >= STAGE_COUNT) return;
+	Read(&now);
+	it = &stages[stage];
+	it->runs++;
+	it->spent.wall += now.wall - it->start.wall;
+	it->spent.cpu += now.cpu - it->start.cpu;
+	for(i = 0; i < COUNTER_COUNT; i++) it->spent.counts[i] += now.counts[i] - it->start.counts[i];
+}
+
+static void ReportTable(FILE* out, const Reading* total)
+{
+	int s, i;
+	fprintf(out, "%-9s %10s %10s", "stage", "wall ms", "cpu ms");
+	for(i = 0; i < COUNTER_COUNT; i++)
+		if(counters[i] >= 0) fprintf(out, " %14s", counterNames[i]);
+	if(counters[COUNTER_CYCLES] >= 0 && counters[COUNTER_INSTRUCTIONS] >= 0) fprintf(out, " %6s", "IPC");
+	fprintf(out, "\n");
+	for(s = 0; s <= STAGE_COUNT; s++)
+	{
+		const Reading* spent = s < STAGE_COUNT ? &stages[s].spent : total;
+		if(s < STAGE_COUNT && !stages[s].runs) continue;
+		fprintf(out, "%-9s %10.1f %10.1f", s < STAGE_COUNT ? stageNames[s] : "total",
+			spent->wall * 1000, spent->cpu * 1000);
+		for(i = 0; i < COUNTER_COUNT; i++)
+			if(counters[i] >= 0) fprintf(out, " %14.0f", spent->counts[i]);
+		if(counters[COUNTER_CYCLES] >= 0 && counters[COUNTER_INSTRUCTIONS] >= 0)
+		{
+			double cycles = spent->counts[COUNTER_CYCLES];
+			fprintf(out, " %6.2f", cycles > 0 ? spent->counts[COUNTER_INSTRUCTIONS] / cycles : 0.0);
+		}
+		fprintf(out, "\n");
+	}
+	if(counters[COUNTER_CYCLES] < 0)
+		fprintf(out, "(no hardware counters here; see /proc/sys/kernel/perf_event_paranoid)\n");
+}
+
+static void ReportJSON(FILE* out, const Reading* total)
+{
+	int s, i, first = 1;
+	fprintf(out, "{\"stages\": [");
+	for(s = 0; s <= STAGE_COUNT; s++)
+	{
+		const Reading* spent = s < STAGE_COUNT ? &stages[s].spent : total;
+		if(s < STAGE_COUNT && !stages[s].runs) continue;
+		fprintf(out, "%s\n\t{\"stage\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f", first ? "" : ",",
+			s < STAGE_COUNT ? stageNames[s] : "total", spent->wall * 1000, spent->cpu * 1000);
+		/* A counter that isn't there is null, not nought. */
+		for(i = 0; i < COUNTER_COUNT; i++)
+		{
+			if(counters[i] >= 0) fprintf(out, ", \"%s\": %.0f", counterNames[i], spent->counts[i]);
+			else fprintf(out, ", \"%s\": null", counterNames[i]);
+		}
+		if(counters[COUNTER_CYCLES] >= 0 && counters[COUNTER_INSTRUCTIONS] >= 0
+				&& spent->counts[COUNTER_CYCLES] > 0)
+			fprintf(out, ", \"ipc\": %.3f}", spent->counts[COUNTER_INSTRUCTIONS] / spent->counts[COUNTER_CYCLES]);
+		else fprintf(out, ", \"ipc\": null}");
+		first = 0;
+	}
+	fprintf(out, "\n]}\n");
+}
+
+void ReportPerfStats(FILE* out, int format)
+{
+	Reading total;
+	int s, i;
+	if(!opened) return;
+	memset(&total, 0, sizeof(total));
+	for(s = 0; s < STAGE_COUNT; s++)
+	{
+		total.wall += stages[s].spent.wall;
+		total.cpu += stages[s].spent.cpu;
+		for(i = 0; i < COUNTER_COUNT; i++) total.counts[i] += stages[s].spent.counts[i];
+	}
+	if(format == STATS_JSON) ReportJSON(out, &total);
+	else ReportTable(out, &total);
+	fflush(out);
+	for(s = 0; s < STAGE_COUNT; s++)
+	{
+		stages[s].runs = 0;
+		memset(&stages[s].spent, 0, sizeof(stages[s].spent));
+	}
+}
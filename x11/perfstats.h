@@ -0,0 +1,57 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+
+/*
+--stats times each stage of making a pattern, by the wall clock and by
+processor time over all of the process's threads, and counts what the
+processor did meanwhile through the kernel's hardware performance
+counters (Linux's perf_event_open): cycles, instructions, branch misses,
+and level 1 data cache and last level cache misses. The counters follow
+every thread started after OpenPerfStats, so open them before making a
+pool. Whatever counters the kernel or the machine won't give, through
+perf_event_paranoid, a virtual machine or another system altogether,
+are left out of the report, and the times are there regardless.
+
+Stages can be begun and ended in any order, but each must be ended
+before it is begun again. Calls when the stats aren't open do nothing.
+ReportPerfStats prints what has been counted since the last report,
+as a table or as JSON, and starts over.
+*/
+
+#define STAGE_GENERATE 0	/* building the tree of waves */
+#define STAGE_RENDER 1		/* filling in the pixels */
+#define STAGE_ENCODE 2		/* writing the png through libpng */
+#define STAGE_UPLOAD 3		/* putting the pixels on the X server */
+#define STAGE_COUNT 4
+
+#define STATS_TABLE 1
+#define STATS_JSON 2
+
+/* returns how many hardware counters could be opened */
+int OpenPerfStats(void);
+void ClosePerfStats(void);
+void BeginPerfStage(int stage);
+void EndPerfStage(int stage);
+void ReportPerfStats(FILE* out, int format);
@@ -0,0 +1,273 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rendercache.h"
+
+#define CACHE_MAGIC 0x53464331	/* "SFC1" */
+#define CACHE_SUFFIX ".sfc"
+#define STALE_TEMPORARY 3600	/* seconds before a leftover temporary file is junk */
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t reserved;
+	RenderCacheKey key;
+} CacheHeader;
+
+static size_t cacheLimit = RENDER_CACHE_DEFAULT_LIMIT;
+
+void InitRenderCacheKey(RenderCacheKey* key, unsigned int seed, int width, int height,
+	int wrapEdges, const StarfishPalette* palette)
+{
+	/* keys are hashed and compared byte for byte, padding and all */
+	memset(key, 0, sizeof(*key));
+	key->engineVersion = STARFISH_ENGINE_VERSION;
+	key->seed = seed;
+	key->width = width;
+	key->height = height;
+	key->wrapEdges = wrapEdges != 0;
+	if(palette && palette->colourcount > 0)
+	{
+		key->colourCount = palette->colourcount;
+		memcpy(key->colours, palette->colour, palette->colourcount * sizeof(pixel));
+	}
+}
+
+void SetRenderCacheLimit(size_t bytes)
+{
+	cacheLimit = bytes;
+}
+
+/* find the cache directory, making it if it isn't there yet */
+static int CacheDirectory(char* path, size_t size)
+{
+	const char* base = getenv("XDG_CACHE_HOME");
+	int length;
+	if(base && *base) length = snprintf(path, size, "%s", base);
+	else
+	{
+		const char* home = getenv("HOME");
+		if(!home || !*home) return 0;
+		length = snprintf(path, size, "%s/.cache", home);
+	}
+	if(length < 0 || (size_t) length >= size) return 0;
+	mkdir(path, 0700);
+	length = snprintf(path + length, size - length, "/starfish") + length;
+	if(length < 0 || (size_t) length >= size) return 0;
+	return !mkdir(path, 0700) || errno == EEXIST;
+}
+
+/* FNV-1a, which is plenty for naming files */
+static uint64_t HashKey(const RenderCacheKey* key)
+{
+	const unsigned char* byte = (const unsigned char*) key;
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+	for(i = 0; i < sizeof(*key); i++)
+	{
+		hash ^= byte[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static int CachePath(const RenderCacheKey* key, char* path, size_t size)
+{
+	char dir[1024];
+	int length;
+	if(!CacheDirectory(dir, sizeof(dir))) return 0;
+	length = snprintf(path, size, "%s/%016llx" CACHE_SUFFIX, dir, (unsigned long long) HashKey(key));
+	return length > 0 && (size_t) length < size;
+}
+
+static size_t CacheFileSize(const RenderCacheKey* key)
+{
+	return sizeof(CacheHeader) + (size_t) key->width * key->height * sizeof(pixel);
+}
+
+int FindCachedRender(const RenderCacheKey* key, CachedRender* found)
+{
+	char path[1100];
+	struct stat info;
+	const CacheHeader* header;
+	void* map;
+	int fd;
+	if(!cacheLimit || !CachePath(key, path, sizeof(path))) return 0;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return 0;
+	if(fstat(fd, &info) || (size_t) info.st_size != CacheFileSize(key))
+	{
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		close(fd);
+		return 0;
+	}
+	header = map;
+	if(header->magic != CACHE_MAGIC || memcmp(&header->key, key, sizeof(*key)))
+	{
+		munmap(map, info.st_size);
+		close(fd);
+		return 0;
+	}
+	/* this is what keeps it from being trimmed away */
+	futimens(fd, NULL);
+	close(fd);
+	found->pixels = (const pixel*) (header + 1);
+	found->width = key->width;
+	found->height = key->height;
+	found->map = map;
+	found->mapSize = info.st_size;
+	return 1;
+}
+
+void ReleaseCachedRender(CachedRender* found)
+{
+	if(found->map) munmap(found->map, found->mapSize);
+	found->map = NULL;
+	found->pixels = NULL;
+}
+
+typedef struct
+{
+	char name[64];
+	time_t used;
+	off_t size;
+} CacheFile;
+
+static int OlderFirst(const void* a, const void* b)
+{
+	time_t x = ((const CacheFile*) a)->used, y = ((const CacheFile*) b)->used;
+	return (x > y) - (x < y);
+}
+
+/*
+Throw out the least recently used files until what is left fits, along
+with temporary files that nobody finished writing.
+*/
+static void TrimCache(const char* dir)
+{
+	DIR* listing = opendir(dir);
+	CacheFile* files = NULL;
+	int count = 0, room = 0, i;
+	off_t total = 0;
+	time_t now = time(NULL);
+	struct dirent* entry;
+	if(!listing) return;
+	while((entry = readdir(listing)) != NULL)
+	{
+		char path[1100];
+		struct stat info;
+		size_t length = strlen(entry->d_name);
+		if(length >= sizeof(files->name)) continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		if(lstat(path, &info) || !S_ISREG(info.st_mode)) continue;
+		if(!strncmp(entry->d_name, "tmp-", 4))
+		{
+			if(now - info.st_mtime > STALE_TEMPORARY) unlink(path);
+			continue;
+		}
+		if(length <= strlen(CACHE_SUFFIX) || strcmp(entry->d_name + length - strlen(CACHE_SUFFIX), CACHE_SUFFIX))
+			continue;
+		if(count == room)
+		{
+			CacheFile* more;
+			room = room ? room * 2 : 64;
+			more = realloc(files, room * sizeof(CacheFile));
+			if(!more) break;
+			files = more;
+		}
+		strcpy(files[count].name, entry->d_name);
+		files[count].used = info.st_mtime;
+		files[count].size = info.st_size;
+		total += info.st_size;
+		count++;
+	}
+	closedir(listing);
+	qsort(files, count, sizeof(CacheFile), OlderFirst);
+	for(i = 0; i < count && total > (off_t) cacheLimit; i++)
+	{
+		char path[1100];
+		snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+		if(!unlink(path)) total -= files[i].size;
+	}
+	free(files);
+}
+
+static int WriteAll(int fd, const void* data, size_t size)
+{
+	const char* out = data;
+	while(size)
+	{
+		ssize_t wrote = write(fd, out, size);
+		if(wrote < 0 && errno == EINTR) continue;
+		if(wrote <= 0) return 0;
+		out += wrote;
+		size -= wrote;
+	}
+	return 1;
+}
+
+int StoreCachedRender(const RenderCacheKey* key, const pixel* pixels, int rowPixels)
+{
+	char dir[1024], path[1100], temporary[1100];
+	CacheHeader header;
+	int fd, row, ok;
+	if(!cacheLimit || CacheFileSize(key) > cacheLimit) return 0;
+	if(!CacheDirectory(dir, sizeof(dir)) || !CachePath(key, path, sizeof(path))) return 0;
+	snprintf(temporary, sizeof(temporary), "%s/tmp-XXXXXX", dir);
+	fd = mkstemp(temporary);
+	if(fd < 0) return 0;
+	memset(&header, 0, sizeof(header));
+	header.magic = CACHE_MAGIC;
+	header.key = *key;
+	ok = WriteAll(fd, &header, sizeof(header));
+	for(row = 0; ok && row < key->height; row++)
+	{
+		ok = WriteAll(fd, pixels + (size_t) row * rowPixels, key->width * sizeof(pixel));
+	}
+	if(close(fd)) ok = 0;
+	/* rename replaces any older copy in one step, so readers see one or the other */
+	if(ok) ok = !rename(temporary, path);
+	if(!ok)
+	{
+		unlink(temporary);
+		return 0;
+	}
+	TrimCache(dir);
+	return 1;
+}
@@ -0,0 +1,81 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "starfish-engine.h"
+
+/*
+Finished patterns are kept on disk, in $XDG_CACHE_HOME/starfish (or
+~/.cache/starfish), one file per pattern. A file is named for a hash of
+everything that decides its pixels and starts with all of it, so a hash
+collision is caught rather than believed. Hits are read through mmap,
+and each one freshens the file's modification time; when the cache grows
+past its limit, the files used least recently go first. A new file is
+written under a temporary name and renamed into place, so readers never
+see half of one, and several processes can share the cache safely.
+*/
+
+#define RENDER_CACHE_DEFAULT_LIMIT (256 * 1024 * 1024)
+
+typedef struct
+{
+	uint32_t engineVersion;
+	uint32_t seed;
+	int32_t width, height;
+	uint32_t wrapEdges;
+	int32_t colourCount;	/* zero when the seed picks the palette */
+	pixel colours[MAX_PALETTE_ENTRIES];
+} RenderCacheKey;
+
+typedef struct
+{
+	const pixel* pixels;	/* width * height of them, rows top to bottom */
+	int width, height;
+	void* map;
+	size_t mapSize;
+} CachedRender;
+
+/* a NULL palette means the seed picks one */
+void InitRenderCacheKey(RenderCacheKey* key, unsigned int seed, int width, int height,
+	int wrapEdges, const StarfishPalette* palette);
+
+/*
+The most the cache may hold, in bytes; zero turns it off, so nothing is
+found and nothing is stored.
+*/
+void SetRenderCacheLimit(size_t bytes);
+
+/*
+Look for a pattern. Returns nonzero and fills in found if it is there;
+release it when done with it.
+*/
+int FindCachedRender(const RenderCacheKey* key, CachedRender* found);
+void ReleaseCachedRender(CachedRender* found);
+
+/*
+Keep a rendered pattern, then trim the cache to its limit. rowPixels is
+the distance from one row of pixels to the next. Returns zero if it
+could not be stored, which does no harm beyond a later miss.
+*/
+int StoreCachedRender(const RenderCacheKey* key, const pixel* pixels, int rowPixels);
@@ -24,122 +24,657 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+#ifdef HAVE_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
+#ifdef HAVE_XINERAMA
+#include <X11/extensions/Xinerama.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include "starfish-engine.h"
+#include "starfish-render.h"
+#include "starfish-trace.h"
+#include "setdesktop.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+The image goes up to the server in bands of this many rows. While one band
+is in flight the pool is already rendering the next one.
+*/
+#define BAND_ROWS 64
 
 Display *display;
-int screen,depth,bpp,width,height;
+int screen,depth,width,height;
 Window rootwin;
+Visual *visual;
 GC gc;
 XImage *image=0;
+XShmSegmentInfo shminfo;
+int useshm;
+
+/*
+A packer turns a row of engine pixels into a row of the XImage, in the
+server's pixel format. The common visuals have their own packers that
+write straight into image->data; anything else goes through XPutPixel.
+*/
+typedef void (*RowPacker)(const pixel* in, XImage* image, int y, int count);
+
+int redshift,greenshift,blueshift;
 
 int compose(int i, int shift)
 {
   return (shift<0) ? (i>>(-shift)) : (i<<shift); 
 }
 
-void fillimage(StarfishRef tex)
+void packgeneric(const pixel* in, XImage* image, int y, int count)
 {
-  int x,y;
+  int x;
   unsigned long value;
-  int redshift,greenshift,blueshift;
-  pixel pixel;
-     
+  for (x=0; x<count; x++)
+  {
+    value  = compose(in[x].red,redshift) & image->red_mask;
+    value += compose(in[x].green,greenshift) & image->green_mask;
+    value += compose(in[x].blue,blueshift) & image->blue_mask;
+    XPutPixel(image,x,y,value);
+  }
+}
+
+/* 32 bits per pixel, blue in the lowest byte: the usual 24 and 32 bit visual */
+void packbgrx(const pixel* in, XImage* image, int y, int count)
+{
+  unsigned int *out = (unsigned int *) (image->data + y * image->bytes_per_line);
+  const unsigned int *src = (const unsigned int *) in;
+  int x = 0;
+#if defined(__SSE2__)
+  const __m128i green = _mm_set1_epi32(0x0000FF00);
+  const __m128i low = _mm_set1_epi32(0x000000FF);
+  const __m128i opaque = _mm_set1_epi32(0xFF000000);
+  for (; x+4 <= count; x+=4)
+  {
+    /* pixels are R,G,B,A in memory; swap red and blue, and the top byte
+       is opaque whatever alpha says, as it is for the odd pixels after */
+    __m128i v = _mm_loadu_si128((const __m128i *) (src+x));
+    __m128i r = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+    v = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, green), opaque), _mm_or_si128(r, b));
+    _mm_storeu_si128((__m128i *) (out+x), v);
+  }
+#endif
+  for (; x<count; x++)
+    out[x] = 0xFF000000 | (in[x].red<<16) | (in[x].green<<8) | in[x].blue;
+}
+
+/* 32 bits per pixel, red in the lowest byte: our own layout */
+void packrgbx(const pixel* in, XImage* image, int y, int count)
+{
+  memcpy(image->data + y * image->bytes_per_line, in, count * sizeof(pixel));
+}
+
+/* 16 bits per pixel, 5-6-5 */
+void pack565(const pixel* in, XImage* image, int y, int count)
+{
+  unsigned short *out = (unsigned short *) (image->data + y * image->bytes_per_line);
+  const unsigned int *src = (const unsigned int *) in;
+  int x = 0;
+#if defined(__SSE2__)
+  const __m128i rmask = _mm_set1_epi32(0x000000F8);
+  const __m128i gmask = _mm_set1_epi32(0x0000FC00);
+  const __m128i bmask = _mm_set1_epi32(0x00F80000);
+  for (; x+8 <= count; x+=8)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i *) (src+x));
+    __m128i b = _mm_loadu_si128((const __m128i *) (src+x+4));
+    a = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(a, rmask), 8),
+          _mm_srli_epi32(_mm_and_si128(a, gmask), 5)), _mm_srli_epi32(_mm_and_si128(a, bmask), 19));
+    b = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(b, rmask), 8),
+          _mm_srli_epi32(_mm_and_si128(b, gmask), 5)), _mm_srli_epi32(_mm_and_si128(b, bmask), 19));
+    /* sign-extend so that the saturating pack leaves the bits alone */
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    _mm_storeu_si128((__m128i *) (out+x), _mm_packs_epi32(a, b));
+  }
+#endif
+  for (; x<count; x++)
+    out[x] = ((in[x].red & 0xF8)<<8) | ((in[x].green & 0xFC)<<3) | (in[x].blue>>3);
+}
+
+/* 32 bits per pixel holding 10 bits of each channel */
+void pack30(const pixel* in, XImage* image, int y, int count)
+{
+  unsigned int *out = (unsigned int *) (image->data + y * image->bytes_per_line);
+  const unsigned int *src = (const unsigned int *) in;
+  int x = 0;
+#if defined(__SSE2__)
+  const __m128i low = _mm_set1_epi32(0x000000FF);
+  for (; x+4 <= count; x+=4)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *) (src+x));
+    __m128i r = _mm_and_si128(v, low);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), low);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+    /* widen each channel to 10 bits by repeating its top bits */
+    r = _mm_or_si128(_mm_slli_epi32(r, 2), _mm_srli_epi32(r, 6));
+    g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 6));
+    b = _mm_or_si128(_mm_slli_epi32(b, 2), _mm_srli_epi32(b, 6));
+    v = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 20), _mm_slli_epi32(g, 10)), b);
+    _mm_storeu_si128((__m128i *) (out+x), v);
+  }
+#endif
+  for (; x<count; x++)
+    out[x] = (((in[x].red<<2) | (in[x].red>>6)) << 20) |
+             (((in[x].green<<2) | (in[x].green>>6)) << 10) |
+             ((in[x].blue<<2) | (in[x].blue>>6));
+}
+
+RowPacker choosepacker(XImage* image)
+{
+  int x;
+  union { int i; char c; } host;
+
+  /* the generic packer needs these; the others don't care */
   x=image->red_mask; redshift=-8;
   while(x) { x/=2; redshift++; }
   x=image->green_mask; greenshift=-8;
   while(x) { x/=2; greenshift++; }
   x=image->blue_mask; blueshift=-8;
   while(x) { x/=2; blueshift++; }
-     
-  for (y=0; y<height; y++)
+
+  /* the fast packers write words in our own byte order */
+  host.i = 1;
+  if (image->byte_order != (host.c ? LSBFirst : MSBFirst))
+    return packgeneric;
+  if (image->bits_per_pixel == 32 && image->red_mask == 0xFF0000 &&
+      image->green_mask == 0xFF00 && image->blue_mask == 0xFF)
+    return packbgrx;
+  if (image->bits_per_pixel == 32 && image->red_mask == 0xFF &&
+      image->green_mask == 0xFF00 && image->blue_mask == 0xFF0000 && host.c)
+    return packrgbx;
+  if (image->bits_per_pixel == 32 && image->red_mask == 0x3FF00000 &&
+      image->green_mask == 0xFFC00 && image->blue_mask == 0x3FF)
+    return pack30;
+  if (image->bits_per_pixel == 16 && image->red_mask == 0xF800 &&
+      image->green_mask == 0x7E0 && image->blue_mask == 0x1F)
+    return pack565;
+  return packgeneric;
+}
+
+static int shmfailed;
+
+static int shmerror(Display* display, XErrorEvent* event)
+{
+  (void) display;
+  (void) event;
+  shmfailed = 1;
+  return 0;
+}
+
+/*
+Make the XImage we render into. If the server is on this machine we share
+the image's memory with it, which saves pushing every byte down the socket.
+*/
+XImage* createimage(void)
+{
+  XImage *out;
+  int (*oldhandler)(Display*, XErrorEvent*);
+
+  useshm = 0;
+  if (XShmQueryExtension(display))
   {
-    for (x=0; x<width; x++)
+    out = XShmCreateImage(display, visual, depth, ZPixmap, NULL, &shminfo, width, height);
+    if (out)
     {
-      GetStarfishPixel(x, y, tex, &pixel);
-      value  = compose(pixel.red,redshift) & image->red_mask;
-      value += compose(pixel.green,greenshift) & image->green_mask;
-      value += compose(pixel.blue,blueshift) & image->blue_mask;
-      XPutPixel(image,x,y,value);
+      shminfo.shmid = shmget(IPC_PRIVATE, out->bytes_per_line * out->height, IPC_CREAT|0600);
+      if (shminfo.shmid != -1)
+      {
+        shminfo.shmaddr = out->data = shmat(shminfo.shmid, 0, 0);
+        shminfo.readOnly = False;
+        if (shminfo.shmaddr != (char *) -1)
+        {
+          /* attaching fails when the server is on another machine */
+          shmfailed = 0;
+          oldhandler = XSetErrorHandler(shmerror);
+          XShmAttach(display, &shminfo);
+          XSync(display, False);
+          XSetErrorHandler(oldhandler);
+          /* the segment goes away once both of us have let go of it */
+          shmctl(shminfo.shmid, IPC_RMID, 0);
+          if (!shmfailed)
+          {
+            useshm = 1;
+            return out;
+          }
+          shmdt(shminfo.shmaddr);
+        }
+        else shmctl(shminfo.shmid, IPC_RMID, 0);
+      }
+      out->data = NULL;
+      XDestroyImage(out);
     }
   }
+
+  out = XCreateImage(display, visual, depth, ZPixmap, 0, NULL, width, height,
+                     BitmapPad(display), 0);
+  if (out)
+  {
+    out->data = malloc(out->bytes_per_line * height);
+    if (!out->data)
+    {
+      XDestroyImage(out);
+      out = NULL;
+    }
+  }
+  return out;
 }
 
-void XSetWindowBackgroundImage(Display* display, Drawable window, XImage* image)
+void destroyimage(void)
 {
-  Pixmap out;
-  if (out = XCreatePixmap(display, window, image->width, image->height, depth))
+  if (useshm)
   {
-    XPutImage(display, out, gc, image, 0,0, 0,0, image->width, image->height);
-    XSetWindowBackgroundPixmap(display, window, out);
-    XFreePixmap(display, out);
-    //Force the entire window to redraw itself. This shows our pixmap.
-    XClearWindow(display, window);
+    XShmDetach(display, &shminfo);
+    XSync(display, False);
+    XDestroyImage(image);
+    shmdt(shminfo.shmaddr);
+  }
+  else XDestroyImage(image);
+  image = 0;
+}
+
+void putband(Drawable out, int top, int rows)
+{
+  double start = StarfishTraceClock();
+  if (useshm)
+    XShmPutImage(display, out, gc, image, 0, top, 0, top, width, rows, False);
+  else
+    XPutImage(display, out, gc, image, 0, top, 0, top, width, rows);
+  XFlush(display);
+  StarfishTraceSpan("upload", "put band", start, "top", top, "rows", rows);
+}
+
+typedef struct
+{
+  StarfishRef tex;		/* render rows from here... */
+  const pixel *pixels;		/* ...or pack them from here */
+  RowPacker pack;
+  int top;
+} Band;
+
+void renderrow(void* context, int index)
+{
+  Band *band = context;
+  int y = band->top + index;
+  pixel *row;
+  if (!band->tex)
+  {
+    band->pack(band->pixels + y * width, image, y, width);
+    return;
   }
+  row = malloc(width * sizeof(pixel));
+  if (!row) return;
+  RenderStarfishRect(band->tex, row, width, 0, y, width, 1);
+  band->pack(row, image, y, width);
+  free(row);
 }
 
-void mainloop(StarfishRef tex)
+/*
+Render into the image a band at a time and send each band to the pixmap as
+soon as it is finished, while the next band is being rendered.
+*/
+void fillpixmap(StarfishRef tex, const pixel* pixels, Drawable out, StarfishPoolRef pool)
 {
-  char *buf;
-  int bpl;
-  int n_pmf;
-  int i;
-  XPixmapFormatValues * pmf;   
-     
-  pmf = XListPixmapFormats (display, &n_pmf);
-  if (pmf)
+  Band band[2];
+  StarfishTasksRef tasks[2];
+  RowPacker pack = choosepacker(image);
+  int top, next, rows;
+
+  band[0].tex = band[1].tex = tex;
+  band[0].pixels = band[1].pixels = pixels;
+  band[0].pack = band[1].pack = pack;
+  band[0].top = 0;
+  rows = (height < BAND_ROWS) ? height : BAND_ROWS;
+  tasks[0] = StartStarfishTasks(pool, renderrow, &band[0], rows);
+  for (top = 0, next = 0; top < height; top += BAND_ROWS, next ^= 1)
   {
-    for (i = 0; i < n_pmf; i++)
+    int nexttop = top + BAND_ROWS;
+    FinishStarfishTasks(tasks[next]);
+    if (nexttop < height)
     {
-      if (pmf[i].depth == depth)
-      {
-        int pad, pad_bytes;
-        bpp = pmf[i].bits_per_pixel;
-	bpl = width * bpp / 8;
-	pad = pmf[i].scanline_pad;
-	pad_bytes = pad / 8;
-	/* make bpl a whole multiple of pad/8 */
-	bpl = (bpl + pad_bytes - 1) & ~(pad_bytes - 1);
-        buf=malloc(height*bpl);
-        image=XCreateImage(display,DefaultVisual(display,screen), depth,
-       	                   ZPixmap,0,buf,width,height,pad,bpl);
-        if(!image)
-        {
-          puts("starfish: XCreateImage failed");
-          return;
-        }
-	break;
-      }
+      band[next^1].top = nexttop;
+      tasks[next^1] = StartStarfishTasks(pool, renderrow, &band[next^1],
+        (height - nexttop < BAND_ROWS) ? height - nexttop : BAND_ROWS);
     }
-    XFree ((char *) pmf);
-  }    
+    putband(out, top, (height - top < BAND_ROWS) ? height - top : BAND_ROWS);
+  }
+}
 
-  if (! XInitImage(image))
+void mainloop(StarfishRef tex, const pixel* pixels, StarfishPoolRef pool)
+{
+  Pixmap out;
+  double start = StarfishTraceClock();
+
+  image = createimage();
+  if(!image)
+  {
+    puts("starfish: XCreateImage failed");
     return;
-  fillimage(tex);
-  XSetWindowBackgroundImage(display, rootwin, image);
-  XDestroyImage(image);
+  }
+  if ((out = XCreatePixmap(display, rootwin, width, height, depth)))
+  {
+    fillpixmap(tex, pixels, out, pool);
+    XSetWindowBackgroundPixmap(display, rootwin, out);
+    XFreePixmap(display, out);
+    //Force the entire window to redraw itself. This shows our pixmap.
+    XClearWindow(display, rootwin);
+    XFlush(display);
+  }
+  destroyimage();
+  StarfishTraceSpan("upload", tex ? "render and upload" : "upload", start, "width", width, "height", height);
 }
 
-void SetXDesktop(StarfishRef tex, const char* displayname)
+int OpenXDesktop(const char* displayname)
 {
+  if (display)
+    return 1;
   if (! (display = XOpenDisplay(displayname)))
   {
     fprintf(stderr, "xstarfish: Failed to open display\n");
-    return;
+    return 0;
   }
   screen = DefaultScreen(display);
   depth = DefaultDepth(display, screen);
   rootwin = RootWindow(display, screen);
   gc=DefaultGC(display,screen);
+  visual = DefaultVisual(display, screen);
+  return 1;
+}
+
+void CloseXDesktop(void)
+{
+  if (display)
+    XCloseDisplay(display);
+  display = 0;
+}
+
+int XDesktopSize(int* w, int* h)
+{
+  if (!display)
+    return 0;
+  *w = DisplayWidth(display, screen);
+  *h = DisplayHeight(display, screen);
+  return 1;
+}
+
+/*
+Ask RandR for the monitors first; it knows about rotated and cloned
+outputs. Servers without RandR 1.5 may still speak Xinerama. Failing
+both, the whole screen is one monitor.
+*/
+int XDesktopMonitors(DesktopRect* rects, int max)
+{
+  int count = 0;
+  if (!display || max < 1)
+    return 0;
+#ifdef HAVE_XRANDR
+  {
+    int event, error, major = 0, minor = 0;
+    if (XRRQueryExtension(display, &event, &error) &&
+        XRRQueryVersion(display, &major, &minor) &&
+        (major > 1 || (major == 1 && minor >= 5)))
+    {
+      int i, found;
+      XRRMonitorInfo *monitors = XRRGetMonitors(display, rootwin, True, &found);
+      for (i = 0; monitors && i < found && count < max; i++)
+      {
+        rects[count].x = monitors[i].x;
+        rects[count].y = monitors[i].y;
+        rects[count].width = monitors[i].width;
+        rects[count].height = monitors[i].height;
+        count++;
+      }
+      if (monitors)
+        XRRFreeMonitors(monitors);
+    }
+  }
+#endif
+#ifdef HAVE_XINERAMA
+  if (!count && XineramaIsActive(display))
+  {
+    int i, found;
+    XineramaScreenInfo *screens = XineramaQueryScreens(display, &found);
+    for (i = 0; screens && i < found && count < max; i++)
+    {
+      rects[count].x = screens[i].x_org;
+      rects[count].y = screens[i].y_org;
+      rects[count].width = screens[i].width;
+      rects[count].height = screens[i].height;
+      count++;
+    }
+    if (screens)
+      XFree(screens);
+  }
+#endif
+  if (!count)
+  {
+    rects[0].x = rects[0].y = 0;
+    XDesktopSize(&rects[0].width, &rects[0].height);
+    count = 1;
+  }
+  return count;
+}
+
+void SetXDesktop(StarfishRef tex, const char* displayname, StarfishPoolRef pool)
+{
+  /* borrow the persistent connection if there is one */
+  int opened = !display;
+  if (!OpenXDesktop(displayname))
+    return;
   width = StarfishWidth(tex);
   height = StarfishHeight(tex);
-  mainloop(tex);
-  XCloseDisplay(display);
+  mainloop(tex, NULL, pool);
+  if (opened)
+    CloseXDesktop();
   return;
 }
+
+void SetXDesktopPixels(const pixel* pixels, int w, int h, StarfishPoolRef pool)
+{
+  if (!display)
+    return;
+  width = w;
+  height = h;
+  mainloop(NULL, pixels, pool);
+}
+
+/*
+Animation keeps one image and one target for as long as it runs, and
+stretches each frame over the target as it packs it. Frames are usually
+smaller than the target when the animation is short of time.
+*/
+#define STRETCH_ROWS 16
+
+Drawable target;
+Window animwin;
+int ownwindow;
+Pixmap animpixmap;
+Atom deletewindow;
+
+typedef struct
+{
+  const pixel *pixels;
+  int framewidth, frameheight;
+  RowPacker pack;
+} Stretch;
+
+void stretchrows(void* context, int index)
+{
+  Stretch *stretch = context;
+  int y, x, last = (index + 1) * STRETCH_ROWS;
+  pixel *row = NULL;
+  if (stretch->framewidth != width)
+  {
+    row = malloc(width * sizeof(pixel));
+    if (!row) return;
+  }
+  if (last > height)
+    last = height;
+  for (y = index * STRETCH_ROWS; y < last; y++)
+  {
+    const pixel *in = stretch->pixels +
+      (size_t) (y * stretch->frameheight / height) * stretch->framewidth;
+    if (row)
+    {
+      for (x = 0; x < width; x++)
+        row[x] = in[x * stretch->framewidth / width];
+      in = row;
+    }
+    stretch->pack(in, image, y, width);
+  }
+  free(row);
+}
+
+int beginimage(void);
+
+int BeginXAnimation(int inwindow, int w, int h)
+{
+  if (!display)
+    return 0;
+  if (inwindow)
+  {
+    width = w;
+    height = h;
+    animwin = XCreateSimpleWindow(display, rootwin, 0, 0, width, height, 0,
+                                  BlackPixel(display, screen), BlackPixel(display, screen));
+    XStoreName(display, animwin, "xstarfish");
+    deletewindow = XInternAtom(display, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(display, animwin, &deletewindow, 1);
+    XSelectInput(display, animwin, StructureNotifyMask | KeyPressMask);
+    XMapWindow(display, animwin);
+    ownwindow = 1;
+    target = animwin;
+  }
+  else
+  {
+    /* the root window shows a pixmap we keep drawing into */
+    XDesktopSize(&width, &height);
+    animpixmap = XCreatePixmap(display, rootwin, width, height, depth);
+    XSetWindowBackgroundPixmap(display, rootwin, animpixmap);
+    target = animpixmap;
+  }
+  return beginimage();
+}
+
+int beginimage(void)
+{
+  image = createimage();
+  if (!image)
+  {
+    puts("starfish: XCreateImage failed");
+    EndXAnimation();
+    return 0;
+  }
+  return 1;
+}
+
+/*
+Someone else's window, such as the one xscreensaver hands its hacks,
+may not use the default visual. Draw in whatever it does use.
+*/
+int BeginXAnimationIn(unsigned long window)
+{
+  XWindowAttributes attributes;
+  if (!display || !XGetWindowAttributes(display, window, &attributes))
+    return 0;
+  animwin = window;
+  ownwindow = 0;
+  target = animwin;
+  width = attributes.width;
+  height = attributes.height;
+  if (attributes.depth != depth || attributes.visual != visual)
+  {
+    depth = attributes.depth;
+    visual = attributes.visual;
+    gc = XCreateGC(display, animwin, 0, NULL);
+  }
+  XSelectInput(display, animwin, attributes.your_event_mask | StructureNotifyMask);
+  return beginimage();
+}
+
+int XAnimationEvents(int* w, int* h)
+{
+  XEvent event;
+  while (animwin && XPending(display))
+  {
+    XNextEvent(display, &event);
+    if (event.type == ConfigureNotify)
+    {
+      width = event.xconfigure.width;
+      height = event.xconfigure.height;
+    }
+    else if (event.type == KeyPress && XLookupKeysym(&event.xkey, 0) == XK_q)
+      return 0;
+    else if (event.type == ClientMessage && (Atom) event.xclient.data.l[0] == deletewindow)
+      return 0;
+  }
+  /* A resize can be followed by a move or a restack at the new size, so
+     only the image itself can say whether it still fits the window. */
+  if (!image || image->width != width || image->height != height)
+  {
+    if (image)
+      destroyimage();
+    image = createimage();
+    if (!image)
+      return 0;
+  }
+  *w = width;
+  *h = height;
+  return 1;
+}
+
+void ShowXFrame(const pixel* pixels, int framewidth, int frameheight, StarfishPoolRef pool)
+{
+  Stretch stretch;
+  if (!image)
+    return;
+  stretch.pixels = pixels;
+  stretch.framewidth = framewidth;
+  stretch.frameheight = frameheight;
+  stretch.pack = choosepacker(image);
+  RunStarfishTasks(pool, stretchrows, &stretch, (height + STRETCH_ROWS - 1) / STRETCH_ROWS);
+  putband(target, 0, height);
+  if (animpixmap)
+    XClearWindow(display, rootwin);
+  /* the server must be done with a shared image before we refill it */
+  XSync(display, False);
+}
+
+void EndXAnimation(void)
+{
+  if (image)
+    destroyimage();
+  if (animwin && ownwindow)
+    XDestroyWindow(display, animwin);
+  if (gc != DefaultGC(display, screen))
+  {
+    XFreeGC(display, gc);
+    gc = DefaultGC(display, screen);
+    depth = DefaultDepth(display, screen);
+    visual = DefaultVisual(display, screen);
+  }
+  if (animpixmap)
+    XFreePixmap(display, animpixmap);
+  animwin = 0;
+  animpixmap = 0;
+  XFlush(display);
+}
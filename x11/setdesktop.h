@@ -23,4 +23,48 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
-void SetXDesktop(StarfishRef tex, const char* display);
+#include "starfish-pool.h"
+
+/* render the texture and make it the root window's background */
+void SetXDesktop(StarfishRef tex, const char* display, StarfishPoolRef pool);
+
+/*
+A daemon can keep one connection to the display for its whole life.
+While it is open, SetXDesktop uses it instead of connecting again, and
+SetXDesktopPixels can put up an image that has already been rendered.
+XDesktopSize reports the default screen's size; it returns zero if the
+desktop isn't open.
+*/
+int OpenXDesktop(const char* display);
+void CloseXDesktop(void);
+int XDesktopSize(int* width, int* height);
+void SetXDesktopPixels(const pixel* pixels, int width, int height, StarfishPoolRef pool);
+
+/*
+The monitors making up the default screen, in root window coordinates.
+Fills in at most max rects and returns how many; without RandR or
+Xinerama support the whole screen counts as one monitor. The desktop
+must be open.
+*/
+typedef struct
+{
+  int x, y;
+  int width, height;
+} DesktopRect;
+
+int XDesktopMonitors(DesktopRect* rects, int max);
+
+/*
+Animation shows frame after frame on one target: a window of its own,
+w by h, or else the root window. The desktop must be open. Frames of any
+size are stretched to fill the target. XAnimationEvents deals with what
+the server has sent, reports the target's current size, and returns zero
+once the user has closed the window or pressed q.
+BeginXAnimationIn draws into a window that already exists, such as the
+one xscreensaver gives its hacks, and leaves it be afterwards.
+*/
+int BeginXAnimation(int inwindow, int w, int h);
+int BeginXAnimationIn(unsigned long window);
+int XAnimationEvents(int* w, int* h);
+void ShowXFrame(const pixel* pixels, int framewidth, int frameheight, StarfishPoolRef pool);
+void EndXAnimation(void);
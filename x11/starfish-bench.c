@@ -0,0 +1,658 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/*
+starfish-bench: times the engine on a fixed corpus of patterns.
+
+Each pattern in the corpus is made from its seed just as xstarfish -r
+makes it, at every size asked for, with edges wrapped and not, and drawn
+by every way the engine has of drawing: pixel by pixel, a tile at a time
+on one thread, and on a pool of threads, plus AltiVec where there is
+AltiVec. For each combination it reports throughput, the spread of the
+time each pattern took, the most memory the process held meanwhile, and
+a checksum of all the pixels. --json writes the results out one to a
+line; a later run given them as its --baseline compares itself with
+them, and fails if anything got slower by more than the tolerance or
+drew different pixels. A baseline from another version of the engine
+draws other pixels by design, so only its speed is compared. Nothing
+leaves the machine.
+
+With --nodes it times each kind of node instead, by itself (see
+TimeStarfishNode), over each spread of coordinates.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "starfish-engine.h"
+#include "starfish-pool.h"
+#include "starfish-render.h"
+#if BUILD_ALTIVEC
+#include "starfish-altivec.h"
+#endif
+
+#define MAX_SIZES 16
+#define MAX_LINE 1024
+#define DEFAULT_SIZES "128x128,512x384"
+#define DEFAULT_TOLERANCE 5.0	/* percent */
+#define DEFAULT_NODE_SAMPLES 262144
+
+/*
+The corpus. Never change these: every stored baseline was measured on
+them. To bench more patterns, add seeds at the end; --seeds picks how
+many of them, from the start, to use.
+*/
+static const unsigned int corpus[] =
+{
+	1, 7, 42, 99, 256, 1000, 1999, 2003, 31337, 65535, 100000, 4000000000u,
+	5, 17, 123, 777, 4096, 12345, 54321, 99999, 262144, 1234567, 7654321, 3000000000u,
+};
+#define CORPUS_SIZE ((int) (sizeof(corpus) / sizeof(corpus[0])))
+#define DEFAULT_SEEDS 12
+
+#define PATH_PIXEL 0
+#define PATH_TILES 1
+#define PATH_POOL 2
+#define PATH_ALTIVEC 3
+#define PATH_COUNT 4
+
+static const char* const pathNames[PATH_COUNT] = { "pixel", "tiles", "pool", "altivec" };
+
+#define DISTRIBUTION_COUNT 3
+static const char* const distributionNames[DISTRIBUTION_COUNT] = { "grid", "scatter", "wrapped" };
+
+typedef struct
+{
+	int width, height;
+} Size;
+
+typedef struct
+{
+	int path;
+	Size size;
+	int wrap;
+	int patterns;
+	double mpixelsPerSecond;
+	double p50, p90, p99, max;	/* milliseconds */
+	long peakRSS;			/* kilobytes */
+	unsigned long long checksum;
+} Result;
+
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+Linux keeps the most memory a process has held as VmHWM, and forgets it
+when told to through clear_refs, so each combination can have a peak of
+its own. Elsewhere there is only the peak for the whole run.
+*/
+static void ResetPeakRSS(void)
+{
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if(file)
+	{
+		fputs("5", file);
+		fclose(file);
+	}
+}
+
+static long PeakRSS(void)
+{
+	char line[256];
+	long kilobytes = -1;
+	struct rusage usage;
+	FILE* file = fopen("/proc/self/status", "r");
+	if(file)
+	{
+		while(fgets(line, sizeof(line), file))
+			if(!strncmp(line, "VmHWM:", 6)) kilobytes = strtol(line + 6, NULL, 10);
+		fclose(file);
+	}
+	if(kilobytes < 0 && !getrusage(RUSAGE_SELF, &usage)) kilobytes = usage.ru_maxrss;
+	return kilobytes;
+}
+
+static unsigned long long HashPixels(const pixel* pixels, size_t count, unsigned long long hash)
+{
+	/* FNV-1a over the colours; alpha is always opaque. */
+	size_t i;
+	for(i = 0; i < count; i++)
+	{
+		hash = (hash ^ pixels[i].red) * 1099511628211ULL;
+		hash = (hash ^ pixels[i].green) * 1099511628211ULL;
+		hash = (hash ^ pixels[i].blue) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static StarfishRef MakeCorpusPattern(unsigned int seed, Size size, int wrap, int path)
+{
+	/* the same seed as xstarfish -r and --batch */
+	srand(seed);
+#if BUILD_ALTIVEC
+	return MakeStarfish(size.width, size.height, NULL, wrap, path == PATH_ALTIVEC);
+#else
+	(void) path;
+	return MakeStarfish(size.width, size.height, NULL, wrap);
+#endif
+}
+
+static void DrawPattern(StarfishRef texture, pixel* pixels, Size size, int path, StarfishPoolRef pool)
+{
+	int x, y;
+	switch(path)
+	{
+		case PATH_PIXEL:
+			for(y = 0; y < size.height; y++)
+			{
+				pixel* row = pixels + (size_t) y * size.width;
+				for(x = 0; x < size.width; x++)
+				{
+					GetStarfishPixel(x, y, texture, &row[x]);
+					row[x].alpha = 0xFF;
+				}
+			}
+			break;
+		case PATH_TILES:
+			RenderStarfish(texture, pixels, size.width, NULL);
+			break;
+		case PATH_POOL:
+			RenderStarfish(texture, pixels, size.width, pool);
+			break;
+#if BUILD_ALTIVEC
+		case PATH_ALTIVEC:
+			for(y = 0; y < size.height; y++)
+			{
+				pixel* row = pixels + (size_t) y * size.width;
+				for(x = 0; x < size.width; x += PIXELS_PER_CALL)
+				{
+					vector unsigned char out[PIXELS_PER_CALL / 4];
+					int count = size.width - x < PIXELS_PER_CALL ? size.width - x : PIXELS_PER_CALL;
+					int i;
+					GetStarfishPixel_AV(x, y, texture, out);
+					memcpy(&row[x], out, count * sizeof(pixel));
+					for(i = 0; i < count; i++) row[x + i].alpha = 0xFF;
+				}
+			}
+			break;
+#endif
+	}
+}
+
+static int CompareTimes(const void* a, const void* b)
+{
+	double x = *(const double*) a, y = *(const double*) b;
+	return x < y ? -1 : x > y;
+}
+
+static double Percentile(const double* sorted, int count, double fraction)
+{
+	/* nearest rank */
+	int rank = (int) ceil(fraction * count);
+	if(rank < 1) rank = 1;
+	return sorted[rank - 1];
+}
+
+/*
+Bench one combination. Each pattern is timed from building its tree to
+its last pixel, the fastest of repeat tries. hashes holds a checksum for
+each seed: the first path to run fills it in, and every later one must
+match it.
+*/
+static int RunBench(Result* result, int seeds, int repeat, unsigned long long* hashes, int firstPath,
+	StarfishPoolRef pool)
+{
+	double* times = malloc(seeds * sizeof(double));
+	pixel* pixels = malloc((size_t) result->size.width * result->size.height * sizeof(pixel));
+	size_t count = (size_t) result->size.width * result->size.height;
+	double total = 0;
+	int i, try, same = 1;
+
+	if(!times || !pixels)
+	{
+		free(times);
+		free(pixels);
+		return -1;
+	}
+	ResetPeakRSS();
+	result->patterns = seeds;
+	result->checksum = 14695981039346656037ULL;
+	for(i = 0; i < seeds; i++)
+	{
+		unsigned long long hash;
+		for(try = 0; try < repeat; try++)
+		{
+			double start = Now(), spent;
+			StarfishRef texture = MakeCorpusPattern(corpus[i], result->size, result->wrap, result->path);
+			if(!texture)
+			{
+				free(times);
+				free(pixels);
+				return -1;
+			}
+			DrawPattern(texture, pixels, result->size, result->path, pool);
+			spent = Now() - start;
+			DumpStarfish(texture);
+			if(!try || spent < times[i]) times[i] = spent;
+		}
+		total += times[i];
+		hash = HashPixels(pixels, count, 14695981039346656037ULL);
+		if(firstPath) hashes[i] = hash;
+		else if(hash != hashes[i]) same = 0;
+		result->checksum = (result->checksum ^ hash) * 1099511628211ULL;
+	}
+	result->peakRSS = PeakRSS();
+	result->mpixelsPerSecond = total > 0 ? count * seeds / total / 1e6 : 0;
+	qsort(times, seeds, sizeof(double), CompareTimes);
+	result->p50 = Percentile(times, seeds, 0.5) * 1000;
+	result->p90 = Percentile(times, seeds, 0.9) * 1000;
+	result->p99 = Percentile(times, seeds, 0.99) * 1000;
+	result->max = times[seeds - 1] * 1000;
+	free(times);
+	free(pixels);
+	return same;
+}
+
+static void PrintResult(FILE* out, const Result* result)
+{
+	char size[32];
+	snprintf(size, sizeof(size), "%dx%d", result->size.width, result->size.height);
+	fprintf(out, "%-8s %-10s %-4s %9.3f %9.1f %9.1f %9.1f %9.1f %9ld  %016llx\n",
+		pathNames[result->path], size, result->wrap ? "yes" : "no",
+		result->mpixelsPerSecond, result->p50, result->p90, result->p99, result->max,
+		result->peakRSS, result->checksum);
+}
+
+static void WriteJSON(FILE* out, const Result* results, int count, int seeds, int threads)
+{
+	int i;
+	fprintf(out, "{\n\t\"starfish_bench\": 1,\n\t\"engine\": %d,\n\t\"threads\": %d,\n\t\"seeds\": [",
+		STARFISH_ENGINE_VERSION, threads);
+	for(i = 0; i < seeds; i++) fprintf(out, "%s%u", i ? ", " : "", corpus[i]);
+	fprintf(out, "],\n\t\"results\": [\n");
+	for(i = 0; i < count; i++)
+	{
+		const Result* r = &results[i];
+		fprintf(out, "\t\t{\"path\": \"%s\", \"width\": %d, \"height\": %d, \"wrap\": %s, "
+			"\"patterns\": %d, \"mpixels_per_s\": %.4f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+			"\"p99_ms\": %.3f, \"max_ms\": %.3f, \"peak_rss_kb\": %ld, \"checksum\": \"%016llx\"}%s\n",
+			pathNames[r->path], r->size.width, r->size.height, r->wrap ? "true" : "false",
+			r->patterns, r->mpixelsPerSecond, r->p50, r->p90, r->p99, r->max, r->peakRSS,
+			r->checksum, i + 1 < count ? "," : "");
+	}
+	fprintf(out, "\t]\n}\n");
+}
+
+/*
+A baseline is a file that WriteJSON wrote, so rather than parse JSON in
+general, read it a line at a time and pick the fields out of each result.
+*/
+static const char* JSONField(const char* line, const char* name)
+{
+	char key[64];
+	const char* at;
+	snprintf(key, sizeof(key), "\"%s\":", name);
+	at = strstr(line, key);
+	if(!at) return NULL;
+	at += strlen(key);
+	while(*at == ' ') at++;
+	return at;
+}
+
+static int ReadBaselineResult(const char* line, Result* result)
+{
+	const char* path = JSONField(line, "path");
+	const char* field;
+	int i;
+	if(!path || *path++ != '"') return 0;
+	result->path = -1;
+	for(i = 0; i < PATH_COUNT; i++)
+	{
+		size_t length = strlen(pathNames[i]);
+		if(!strncmp(path, pathNames[i], length) && path[length] == '"') result->path = i;
+	}
+	if(result->path < 0) return 0;
+	if(!(field = JSONField(line, "width"))) return 0;
+	result->size.width = atoi(field);
+	if(!(field = JSONField(line, "height"))) return 0;
+	result->size.height = atoi(field);
+	if(!(field = JSONField(line, "wrap"))) return 0;
+	result->wrap = !strncmp(field, "true", 4);
+	if(!(field = JSONField(line, "patterns"))) return 0;
+	result->patterns = atoi(field);
+	if(!(field = JSONField(line, "mpixels_per_s"))) return 0;
+	result->mpixelsPerSecond = strtod(field, NULL);
+	if(!(field = JSONField(line, "checksum")) || *field != '"') return 0;
+	result->checksum = strtoull(field + 1, NULL, 16);
+	return 1;
+}
+
+static int CompareWithBaseline(FILE* out, const char* name, const Result* results, int count, double tolerance)
+{
+	char line[MAX_LINE];
+	int failures = 0, matched = 0, engine = STARFISH_ENGINE_VERSION, i;
+	FILE* file = fopen(name, "r");
+	if(!file)
+	{
+		fprintf(stderr, "starfish-bench: could not open baseline %s\n", name);
+		return 1;
+	}
+	fprintf(out, "\ncompared with %s, %.1f%% tolerance:\n", name, tolerance);
+	while(fgets(line, sizeof(line), file))
+	{
+		Result old;
+		const char* field = JSONField(line, "engine");
+		if(field)
+		{
+			engine = atoi(field);
+			if(engine != STARFISH_ENGINE_VERSION)
+				fprintf(out, "the baseline is from engine %d and this is engine %d, whose pixels\n"
+					"are meant to differ: comparing speed only\n", engine, STARFISH_ENGINE_VERSION);
+			continue;
+		}
+		if(!ReadBaselineResult(line, &old)) continue;
+		for(i = 0; i < count; i++)
+		{
+			const Result* now = &results[i];
+			double change;
+			const char* verdict = "";
+			char size[32];
+			if(now->path != old.path || now->wrap != old.wrap || now->size.width != old.size.width
+				|| now->size.height != old.size.height || now->patterns != old.patterns) continue;
+			matched++;
+			change = old.mpixelsPerSecond > 0 ?
+				100.0 * (now->mpixelsPerSecond - old.mpixelsPerSecond) / old.mpixelsPerSecond : 0;
+			if(change < -tolerance)
+			{
+				verdict = "  SLOWER";
+				failures++;
+			}
+			else if(change > tolerance) verdict = "  faster";
+			if(engine == STARFISH_ENGINE_VERSION && now->checksum != old.checksum)
+			{
+				verdict = "  DIFFERENT PIXELS";
+				failures++;
+			}
+			snprintf(size, sizeof(size), "%dx%d", now->size.width, now->size.height);
+			fprintf(out, "%-8s %-10s %-4s %9.3f was %9.3f %+7.1f%%%s\n",
+				pathNames[now->path], size, now->wrap ? "yes" : "no",
+				now->mpixelsPerSecond, old.mpixelsPerSecond, change, verdict);
+		}
+	}
+	fclose(file);
+	if(!matched) fprintf(out, "nothing in the baseline was measured the same way\n");
+	return failures;
+}
+
+static int ParseSizes(const char* text, Size* sizes)
+{
+	int count = 0;
+	while(*text && count < MAX_SIZES)
+	{
+		char* end;
+		sizes[count].width = (int) strtol(text, &end, 10);
+		if(*end != 'x') return 0;
+		sizes[count].height = (int) strtol(end + 1, &end, 10);
+		if(sizes[count].width <= 0 || sizes[count].height <= 0) return 0;
+		count++;
+		if(*end == ',') end++;
+		else if(*end) return 0;
+		text = end;
+	}
+	return count;
+}
+
+static int ParsePaths(const char* text, int* paths)
+{
+	int count = 0, i;
+	while(*text)
+	{
+		size_t length = strcspn(text, ",");
+		for(i = 0; i < PATH_COUNT; i++)
+			if(strlen(pathNames[i]) == length && !strncmp(text, pathNames[i], length)) break;
+#if !BUILD_ALTIVEC
+		if(i == PATH_ALTIVEC) i = PATH_COUNT;
+#endif
+		if(i == PATH_COUNT) return 0;
+		paths[count++] = i;
+		text += length;
+		if(*text == ',') text++;
+	}
+	return count;
+}
+
+/*
+Time every kind of node, scalar and then (with AltiVec) vector, over every
+spread of coordinates.
+*/
+static int BenchNodes(FILE* out, FILE* json, int samples)
+{
+	int kinds = StarfishNodeKinds();
+	int vector, kind, d, first = 1;
+	fprintf(out, "%-18s %-6s", "node", "path");
+	for(d = 0; d < DISTRIBUTION_COUNT; d++)
+		fprintf(out, " %8s ns %9s", distributionNames[d], "samples/c");
+	fprintf(out, "\n");
+	if(json) fprintf(json, "{\n\t\"starfish_bench\": 1,\n\t\"engine\": %d,\n\t\"nodes\": [\n",
+		STARFISH_ENGINE_VERSION);
+	for(vector = 0; vector < 2; vector++)
+	{
+		for(kind = 0; kind < kinds; kind++)
+		{
+			double nanoseconds[DISTRIBUTION_COUNT], cycles[DISTRIBUTION_COUNT];
+			for(d = 0; d < DISTRIBUTION_COUNT; d++)
+				if(!TimeStarfishNode(kind, d, samples, vector, &nanoseconds[d], &cycles[d])) break;
+			/* No vector path, on anything but AltiVec. */
+			if(d < DISTRIBUTION_COUNT) break;
+			fprintf(out, "%-18s %-6s", StarfishNodeName(kind), vector ? "vector" : "scalar");
+			for(d = 0; d < DISTRIBUTION_COUNT; d++)
+			{
+				fprintf(out, " %11.2f %9.4f", nanoseconds[d], cycles[d] > 0 ? 1 / cycles[d] : 0);
+				if(json) fprintf(json, "%s\t\t{\"node\": \"%s\", \"path\": \"%s\", \"distribution\": \"%s\", "
+					"\"ns_per_sample\": %.4f, \"samples_per_cycle\": %.6f}",
+					first ? "" : ",\n", StarfishNodeName(kind), vector ? "vector" : "scalar",
+					distributionNames[d], nanoseconds[d], cycles[d] > 0 ? 1 / cycles[d] : 0);
+				first = 0;
+			}
+			fprintf(out, "\n");
+			fflush(out);
+		}
+	}
+	if(json) fprintf(json, "\n\t]\n}\n");
+	return 0;
+}
+
+static void usage(void)
+{
+	puts(
+		"starfish-bench: times the engine on a fixed corpus of patterns.\n"
+		"Usage: starfish-bench [options...]\n"
+		"-j,--threads:	threads for the pool path, one per processor by default.\n"
+		"--sizes:	the sizes to draw at, " DEFAULT_SIZES " by default.\n"
+		"--seeds:	how many of the corpus's patterns to draw, 12 by default\n"
+		"		and at most 24.\n"
+		"--paths:	which ways of drawing to time, from pixel, tiles, pool\n"
+		"		and altivec; all of them there are by default.\n"
+		"--wrap:	on, off, or both, the default.\n"
+		"--repeat:	draw each pattern this many times and keep the fastest.\n"
+		"--json:	write the results to this file, or - for standard output.\n"
+		"--baseline:	a file written by --json to compare with. Anything\n"
+		"		slower by more than the tolerance, or with different\n"
+		"		pixels, makes starfish-bench fail; pixels are only\n"
+		"		compared with a baseline from the same engine.\n"
+		"--tolerance:	percent, 5 by default.\n"
+		"--nodes:	time each kind of node by itself instead, in ns per\n"
+		"		sample and samples per time-stamp counter cycle.\n"
+		"--node-samples:	how many samples to time each node on, 262144 by\n"
+		"		default.\n"
+		);
+}
+
+int main(int argc, char* argv[])
+{
+	Size sizes[MAX_SIZES];
+	int paths[PATH_COUNT];
+	int sizeCount, pathCount = 0;
+	int threads = 0, seeds = DEFAULT_SEEDS, repeat = 1;
+	int wrapFirst = 0, wrapLast = 1;
+	const char* jsonName = NULL;
+	const char* baselineName = NULL;
+	double tolerance = DEFAULT_TOLERANCE;
+	int nodes = 0, nodeSamples = DEFAULT_NODE_SAMPLES;
+	unsigned long long hashes[CORPUS_SIZE];
+	Result* results;
+	int resultCount = 0, failures = 0;
+	StarfishPoolRef pool;
+	FILE* out = stdout;
+	int ctr, s, w, p;
+
+	sizeCount = ParseSizes(DEFAULT_SIZES, sizes);
+	for(ctr = 1; ctr < argc; ctr++)
+	{
+		if((!strcmp(argv[ctr], "-j") || !strcmp(argv[ctr], "--threads")) && ctr + 1 < argc)
+			threads = atoi(argv[++ctr]);
+		else if(!strcmp(argv[ctr], "--sizes") && ctr + 1 < argc)
+			sizeCount = ParseSizes(argv[++ctr], sizes);
+		else if(!strcmp(argv[ctr], "--seeds") && ctr + 1 < argc)
+			seeds = atoi(argv[++ctr]);
+		else if(!strcmp(argv[ctr], "--paths") && ctr + 1 < argc)
+			pathCount = ParsePaths(argv[++ctr], paths);
+		else if(!strcmp(argv[ctr], "--wrap") && ctr + 1 < argc)
+		{
+			ctr++;
+			wrapFirst = !strcmp(argv[ctr], "on");
+			wrapLast = strcmp(argv[ctr], "off") != 0;
+		}
+		else if(!strcmp(argv[ctr], "--repeat") && ctr + 1 < argc)
+			repeat = atoi(argv[++ctr]);
+		else if(!strcmp(argv[ctr], "--json") && ctr + 1 < argc)
+			jsonName = argv[++ctr];
+		else if(!strcmp(argv[ctr], "--baseline") && ctr + 1 < argc)
+			baselineName = argv[++ctr];
+		else if(!strcmp(argv[ctr], "--tolerance") && ctr + 1 < argc)
+			tolerance = atof(argv[++ctr]);
+		else if(!strcmp(argv[ctr], "--nodes"))
+			nodes = 1;
+		else if(!strcmp(argv[ctr], "--node-samples") && ctr + 1 < argc)
+			nodeSamples = atoi(argv[++ctr]);
+		else
+		{
+			usage();
+			return !(!strcmp(argv[ctr], "-h") || !strcmp(argv[ctr], "--help"));
+		}
+	}
+	/* With the JSON on standard output, the table goes to the side. */
+	if(jsonName && !strcmp(jsonName, "-")) out = stderr;
+	if(nodes)
+	{
+		FILE* json = NULL;
+		int failed;
+		if(jsonName) json = strcmp(jsonName, "-") ? fopen(jsonName, "w") : stdout;
+		if(jsonName && !json)
+		{
+			fprintf(stderr, "starfish-bench: could not write %s\n", jsonName);
+			return 1;
+		}
+		failed = BenchNodes(out, json, nodeSamples);
+		if(json && json != stdout && fclose(json)) failed = 1;
+		return failed;
+	}
+	if(!pathCount)
+	{
+		paths[pathCount++] = PATH_PIXEL;
+		paths[pathCount++] = PATH_TILES;
+		paths[pathCount++] = PATH_POOL;
+#if BUILD_ALTIVEC
+		paths[pathCount++] = PATH_ALTIVEC;
+#endif
+	}
+	if(!sizeCount || !pathCount || seeds < 1 || seeds > CORPUS_SIZE || repeat < 1)
+	{
+		usage();
+		return 1;
+	}
+	results = calloc(sizeCount * 2 * pathCount, sizeof(Result));
+	if(!results) return 1;
+
+	pool = MakeStarfishPool(threads);
+	fprintf(out, "%d patterns, pool of %d threads\n", seeds, StarfishPoolThreads(pool));
+	fprintf(out, "%-8s %-10s %-4s %9s %9s %9s %9s %9s %9s  %s\n", "path", "size", "wrap",
+		"Mpixels/s", "p50 ms", "p90 ms", "p99 ms", "max ms", "peak KB", "checksum");
+	for(s = 0; s < sizeCount; s++)
+	{
+		for(w = wrapFirst; w <= wrapLast; w++)
+		{
+			for(p = 0; p < pathCount; p++)
+			{
+				Result* result = &results[resultCount];
+				int same;
+				result->path = paths[p];
+				result->size = sizes[s];
+				result->wrap = w;
+				same = RunBench(result, seeds, repeat, hashes, p == 0, pool);
+				if(same < 0)
+				{
+					fprintf(stderr, "starfish-bench: could not draw at %dx%d\n",
+						sizes[s].width, sizes[s].height);
+					failures++;
+					continue;
+				}
+				PrintResult(out, result);
+				fflush(out);
+				if(!same)
+				{
+					fprintf(out, "%s drew different pixels from %s\n",
+						pathNames[paths[p]], pathNames[paths[0]]);
+					failures++;
+				}
+				resultCount++;
+			}
+		}
+	}
+	if(jsonName)
+	{
+		FILE* json = strcmp(jsonName, "-") ? fopen(jsonName, "w") : stdout;
+		if(json)
+		{
+			WriteJSON(json, results, resultCount, seeds, StarfishPoolThreads(pool));
+			if(json != stdout && fclose(json)) json = NULL;
+		}
+		if(!json)
+		{
+			fprintf(stderr, "starfish-bench: could not write %s\n", jsonName);
+			failures++;
+		}
+	}
+	if(baselineName) failures += CompareWithBaseline(out, baselineName, results, resultCount, tolerance);
+	DumpStarfishPool(pool);
+	free(results);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,501 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/*
+starfish-diff: checks every way the engine has of drawing a pattern
+against the plainest one.
+
+The reference is GetStarfishPixel, asked for each pixel in turn. Each
+seed is made into a pattern as xstarfish -r makes it, drawn that way,
+and then drawn again by every backend, and the two are compared channel
+by channel. Backends that promise the same pixels as GetStarfishPixel
+(rendering a rectangle, tiles, the pool, progressive passes, a render
+job, and a pattern reloaded from its genome in either form) must match
+it exactly; the others, sampling by resolution-independent coordinates
+and AltiVec, only have to come within a tolerance, of both the largest
+error in any channel and the signal to noise ratio. For each backend it
+reports the largest and mean channel error and the worst and mean PSNR.
+When a pattern fails, it writes a PNG of the reference, the backend's
+pixels and their difference, magnified, side by side.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "starfish-engine.h"
+#include "starfish-pool.h"
+#include "starfish-render.h"
+#include "makepng.h"
+#if BUILD_ALTIVEC
+#include "starfish-altivec.h"
+#endif
+
+#define DEFAULT_SEEDS 1000
+#define DEFAULT_SIZE 64
+#define DEFAULT_SAVED 20
+#define DIFF_GAIN 16	/* how much to magnify differences in a saved image */
+
+#define BACKEND_RECT 0
+#define BACKEND_TILES 1
+#define BACKEND_POOL 2
+#define BACKEND_PROGRESSIVE 3
+#define BACKEND_JOB 4
+#define BACKEND_BINARY 5
+#define BACKEND_TEXT 6
+#define BACKEND_SAMPLE 7
+#define BACKEND_ALTIVEC 8
+#define BACKEND_COUNT 9
+
+typedef struct
+{
+	const char* name;
+	int maxError;		/* in any channel; zero for bit-exact */
+	double minPSNR;		/* decibels; ignored when bit-exact */
+} Backend;
+
+/*
+What each backend promises. Sampling at x/w, y/h works out the same
+coordinates as GetStarfishPixel, so it is exact too; AltiVec does all
+of its arithmetic its own way.
+*/
+static Backend backends[BACKEND_COUNT] =
+{
+	{ "rect", 0, 0 },
+	{ "tiles", 0, 0 },
+	{ "pool", 0, 0 },
+	{ "progressive", 0, 0 },
+	{ "job", 0, 0 },
+	{ "binary", 0, 0 },
+	{ "text", 0, 0 },
+	{ "sample", 0, 0 },
+	{ "altivec", 16, 30 },
+};
+
+typedef struct
+{
+	int patterns;
+	int failures;
+	int maxError;
+	double errorSum;	/* of every channel's error, for the mean */
+	double channels;
+	double worstPSNR;
+	double psnrSum;		/* of the finite ones */
+	int psnrCount;
+} Tally;
+
+typedef struct
+{
+	int maxError;
+	double meanError;
+	double psnr;		/* HUGE_VAL when the pixels are the same */
+} Difference;
+
+static StarfishRef MakeSeedPattern(unsigned int seed, int width, int height, int wrap, int altivec)
+{
+	/* the same seed as xstarfish -r and --batch */
+	srand(seed);
+#if BUILD_ALTIVEC
+	return MakeStarfish(width, height, NULL, wrap, altivec);
+#else
+	(void) altivec;
+	return MakeStarfish(width, height, NULL, wrap);
+#endif
+}
+
+static void DrawReference(StarfishRef texture, pixel* pixels, int width, int height)
+{
+	int x, y;
+	for(y = 0; y < height; y++)
+	{
+		for(x = 0; x < width; x++)
+		{
+			GetStarfishPixel(x, y, texture, &pixels[y * width + x]);
+			pixels[y * width + x].alpha = 0xFF;
+		}
+	}
+}
+
+static StarfishRef ReloadPattern(StarfishRef texture, int format)
+{
+	long length = SaveStarfish(texture, format, NULL, 0);
+	StarfishRef loaded = NULL;
+	char* genome;
+	if(length < 0) return NULL;
+	/* room for the text form's terminator */
+	genome = malloc(length + 1);
+	if(!genome) return NULL;
+	SaveStarfish(texture, format, genome, length + 1);
+	loaded = LoadStarfish(genome, length, StarfishWidth(texture), StarfishHeight(texture));
+	free(genome);
+	return loaded;
+}
+
+/*
+Draw the pattern through one backend. Most of them draw the texture they
+are given; the rest make their own from it or from its seed. Returns zero
+if the backend could not draw at all.
+*/
+static int DrawBackend(int backend, StarfishRef texture, unsigned int seed, int wrap,
+	pixel* pixels, int width, int height, StarfishPoolRef pool)
+{
+	StarfishRef other;
+	StarfishJobRef job;
+	int x, y;
+	switch(backend)
+	{
+		case BACKEND_RECT:
+			RenderStarfishRect(texture, pixels, width, 0, 0, width, height);
+			return 1;
+		case BACKEND_TILES:
+			RenderStarfish(texture, pixels, width, NULL);
+			return 1;
+		case BACKEND_POOL:
+			RenderStarfish(texture, pixels, width, pool);
+			return 1;
+		case BACKEND_PROGRESSIVE:
+			return RenderStarfishProgressive(texture, pixels, width, pool, NULL, NULL);
+		case BACKEND_JOB:
+			job = MakeStarfishJob(texture, pixels, width);
+			if(!job) return 0;
+			/* in small slices, so that the job stops and starts */
+			while(!RenderStarfishFor(job, 1, pool))
+				;
+			DumpStarfishJob(job);
+			return 1;
+		case BACKEND_BINARY:
+		case BACKEND_TEXT:
+			other = ReloadPattern(texture,
+				backend == BACKEND_TEXT ? STARFISH_GENOME_TEXT : STARFISH_GENOME_BINARY);
+			if(!other) return 0;
+			DrawReference(other, pixels, width, height);
+			DumpStarfish(other);
+			return 1;
+		case BACKEND_SAMPLE:
+			for(y = 0; y < height; y++)
+			{
+				for(x = 0; x < width; x++)
+				{
+					GetStarfishSample((double) x / width, (double) y / height, texture,
+						&pixels[y * width + x]);
+					pixels[y * width + x].alpha = 0xFF;
+				}
+			}
+			return 1;
+#if BUILD_ALTIVEC
+		case BACKEND_ALTIVEC:
+			other = MakeSeedPattern(seed, width, height, wrap, 1);
+			if(!other) return 0;
+			for(y = 0; y < height; y++)
+			{
+				pixel* row = pixels + y * width;
+				for(x = 0; x < width; x += PIXELS_PER_CALL)
+				{
+					vector unsigned char out[PIXELS_PER_CALL / 4];
+					int count = width - x < PIXELS_PER_CALL ? width - x : PIXELS_PER_CALL;
+					int i;
+					GetStarfishPixel_AV(x, y, other, out);
+					memcpy(&row[x], out, count * sizeof(pixel));
+					for(i = 0; i < count; i++) row[x + i].alpha = 0xFF;
+				}
+			}
+			DumpStarfish(other);
+			return 1;
+#endif
+	}
+	(void) seed;
+	(void) wrap;
+	return 0;
+}
+
+static void Compare(const pixel* reference, const pixel* pixels, int count, Difference* difference)
+{
+	double squares = 0, sum = 0;
+	int i, c;
+	difference->maxError = 0;
+	for(i = 0; i < count; i++)
+	{
+		int errors[3];
+		errors[0] = abs(reference[i].red - pixels[i].red);
+		errors[1] = abs(reference[i].green - pixels[i].green);
+		errors[2] = abs(reference[i].blue - pixels[i].blue);
+		for(c = 0; c < 3; c++)
+		{
+			if(errors[c] > difference->maxError) difference->maxError = errors[c];
+			sum += errors[c];
+			squares += (double) errors[c] * errors[c];
+		}
+	}
+	difference->meanError = sum / (3.0 * count);
+	squares /= 3.0 * count;
+	difference->psnr = squares > 0 ? 10 * log10(255.0 * 255.0 / squares) : HUGE_VAL;
+}
+
+static int Acceptable(const Backend* backend, const Difference* difference)
+{
+	if(difference->maxError > backend->maxError) return 0;
+	return !backend->maxError || difference->psnr >= backend->minPSNR;
+}
+
+static void Tell(Tally* tally, const Difference* difference, int failed)
+{
+	tally->patterns++;
+	if(failed) tally->failures++;
+	if(difference->maxError > tally->maxError) tally->maxError = difference->maxError;
+	tally->errorSum += difference->meanError;
+	if(difference->psnr < tally->worstPSNR) tally->worstPSNR = difference->psnr;
+	if(difference->psnr != HUGE_VAL)
+	{
+		tally->psnrSum += difference->psnr;
+		tally->psnrCount++;
+	}
+}
+
+/*
+Save the reference, the backend's pixels and the difference between
+them side by side, so that it is plain where they part company.
+*/
+static int SaveDifference(const char* directory, unsigned int seed, int wrap, const char* backend,
+	const pixel* reference, const pixel* pixels, int width, int height)
+{
+	char name[1024];
+	pixel* strip = malloc((size_t) width * 3 * height * sizeof(pixel));
+	int x, y, saved;
+	if(!strip) return 0;
+	for(y = 0; y < height; y++)
+	{
+		pixel* row = strip + (size_t) y * width * 3;
+		for(x = 0; x < width; x++)
+		{
+			const pixel* a = &reference[y * width + x];
+			const pixel* b = &pixels[y * width + x];
+			int red = abs(a->red - b->red) * DIFF_GAIN;
+			int green = abs(a->green - b->green) * DIFF_GAIN;
+			int blue = abs(a->blue - b->blue) * DIFF_GAIN;
+			row[x] = *a;
+			row[width + x] = *b;
+			row[width * 2 + x].red = red > 255 ? 255 : red;
+			row[width * 2 + x].green = green > 255 ? 255 : green;
+			row[width * 2 + x].blue = blue > 255 ? 255 : blue;
+			row[width * 2 + x].alpha = 0xFF;
+		}
+	}
+	snprintf(name, sizeof(name), "%s/diff-%u-%s%s.png", directory, seed, backend, wrap ? "-wrap" : "");
+	saved = WritePNGFile(name, strip, width * 3, height, width * 3);
+	if(saved) printf("saved %s\n", name);
+	else fprintf(stderr, "starfish-diff: could not write %s\n", name);
+	free(strip);
+	return saved;
+}
+
+static int ParseBackends(const char* text, int* chosen)
+{
+	int count = 0, i;
+	while(*text)
+	{
+		size_t length = strcspn(text, ",");
+		for(i = 0; i < BACKEND_COUNT; i++)
+			if(strlen(backends[i].name) == length && !strncmp(text, backends[i].name, length)) break;
+#if !BUILD_ALTIVEC
+		if(i == BACKEND_ALTIVEC) i = BACKEND_COUNT;
+#endif
+		if(i == BACKEND_COUNT) return 0;
+		chosen[count++] = i;
+		text += length;
+		if(*text == ',') text++;
+	}
+	return count;
+}
+
+/* NAME=ERROR or NAME=ERROR/PSNR */
+static int ParseTolerance(const char* text)
+{
+	size_t length = strcspn(text, "=");
+	char* end;
+	int i;
+	if(text[length] != '=') return 0;
+	for(i = 0; i < BACKEND_COUNT; i++)
+		if(strlen(backends[i].name) == length && !strncmp(text, backends[i].name, length)) break;
+	if(i == BACKEND_COUNT) return 0;
+	backends[i].maxError = (int) strtol(text + length + 1, &end, 10);
+	if(*end == '/') backends[i].minPSNR = strtod(end + 1, &end);
+	return !*end && backends[i].maxError >= 0;
+}
+
+static void usage(void)
+{
+	puts(
+		"starfish-diff: checks every way of drawing a pattern against GetStarfishPixel.\n"
+		"Usage: starfish-diff [options...]\n"
+		"--seeds:	how many patterns to check, 1000 by default.\n"
+		"--first:	the seed to start from, 1 by default.\n"
+		"--size:	the size to draw at, 64x64 by default.\n"
+		"--backends:	which to check, from rect, tiles, pool, progressive,\n"
+		"		job, binary, text, sample and altivec; all of them\n"
+		"		there are by default.\n"
+		"--wrap:	on, off, or both, the default.\n"
+		"--tolerance:	NAME=ERROR or NAME=ERROR/PSNR, to allow a backend\n"
+		"		that much error in any channel, and no worse a PSNR in\n"
+		"		decibels. ERROR 0 means bit-exact.\n"
+		"--save:	the directory to write a failing pattern's differences\n"
+		"		to, the current one by default.\n"
+		"--keep:	write at most this many, 20 by default; 0 for none.\n"
+		"-j,--threads:	threads for the pool, one per processor by default.\n"
+		);
+}
+
+int main(int argc, char* argv[])
+{
+	int chosen[BACKEND_COUNT];
+	Tally tallies[BACKEND_COUNT];
+	int chosenCount = 0;
+	int seeds = DEFAULT_SEEDS, width = DEFAULT_SIZE, height = DEFAULT_SIZE;
+	unsigned int first = 1;
+	int wrapFirst = 0, wrapLast = 1;
+	int threads = 0, keep = DEFAULT_SAVED, saved = 0, failures = 0;
+	const char* directory = ".";
+	pixel *reference, *pixels;
+	StarfishPoolRef pool;
+	int ctr, i, b, w;
+
+	for(ctr = 1; ctr < argc; ctr++)
+	{
+		if(!strcmp(argv[ctr], "--seeds") && ctr + 1 < argc)
+			seeds = atoi(argv[++ctr]);
+		else if(!strcmp(argv[ctr], "--first") && ctr + 1 < argc)
+			first = (unsigned int) strtoul(argv[++ctr], NULL, 10);
+		else if(!strcmp(argv[ctr], "--size") && ctr + 1 < argc)
+		{
+			if(sscanf(argv[++ctr], "%dx%d", &width, &height) != 2) width = 0;
+		}
+		else if(!strcmp(argv[ctr], "--backends") && ctr + 1 < argc)
+		{
+			chosenCount = ParseBackends(argv[++ctr], chosen);
+			if(!chosenCount) width = 0;
+		}
+		else if(!strcmp(argv[ctr], "--wrap") && ctr + 1 < argc)
+		{
+			ctr++;
+			wrapFirst = !strcmp(argv[ctr], "on");
+			wrapLast = strcmp(argv[ctr], "off") != 0;
+		}
+		else if(!strcmp(argv[ctr], "--tolerance") && ctr + 1 < argc)
+		{
+			if(!ParseTolerance(argv[++ctr])) width = 0;
+		}
+		else if(!strcmp(argv[ctr], "--save") && ctr + 1 < argc)
+			directory = argv[++ctr];
+		else if(!strcmp(argv[ctr], "--keep") && ctr + 1 < argc)
+			keep = atoi(argv[++ctr]);
+		else if((!strcmp(argv[ctr], "-j") || !strcmp(argv[ctr], "--threads")) && ctr + 1 < argc)
+			threads = atoi(argv[++ctr]);
+		else
+		{
+			usage();
+			return !(!strcmp(argv[ctr], "-h") || !strcmp(argv[ctr], "--help"));
+		}
+	}
+	if(!chosenCount)
+	{
+		for(b = 0; b < BACKEND_COUNT; b++)
+		{
+#if !BUILD_ALTIVEC
+			if(b == BACKEND_ALTIVEC) continue;
+#endif
+			chosen[chosenCount++] = b;
+		}
+	}
+	if(seeds < 1 || width <= 0 || height <= 0)
+	{
+		usage();
+		return 1;
+	}
+	reference = malloc((size_t) width * height * sizeof(pixel));
+	pixels = malloc((size_t) width * height * sizeof(pixel));
+	if(!reference || !pixels) return 1;
+	memset(tallies, 0, sizeof(tallies));
+	for(b = 0; b < BACKEND_COUNT; b++) tallies[b].worstPSNR = HUGE_VAL;
+
+	pool = MakeStarfishPool(threads);
+	for(i = 0; i < seeds; i++)
+	{
+		unsigned int seed = first + i;
+		for(w = wrapFirst; w <= wrapLast; w++)
+		{
+			StarfishRef texture = MakeSeedPattern(seed, width, height, w, 0);
+			if(!texture)
+			{
+				fprintf(stderr, "starfish-diff: could not make pattern %u\n", seed);
+				failures++;
+				continue;
+			}
+			DrawReference(texture, reference, width, height);
+			for(b = 0; b < chosenCount; b++)
+			{
+				const Backend* backend = &backends[chosen[b]];
+				Difference difference;
+				int failed;
+				memset(pixels, 0, (size_t) width * height * sizeof(pixel));
+				if(!DrawBackend(chosen[b], texture, seed, w, pixels, width, height, pool))
+				{
+					/* Nothing drawn is as different as it gets. */
+					difference.maxError = 255;
+					difference.meanError = 255;
+					difference.psnr = 0;
+				}
+				else Compare(reference, pixels, width * height, &difference);
+				failed = !Acceptable(backend, &difference);
+				Tell(&tallies[chosen[b]], &difference, failed);
+				if(!failed) continue;
+				printf("seed %u%s: %s differs by up to %d, PSNR %.1f dB\n", seed, w ? " wrapped" : "",
+					backend->name, difference.maxError, difference.psnr);
+				if(saved < keep && SaveDifference(directory, seed, w, backend->name,
+					reference, pixels, width, height)) saved++;
+			}
+			DumpStarfish(texture);
+		}
+	}
+
+	printf("%u to %u at %dx%d\n", first, first + seeds - 1, width, height);
+	printf("%-12s %9s %9s %9s %10s %9s %9s %9s\n", "backend", "patterns", "failed", "max err",
+		"mean err", "worst dB", "mean dB", "allowed");
+	for(b = 0; b < chosenCount; b++)
+	{
+		const Backend* backend = &backends[chosen[b]];
+		const Tally* tally = &tallies[chosen[b]];
+		char allowed[32];
+		if(backend->maxError) snprintf(allowed, sizeof(allowed), "%d/%.0f", backend->maxError, backend->minPSNR);
+		else snprintf(allowed, sizeof(allowed), "exact");
+		printf("%-12s %9d %9d %9d %10.4f ", backend->name, tally->patterns, tally->failures,
+			tally->maxError, tally->patterns ? tally->errorSum / tally->patterns : 0.0);
+		if(tally->worstPSNR == HUGE_VAL) printf("%9s %9s", "same", "same");
+		else printf("%9.1f %9.1f", tally->worstPSNR,
+			tally->psnrCount ? tally->psnrSum / tally->psnrCount : 0.0);
+		printf(" %9s\n", allowed);
+		failures += tally->failures;
+	}
+	DumpStarfishPool(pool);
+	free(reference);
+	free(pixels);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "starfish-service.h"
+
+int StarfishServicePath(char* path, size_t size)
+{
+	const char* runtime = getenv("XDG_RUNTIME_DIR");
+	int length;
+	if(runtime && *runtime) length = snprintf(path, size, "%s/starfishd.sock", runtime);
+	else length = snprintf(path, size, "/tmp/starfishd-%u.sock", (unsigned int) getuid());
+	return length > 0 && (size_t) length < size;
+}
+
+int ConnectStarfishService(const char* path)
+{
+	struct sockaddr_un address;
+	int connection;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(path)
+	{
+		if(strlen(path) >= sizeof(address.sun_path)) return -1;
+		strcpy(address.sun_path, path);
+	}
+	else if(!StarfishServicePath(address.sun_path, sizeof(address.sun_path))) return -1;
+	connection = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(connection < 0) return -1;
+	if(connect(connection, (struct sockaddr*) &address, sizeof(address)))
+	{
+		close(connection);
+		return -1;
+	}
+	return connection;
+}
+
+void InitStarfishRequest(StarfishRequest* request, unsigned int seed, int width, int height,
+	int wrapEdges, int format)
+{
+	/* the daemon compares requests byte for byte, padding and all */
+	memset(request, 0, sizeof(*request));
+	request->magic = STARFISHD_MAGIC;
+	request->priority = STARFISHD_INTERACTIVE;
+	request->seed = seed;
+	request->width = width;
+	request->height = height;
+	request->wrapEdges = wrapEdges != 0;
+	request->format = format;
+}
+
+int RequestStarfish(int connection, const StarfishRequest* request, StarfishReply* reply)
+{
+	struct msghdr message;
+	struct iovec part;
+	union
+	{
+		struct cmsghdr header;
+		char space[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr* header;
+	const char* out = (const char*) request;
+	size_t sent = 0;
+	ssize_t got;
+	int fd = -1;
+
+	memset(reply, 0, sizeof(*reply));
+	reply->status = EPROTO;
+	while(sent < sizeof(*request))
+	{
+		ssize_t wrote = send(connection, out + sent, sizeof(*request) - sent, MSG_NOSIGNAL);
+		if(wrote < 0 && errno == EINTR) continue;
+		if(wrote <= 0)
+		{
+			reply->status = errno ? errno : EPIPE;
+			return -1;
+		}
+		sent += wrote;
+	}
+
+	/* the descriptor rides along with the reply's first byte */
+	memset(&message, 0, sizeof(message));
+	part.iov_base = reply;
+	part.iov_len = sizeof(*reply);
+	message.msg_iov = &part;
+	message.msg_iovlen = 1;
+	message.msg_control = control.space;
+	message.msg_controllen = sizeof(control.space);
+	do got = recvmsg(connection, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+	while(got < 0 && errno == EINTR);
+	for(header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+	{
+		if(header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+			memcpy(&fd, CMSG_DATA(header), sizeof(int));
+	}
+	if(got != sizeof(*reply) || reply->magic != STARFISHD_MAGIC || reply->tag != request->tag)
+	{
+		if(fd >= 0) close(fd);
+		reply->status = EPROTO;
+		return -1;
+	}
+	if(reply->status && fd >= 0)
+	{
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
@@ -0,0 +1,106 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "starfish-engine.h"
+
+/*
+starfishd renders patterns for any number of local clients on one
+shared pool. A client connects to the daemon's Unix socket and sends
+StarfishRequests; for each one the daemon sends back a StarfishReply
+carrying the result in a file descriptor (SCM_RIGHTS), so the image
+itself never goes through the socket. The descriptor is sealed against
+writing and may be shared with other clients that asked for the same
+pattern, so read it with mmap or pread, never read.
+
+A request is built with the seed, size and wrap that `xstarfish -r`
+would use, and the same pattern comes back. colourCount zero means the
+seed picks the palette, as it does for xstarfish.
+
+Everything is in the host's byte order: the socket never leaves the
+machine.
+*/
+
+#define STARFISHD_MAGIC 0x53465331	/* "SFS1" */
+
+#define STARFISHD_RGBA 0	/* width * height pixels, rows top to bottom */
+#define STARFISHD_PNG 1		/* a png file */
+
+/*
+Someone waiting to see the result should ask for STARFISHD_INTERACTIVE,
+which is served ahead of STARFISHD_BATCH work, tile by tile. Asking for
+a pattern that is already queued as batch work hurries it along.
+*/
+#define STARFISHD_BATCH 0
+#define STARFISHD_INTERACTIVE 1
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t tag;		/* comes back in the reply, to match them up */
+	uint32_t priority;
+	/* everything from here on identifies the pattern */
+	uint32_t seed;
+	int32_t width, height;
+	uint32_t wrapEdges;
+	uint32_t format;
+	int32_t colourCount;
+	pixel colours[MAX_PALETTE_ENTRIES];
+} StarfishRequest;
+
+/* where the part of a request that identifies a pattern starts */
+#define STARFISHD_KEY_OFFSET offsetof(StarfishRequest, seed)
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t tag;
+	int32_t status;		/* zero, or an errno value */
+	int32_t width, height;
+	uint32_t format;
+	uint64_t size;		/* bytes in the file descriptor's contents */
+} StarfishReply;
+
+/*
+The socket lives in $XDG_RUNTIME_DIR, or failing that in /tmp under the
+user's id. Returns zero if the path doesn't fit.
+*/
+int StarfishServicePath(char* path, size_t size);
+
+/*
+Open a connection to the daemon at path, or at the usual place for a
+NULL path; returns -1 if it isn't running.
+*/
+int ConnectStarfishService(const char* path);
+
+/*
+Send a request on a connection and wait for its reply. Returns the file
+descriptor holding the result, or -1 with reply->status saying why.
+The caller owns the descriptor and closes it.
+*/
+int RequestStarfish(int connection, const StarfishRequest* request, StarfishReply* reply);
+
+/* fill in an interactive request for the default palette */
+void InitStarfishRequest(StarfishRequest* request, unsigned int seed, int width, int height,
+	int wrapEdges, int format);
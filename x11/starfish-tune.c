@@ -0,0 +1,213 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/*
+starfish-tune: finds out what renders fastest on this machine, and keeps
+it for next time.
+
+It makes a fixed set of patterns, each from its seed as xstarfish -r
+makes it, and renders them all with each tile size on a pool of one
+thread per processor, then with the fastest tile size on pools of more
+and fewer threads, keeping the quickest of a few tries of each. A
+setting only wins if it beats the one before it by more than the noise.
+Then it calibrates the cost model (see CalibrateStarfishCosts), and
+writes all of it as the tuning (see LoadStarfishTuning) that the render
+functions and xstarfish read from then on.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "starfish-engine.h"
+#include "starfish-pool.h"
+#include "starfish-render.h"
+
+/* the same seeds, and so the same patterns, on every machine */
+static const unsigned int seeds[] = { 1, 7, 42, 99, 256, 1000, 1999, 2003 };
+#define SEED_COUNT ((int) (sizeof(seeds) / sizeof(seeds[0])))
+#define DEFAULT_SEEDS 6
+#define DEFAULT_SIZE 256
+#define DEFAULT_REPEAT 2
+#define MARGIN 0.02	/* how much faster a setting must be to win */
+
+static const int tileSizes[] = { STARFISH_TILE_SIZE, 16, 32, 48, 96, 128, 256 };
+#define TILE_SIZE_COUNT ((int) (sizeof(tileSizes) / sizeof(tileSizes[0])))
+
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+Render every pattern, the quickest of repeat tries each, and return the
+total. Making the patterns doesn't depend on any of the settings, so it
+is done once, beforehand.
+*/
+static double TimeRenders(StarfishRef* textures, int count, pixel* pixels, int repeat, StarfishPoolRef pool)
+{
+	double total = 0;
+	int i, try;
+	for(i = 0; i < count; i++)
+	{
+		double best = 0;
+		for(try = 0; try < repeat; try++)
+		{
+			double start = Now(), spent;
+			RenderStarfish(textures[i], pixels, StarfishWidth(textures[i]), pool);
+			spent = Now() - start;
+			if(!try || spent < best) best = spent;
+		}
+		total += best;
+	}
+	return total;
+}
+
+static void usage(void)
+{
+	puts(
+		"starfish-tune: finds what renders fastest here, and keeps it.\n"
+		"Usage: starfish-tune [options...]\n"
+		"--size:	the size to render at, 256x256 by default.\n"
+		"--seeds:	how many patterns to render, 6 by default and at most 8.\n"
+		"--repeat:	render each pattern this many times and keep the\n"
+		"		fastest, 2 by default.\n"
+		"-o,--output:	write the tuning here instead of where the render\n"
+		"		functions look for it.\n"
+		"--dry-run:	find the best settings, but write nothing.\n"
+		);
+}
+
+int main(int argc, char* argv[])
+{
+	StarfishRef textures[SEED_COUNT];
+	int width = DEFAULT_SIZE, height = DEFAULT_SIZE;
+	int count = DEFAULT_SEEDS, repeat = DEFAULT_REPEAT;
+	int dryRun = 0;
+	const char* output = NULL;
+	int processors, bestTile, bestThreads, threads, i, ctr;
+	double bestTime, time;
+	StarfishPoolRef pool;
+	pixel* pixels;
+
+	for(ctr = 1; ctr < argc; ctr++)
+	{
+		if(!strcmp(argv[ctr], "--size") && ctr + 1 < argc)
+		{
+			if(sscanf(argv[++ctr], "%dx%d", &width, &height) != 2) width = 0;
+		}
+		else if(!strcmp(argv[ctr], "--seeds") && ctr + 1 < argc)
+			count = atoi(argv[++ctr]);
+		else if(!strcmp(argv[ctr], "--repeat") && ctr + 1 < argc)
+			repeat = atoi(argv[++ctr]);
+		else if((!strcmp(argv[ctr], "-o") || !strcmp(argv[ctr], "--output")) && ctr + 1 < argc)
+			output = argv[++ctr];
+		else if(!strcmp(argv[ctr], "--dry-run"))
+			dryRun = 1;
+		else
+		{
+			usage();
+			return !(!strcmp(argv[ctr], "-h") || !strcmp(argv[ctr], "--help"));
+		}
+	}
+	if(width <= 0 || height <= 0 || count < 1 || count > SEED_COUNT || repeat < 1)
+	{
+		usage();
+		return 1;
+	}
+	pixels = malloc((size_t) width * height * sizeof(pixel));
+	if(!pixels) return 1;
+	for(i = 0; i < count; i++)
+	{
+		srand(seeds[i]);
+		textures[i] = MakeStarfish(width, height, NULL, 0);
+		if(!textures[i]) return 1;
+	}
+
+	/* The tile size first, on as many threads as there are processors. */
+	pool = MakeStarfishPool(0);
+	processors = StarfishPoolThreads(pool);
+	printf("%d patterns at %dx%d, %d processor%s\n", count, width, height,
+		processors, processors == 1 ? "" : "s");
+	printf("%-10s %8s %10s\n", "tile size", "threads", "seconds");
+	bestTile = tileSizes[0];
+	bestTime = 0;
+	for(i = 0; i < TILE_SIZE_COUNT; i++)
+	{
+		SetStarfishTileSize(tileSizes[i]);
+		time = TimeRenders(textures, count, pixels, repeat, pool);
+		printf("%-10d %8d %10.3f\n", tileSizes[i], processors, time);
+		fflush(stdout);
+		if(!i || time < bestTime * (1 - MARGIN))
+		{
+			bestTile = tileSizes[i];
+			bestTime = time;
+		}
+	}
+	DumpStarfishPool(pool);
+	SetStarfishTileSize(bestTile);
+
+	/*
+	Then the threads: fewer can win where processors share their caches
+	or their cores, and more where threads wait on each other.
+	*/
+	bestThreads = processors;
+	for(threads = 1; threads <= processors * 2; threads = threads < 4 ? threads + 1 : threads * 3 / 2)
+	{
+		if(threads == processors) continue;
+		pool = MakeStarfishPool(threads);
+		time = TimeRenders(textures, count, pixels, repeat, pool);
+		DumpStarfishPool(pool);
+		printf("%-10d %8d %10.3f\n", bestTile, threads, time);
+		fflush(stdout);
+		if(time < bestTime * (1 - MARGIN))
+		{
+			bestThreads = threads;
+			bestTime = time;
+		}
+	}
+	for(i = 0; i < count; i++) DumpStarfish(textures[i]);
+	free(pixels);
+	printf("best: tiles of %d on %d thread%s\n", bestTile, bestThreads, bestThreads == 1 ? "" : "s");
+
+	printf("calibrating the cost model...\n");
+	fflush(stdout);
+	CalibrateStarfishCosts();
+	if(dryRun)
+	{
+		DumpStarfishCosts(stdout);
+		return 0;
+	}
+	/* with no path, SaveStarfishTuning makes the directory it goes in */
+	if(!SaveStarfishTuning(output, bestThreads))
+	{
+		if(!output) output = StarfishTuningPath();
+		fprintf(stderr, "starfish-tune: could not write %s\n", output ? output : "the tuning");
+		return 1;
+	}
+	printf("wrote %s\n", output ? output : StarfishTuningPath());
+	return 0;
+}
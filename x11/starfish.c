@@ -40,12 +40,33 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <ctype.h>
 #include <X11/bitmaps/gray>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "starfish-engine.h"
 #include "starfish-rasterlib.h"
+#include "starfish-pool.h"
+#include "starfish-render.h"
 #include "setdesktop.h"
 #include "makepng.h"
+#include "makepyramid.h"
+#include "downsample.h"
+#include "maketexture.h"
+#include "multihead.h"
+#include "animate.h"
+#include "makevideo.h"
+#include "hack.h"
+#include "makebatch.h"
+#include "starfish-service.h"
+#include "rendercache.h"
+#include "perfstats.h"
+#include "starfish-trace.h"
+#include "heatmap.h"
 #include "genutils.h"
 
+#define ANIMATE_ROOT 1
+#define ANIMATE_WINDOW 2
+
 void usage(void)
 	{
 	puts(
@@ -67,7 +88,10 @@ void usage(void)
 		"		a square pattern WxW will be generated.\n"
 		"-o,--outfile: specify an output file. If you use this option,\n"
 		"		starfish will write a png file instead of setting the X11\n"
-		"		desktop.\n"
+		"		desktop. A name ending in .ktx2 or .dds gets an\n"
+		"		uncompressed RGBA8 texture with a full mip chain.\n"
+		"-w,--wrap:	make the pattern tile seamlessly.\n"
+		"--mip-filter:	box or kaiser, the filter used to make mip levels.\n"
 		"-s,--size:	An approximate size in English. Valid size arguments are\n"
 		"		small, medium, large, full, and random. Full size creates\n"
 		"		patterns the exact size of your display's default monitor.\n"
@@ -76,25 +100,107 @@ void usage(void)
 		"		any size from 64x64 up to the whole monitor. Size always\n"
 		"		overrides geometry.\n"
 	        "-r,--random:   specify seed for rand() call - for debugging.\n"
+		"-j,--threads:	number of threads to render with. The default is what\n"
+		"		starfish-tune found best here, or else one per processor.\n"
+		"--pyramid:	one argument, a path. Instead of a single image, write a\n"
+		"		deep zoom tile pyramid: a .dzi file and its _files\n"
+		"		directory if the path ends in .dzi, otherwise a\n"
+		"		directory of z/x/y.png tiles.\n"
+		"--pyramid-format: dzi or xyz, to override the guess made from\n"
+		"		the pyramid path.\n"
+		"--tile-size:	edge length of pyramid tiles, 256 by default.\n"
+		"--animate:	play the pattern as an endless animation on the root\n"
+		"		window, at whatever resolution keeps up with the frame\n"
+		"		rate.\n"
+		"--window:	like --animate, but in a window of its own, sized by\n"
+		"		--geometry. Press q or close the window to stop.\n"
+		"--fps:		frame rate to aim for when animating, 30 by default.\n"
+		"--period:	seconds for an animation to come back to where it\n"
+		"		started, 60 by default.\n"
+		"--video:	y4m or rgb. Write one loop of the animation as a video\n"
+		"		to the --outfile, or to standard output if there is\n"
+		"		none: YUV4MPEG2, or bare rgb24 frames.\n"
+		"--frames:	how many frames the video loop has. The default is\n"
+		"		enough for one period at the frame rate.\n"
+		"--hack:	run as an xscreensaver hack, in the window named by\n"
+		"		$XSCREENSAVER_WINDOW or else a window of its own. Each\n"
+		"		pattern appears coarse at once, sharpens, and fades\n"
+		"		into the next.\n"
+		"-window-id:	one argument, the id of a window to run the hack in.\n"
+		"--cycle:	seconds each hack pattern stays up, 30 by default.\n"
+		"--batch:	one argument, a count. Write that many patterns as png\n"
+		"		files named by their seeds, all at once, and report\n"
+		"		how fast it went.\n"
+		"--outdir:	where --batch puts its files, . by default.\n"
+		"--seed-start:	the first seed of a batch; -r with a file's seed\n"
+		"		makes that pattern again.\n"
+		"--service:	ask a running starfishd for the pattern instead of\n"
+		"		rendering it here. Only for a single png or the desktop,\n"
+		"		of a size that isn't picked at random.\n"
+		"--cache-size:	megabytes of patterns made with -r and --geometry to\n"
+		"		keep in ~/.cache/starfish, so they needn't be rendered\n"
+		"		again; 256 by default.\n"
+		"--no-cache:	neither use nor fill the render cache.\n"
+		"--save-genome:	one argument, a file to write the pattern's genome to:\n"
+		"		its whole tree of waves, which is enough to draw it\n"
+		"		again at any size. Text if the name ends in .txt.\n"
+		"--genome:	one argument, a genome file to draw instead of making\n"
+		"		a new pattern. Its edges wrap or not as saved.\n"
+		"		Neither genome option works with -d on the desktop. On\n"
+		"		a screen of several monitors, both put one pattern\n"
+		"		across the whole screen.\n"
+		"--budget:	seconds a pattern may take to render. Patterns the\n"
+		"		cost model expects to take longer are passed over for\n"
+		"		another; after a few dozen tries the cheapest is used.\n"
+		"		For the desktop, once or as a daemon.\n"
+		"--calibrate:	time each kind of wave on this machine and use\n"
+		"		those costs for --budget, instead of the built-in ones\n"
+		"		which make the same pattern of a seed everywhere.\n"
+		"		If starfish-tune has run here, use its costs instead.\n"
+		"		Without --budget, list the costs and quit.\n"
+		"--stats:	table or json. Report the time each stage of making\n"
+		"		a pattern took, on the wall clock and the processor,\n"
+		"		with hardware counters where the kernel allows them:\n"
+		"		cycles, instructions, branch and cache misses.\n"
+		"		The stages are generating the tree, rendering, png\n"
+		"		encoding and uploading to the X server.\n"
+		"--trace:	one argument, a file to write a timeline of the run\n"
+		"		to when it finishes, as Chrome trace-event JSON for\n"
+		"		Perfetto: making the tree, each tile on each thread,\n"
+		"		threads waiting, png encoding and the X upload.\n"
+		"--heatmap:	one argument, a png file to write a map of what the\n"
+		"		pattern costs to evaluate, place by place, to: black\n"
+		"		is cheapest and pale yellow dearest. A summary goes\n"
+		"		to standard error. Not with -d on the desktop; on a\n"
+		"		screen of several monitors, one pattern covers the\n"
+		"		whole screen.\n"
+		"--heatmap-step:	time one pixel in each square this many pixels\n"
+		"		on a side for the heatmap, 4 by default.\n"
 		"--display:	one argument, name of the desired target display.\n"
 	    );
 	}
 
-void CalcRandomSize(int* width, int* height, const char* sizename, const char* displayname)
+void PickRandomSize(int* width, int* height, const char* sizename, int maxH, int maxV);
+
+void GetDisplaySize(int* maxH, int* maxV, const char* displayname)
 	{
 	/*
 	Figure out how big the default monitor is.
-	Then come up with some reasonable size values based on that.
-	Return them.
 	*/
 	int screen;
-	int minH, maxH, minV, maxV;
-	Display* display = XOpenDisplay(displayname);
-	if(display)
+	Display* display = NULL;
+	/*
+	A daemon keeps the desktop's connection open; ask it rather than
+	connecting all over again.
+	*/
+	if(XDesktopSize(maxH, maxV))
+		{
+		}
+	else if((display = XOpenDisplay(displayname)))
 		{
 		screen = DefaultScreen(display);
-		maxH = DisplayWidth(display, screen);
-		maxV = DisplayHeight(display, screen);
+		*maxH = DisplayWidth(display, screen);
+		*maxV = DisplayHeight(display, screen);
 		}
 	else
 		{
@@ -102,9 +208,29 @@ void CalcRandomSize(int* width, int* height, const char* sizename, const char* d
 		In the case that someone tries to run this without X,
 		we fabricate numbers based on the smallest common display.
 		*/
-		maxH = 640;
-		maxV = 480;
+		*maxH = 640;
+		*maxV = 480;
 		}
+	if(display) XCloseDisplay(display);
+	}
+
+void CalcRandomSize(int* width, int* height, const char* sizename, const char* displayname)
+	{
+	/*
+	Come up with some reasonable size values based on the display's size.
+	Return them.
+	*/
+	int maxH, maxV;
+	GetDisplaySize(&maxH, &maxV, displayname);
+	PickRandomSize(width, height, sizename, maxH, maxV);
+	}
+
+void PickRandomSize(int* width, int* height, const char* sizename, int maxH, int maxV)
+	{
+	/*
+	Come up with a pattern size that suits a monitor this big.
+	*/
+	int minH, minV;
 	minV = minH = 64;
 	if(!strcmp(sizename, "full"))
 		{
@@ -132,7 +258,324 @@ void CalcRandomSize(int* width, int* height, const char* sizename, const char* d
 		}
 	*width = irandge(minH, maxH);
 	*height = irandge(minV, maxV);
-	if(display) XCloseDisplay(display);
+	}
+
+/*
+The daemon renders each pattern ahead of time, on a background thread at
+idle priority, while it sleeps through the interval. When the interval is
+up the pattern is already in memory and only has to be sent to X.
+*/
+typedef struct
+	{
+	int width, height;
+	int wrapEdges;
+	double budget;
+	StarfishPoolRef pool;
+	pixel* pixels;
+	/*
+	With more than one monitor, each gets a pattern of its own and the
+	pixels cover the whole screen.
+	*/
+	int monitorCount;
+	DesktopRect monitors[MAX_MONITORS];
+	int widths[MAX_MONITORS], heights[MAX_MONITORS];
+	} NextPattern;
+
+void PickPatternSizes(NextPattern* next, int width, int height, const char* sizeName, const char* displayName)
+	{
+	int i;
+	if(next->monitorCount <= 1)
+		{
+		if(sizeName) CalcRandomSize(&width, &height, sizeName, displayName);
+		next->width = width;
+		next->height = height;
+		return;
+		}
+	for(i = 0; i < next->monitorCount; i++)
+		{
+		next->widths[i] = width;
+		next->heights[i] = height;
+		if(sizeName) PickRandomSize(&next->widths[i], &next->heights[i], sizeName,
+				next->monitors[i].width, next->monitors[i].height);
+		}
+	XDesktopSize(&next->width, &next->height);
+	}
+
+void RenderPattern(NextPattern* next)
+	{
+	StarfishRef texture;
+	next->pixels = NULL;
+	if(next->monitorCount > 1)
+		{
+		next->pixels = RenderMonitorPatterns(next->monitors, next->monitorCount,
+				next->widths, next->heights, next->wrapEdges, next->budget,
+				next->width, next->height, next->pool);
+		return;
+		}
+	if(next->budget > 0)
+		{
+		texture = MakeStarfishWithin(next->width, next->height, NULL, next->wrapEdges,
+				next->budget, StarfishPoolThreads(next->pool));
+		}
+	else texture = MakeStarfish(next->width, next->height, NULL, next->wrapEdges);
+	if(texture)
+		{
+		next->pixels = malloc((size_t) next->width * next->height * sizeof(pixel));
+		if(next->pixels) RenderStarfish(texture, next->pixels, next->width, next->pool);
+		DumpStarfish(texture);
+		}
+	}
+
+void* RenderAhead(void* arg)
+	{
+	LowerStarfishThreadPriority();
+	RenderPattern(arg);
+	return NULL;
+	}
+
+int SetMonitorPatterns(int width, int height, const char* sizeName, int wrapEdges,
+		double budget, const char* displayName, StarfishPoolRef pool)
+	{
+	/*
+	A one-off run on a multi-head screen: render every monitor's
+	pattern at full priority and put them up together.
+	*/
+	NextPattern next;
+	next.wrapEdges = wrapEdges;
+	next.budget = budget;
+	next.pool = pool;
+	next.monitorCount = XDesktopMonitors(next.monitors, MAX_MONITORS);
+	PickPatternSizes(&next, width, height, sizeName, displayName);
+	RenderPattern(&next);
+	if(!next.pixels)
+		{
+		fprintf(stderr, "xstarfish: was not able to create texture\n");
+		return 1;
+		}
+	BeginPerfStage(STAGE_UPLOAD);
+	SetXDesktopPixels(next.pixels, next.width, next.height, pool);
+	EndPerfStage(STAGE_UPLOAD);
+	free(next.pixels);
+	return 0;
+	}
+
+int RunDesktopDaemon(int width, int height, const char* sizeName, int wrapEdges,
+		double budget, int sleeptime, const char* displayName, int threads)
+	{
+	NextPattern next;
+	pthread_t renderer;
+	StarfishPoolRef pool;
+	int first = 1, started;
+	if(!OpenXDesktop(displayName)) return 1;
+	next.wrapEdges = wrapEdges;
+	next.budget = budget;
+	next.pool = MakeStarfishIdlePool(threads);
+	/* putting a pattern up is quick, and shouldn't wait on anything else */
+	pool = MakeStarfishPool(threads);
+	for(;;)
+		{
+		/*
+		Pick the sizes here, not on the renderer thread: both of them
+		draw from the C library's one random number generator. The
+		monitors are asked for again every time, in case they changed.
+		*/
+		next.monitorCount = XDesktopMonitors(next.monitors, MAX_MONITORS);
+		PickPatternSizes(&next, width, height, sizeName, displayName);
+		/*
+		Without a thread to render on, render right here instead, at
+		the usual priority. Either way the pattern that is up stays
+		up for one sleep, and only one.
+		*/
+		started = !pthread_create(&renderer, NULL, RenderAhead, &next);
+		if(!started) RenderPattern(&next);
+		if(!first) sleep(sleeptime);
+		first = 0;
+		if(started) pthread_join(renderer, NULL);
+		if(!next.pixels)
+			{
+			fprintf(stderr, "xstarfish: was not able to create texture\n");
+			continue;
+			}
+		SetXDesktopPixels(next.pixels, next.width, next.height, pool);
+		free(next.pixels);
+		}
+	return 0;
+	}
+
+/*
+Every pattern in a batch is sized the way a single one would be. The
+display is asked its size once, up front, rather than once a pattern.
+*/
+typedef struct
+	{
+	int width, height;
+	const char* sizeName;
+	int maxH, maxV;
+	} BatchSize;
+
+void PickBatchSize(void* context, int* width, int* height)
+	{
+	BatchSize* batch = context;
+	*width = batch->width;
+	*height = batch->height;
+	if(batch->sizeName) PickRandomSize(width, height, batch->sizeName, batch->maxH, batch->maxV);
+	}
+
+/*
+Get the pattern from starfishd, which may already have it. The result
+comes back as a file descriptor: map it, and either copy it out as the
+png file or put it up on the desktop. Returns zero if the daemon isn't
+there or couldn't help, so the caller can render it here instead, and
+-1 if the pattern came back but the png file could not be written.
+*/
+int FetchFromService(unsigned int seed, int width, int height, int wrapEdges,
+		const char* filename, const char* displayName, StarfishPoolRef pool)
+	{
+	StarfishRequest request;
+	StarfishReply reply;
+	int connection, fd, ok = 0;
+	void* result;
+	connection = ConnectStarfishService(NULL);
+	if(connection < 0) return 0;
+	InitStarfishRequest(&request, seed, width, height, wrapEdges, filename ? STARFISHD_PNG : STARFISHD_RGBA);
+	fd = RequestStarfish(connection, &request, &reply);
+	close(connection);
+	if(fd < 0)
+		{
+		fprintf(stderr, "xstarfish: starfishd could not make the pattern: %s\n", strerror(reply.status));
+		return 0;
+		}
+	result = mmap(NULL, reply.size, PROT_READ, MAP_SHARED, fd, 0);
+	if(result != MAP_FAILED)
+		{
+		if(filename)
+			{
+			FILE* out = fopen(filename, "wb");
+			if(out)
+				{
+				ok = fwrite(result, 1, reply.size, out) == reply.size;
+				if(fclose(out) == EOF) ok = 0;
+				}
+			if(!ok)
+				{
+				fprintf(stderr, "xstarfish: could not write output file %s.\n", filename);
+				ok = -1;
+				}
+			}
+		else if(OpenXDesktop(displayName))
+			{
+			BeginPerfStage(STAGE_UPLOAD);
+			SetXDesktopPixels(result, reply.width, reply.height, pool);
+			EndPerfStage(STAGE_UPLOAD);
+			CloseXDesktop();
+			ok = 1;
+			}
+		munmap(result, reply.size);
+		}
+	close(fd);
+	return ok;
+	}
+
+/*
+Put up a pattern that has already been rendered: write the png file, if
+there is one, or else set it on the desktop.
+*/
+int ShowPatternPixels(const pixel* pixels, int width, int height,
+		const char* filename, const char* displayName, StarfishPoolRef pool)
+	{
+	int ok;
+	if(filename)
+		{
+		BeginPerfStage(STAGE_ENCODE);
+		ok = WritePNGFile(filename, pixels, width, height, width);
+		EndPerfStage(STAGE_ENCODE);
+		return ok;
+		}
+	if(!OpenXDesktop(displayName)) return 0;
+	BeginPerfStage(STAGE_UPLOAD);
+	SetXDesktopPixels(pixels, width, height, pool);
+	EndPerfStage(STAGE_UPLOAD);
+	CloseXDesktop();
+	return 1;
+	}
+
+/*
+Render a pattern in memory, then send it to the png file or the desktop.
+With a key, keep a copy in the render cache on the way. Either way the
+rendering and what follows it can be timed apart.
+*/
+void RenderThenShowPattern(StarfishRef texture, const RenderCacheKey* key,
+		const char* filename, const char* displayName, StarfishPoolRef pool)
+	{
+	int width = StarfishWidth(texture), height = StarfishHeight(texture);
+	pixel* pixels = malloc((size_t) width * height * sizeof(pixel));
+	if(!pixels)
+		{
+		// Too big to hold in one piece; do without the cache.
+		if(filename) MakePNGFile(texture, filename, pool);
+		else SetXDesktop(texture, displayName, pool);
+		return;
+		}
+	BeginPerfStage(STAGE_RENDER);
+	RenderStarfish(texture, pixels, width, pool);
+	EndPerfStage(STAGE_RENDER);
+	if(key) StoreCachedRender(key, pixels, width);
+	ShowPatternPixels(pixels, width, height, filename, displayName, pool);
+	free(pixels);
+	}
+
+/*
+Read a genome file, in either form, and grow its pattern at this size.
+*/
+StarfishRef LoadGenomeFile(const char* path, int width, int height)
+	{
+	FILE* in = fopen(path, "rb");
+	char* genome = NULL;
+	long size = 0, room = 0;
+	StarfishRef texture = NULL;
+	if(!in)
+		{
+		fprintf(stderr, "xstarfish: could not open genome file %s.\n", path);
+		return NULL;
+		}
+	for(;;)
+		{
+		char* more;
+		if(size == room)
+			{
+			room = room ? room * 2 : 4096;
+			more = realloc(genome, room);
+			if(!more) break;
+			genome = more;
+			}
+		size += fread(genome + size, 1, room - size, in);
+		if(size < room) break;
+		}
+	fclose(in);
+	if(genome) texture = LoadStarfish(genome, size, width, height);
+	if(!texture) fprintf(stderr, "xstarfish: %s is not a genome this version can read.\n", path);
+	free(genome);
+	return texture;
+	}
+
+void SaveGenomeFile(StarfishRef texture, const char* path)
+	{
+	size_t length = strlen(path);
+	int format = (length > 4 && !strcmp(path + length - 4, ".txt")) ? STARFISH_GENOME_TEXT : STARFISH_GENOME_BINARY;
+	long size = SaveStarfish(texture, format, NULL, 0);
+	char* genome = (size > 0) ? malloc(size + 1) : NULL;
+	FILE* out;
+	int ok = 0;
+	if(!genome) return;
+	SaveStarfish(texture, format, genome, size + 1);
+	out = fopen(path, "wb");
+	if(out)
+		{
+		ok = fwrite(genome, 1, size, out) == (size_t) size;
+		if(fclose(out) == EOF) ok = 0;
+		}
+	if(!ok) fprintf(stderr, "xstarfish: could not write genome file %s.\n", path);
+	free(genome);
 	}
 
 void ExtractGeometry(const char* geostr, int* width, int* height)
@@ -175,6 +618,16 @@ void ExtractGeometry(const char* geostr, int* width, int* height)
 	if(*geostr) fprintf(stderr, "xstarfish: The geometry option is broken - \"%s\"\n", geostr);
 	}
 
+/*
+The trace, if there is one, is written however xstarfish finishes.
+*/
+const char* tracePath;
+
+void WriteTrace(void)
+	{
+	if(!FinishStarfishTrace(tracePath)) fprintf(stderr, "xstarfish: could not write trace %s.\n", tracePath);
+	}
+
 int main(int argc, char** argv)
 	{
 	/*
@@ -211,6 +664,35 @@ int main(int argc, char** argv)
 	const char* sizeName;
 	const char* filename;
 	char haveOutfile;
+	int threads;
+	StarfishPoolRef pool;
+	const char* pyramidPath;
+	int pyramidFormat;
+	int tileSize;
+	int wrapEdges;
+	int mipFilter;
+	int animate;
+	double fps, period;
+	int videoFormat, frameCount;
+	int hack, cycle;
+	unsigned long hackWindow;
+	int batchCount;
+	const char* outDir;
+	unsigned int seedStart;
+	unsigned int seed;
+	int haveSeed;
+	int useService;
+	int useCache, caching, fetching, fetched;
+	int failed = 0;
+	double budget;
+	int calibrate;
+	int stats;
+	const char* heatmapPath;
+	int heatmapStep;
+	const char* genomePath;
+	const char* saveGenomePath;
+	RenderCacheKey cacheKey;
+	int container;
 	/*
 	Set up our defaults. These may be overridden by command line parameters.
 	*/
@@ -221,6 +703,36 @@ int main(int argc, char** argv)
 	sizeName = NULL;
 	filename = NULL;
 	haveOutfile = 0;
+	threads = 0;
+	pyramidPath = NULL;
+	pyramidFormat = -1;
+	tileSize = PYRAMID_DEFAULT_TILE;
+	wrapEdges = 0;
+	mipFilter = MIP_FILTER_BOX;
+	animate = 0;
+	fps = ANIMATION_DEFAULT_FPS;
+	period = ANIMATION_DEFAULT_PERIOD;
+	videoFormat = VIDEO_NONE;
+	frameCount = 0;
+	hack = 0;
+	hackWindow = 0;
+	cycle = HACK_DEFAULT_CYCLE;
+	batchCount = 0;
+	outDir = ".";
+	seedStart = (unsigned int) time(NULL);
+	seed = 0;
+	haveSeed = 0;
+	useService = 0;
+	useCache = 1;
+	caching = 0;
+	budget = 0;
+	calibrate = 0;
+	stats = 0;
+	heatmapPath = NULL;
+	heatmapStep = HEATMAP_DEFAULT_STEP;
+	genomePath = NULL;
+	saveGenomePath = NULL;
+	container = TEXTURE_NONE;
 	srand(time(0));  /* we may override this when parsing the arguments */
 	for(ctr = 1; ctr < argc; ctr++)
 		{
@@ -294,13 +806,207 @@ int main(int argc, char** argv)
 			*/ 
 			if(ctr + 1 < argc && isdigit(argv[ctr + 1][0]))
 				{
-				srand(atoi(argv[++ctr]));
+				seed = strtoul(argv[++ctr], NULL, 10);
+				haveSeed = 1;
+				srand(seed);
 				}
 			else
 				{
 			        fprintf(stderr, "xstarfish: \"-r\" requires an argument.\n");
 				}			     
 			}
+		else if(!strcmp(argv[ctr], "-j") || !strcmp(argv[ctr], "--threads"))
+			{
+			if(ctr + 1 < argc && isdigit(argv[ctr + 1][0]))
+				{
+				threads = atoi(argv[++ctr]);
+				}
+			else
+				{
+				fprintf(stderr, "xstarfish: %s requires a number.\n", argv[ctr]);
+				}
+			}
+		else if(!strcmp(argv[ctr], "--pyramid"))
+			{
+			if(ctr + 1 < argc) pyramidPath = argv[++ctr];
+				else fprintf(stderr, "xstarfish: %s requires an argument.\n", argv[ctr]);
+			}
+		else if(!strcmp(argv[ctr], "--pyramid-format"))
+			{
+			ctr++;
+			if(ctr < argc && !strcmp(argv[ctr], "dzi")) pyramidFormat = PYRAMID_DZI;
+			else if(ctr < argc && !strcmp(argv[ctr], "xyz")) pyramidFormat = PYRAMID_XYZ;
+			else
+				{
+				fprintf(stderr, "xstarfish: pyramid format must be dzi or xyz.\n");
+				return 1;
+				}
+			}
+		else if(!strcmp(argv[ctr], "--tile-size"))
+			{
+			if(ctr + 1 < argc && isdigit(argv[ctr + 1][0]))
+				{
+				tileSize = atoi(argv[++ctr]);
+				}
+			else
+				{
+				fprintf(stderr, "xstarfish: %s requires a number.\n", argv[ctr]);
+				}
+			}
+		else if(!strcmp(argv[ctr], "-w") || !strcmp(argv[ctr], "--wrap"))
+			{
+			wrapEdges = 1;
+			}
+		else if(!strcmp(argv[ctr], "--mip-filter"))
+			{
+			ctr++;
+			if(ctr < argc && !strcmp(argv[ctr], "box")) mipFilter = MIP_FILTER_BOX;
+			else if(ctr < argc && !strcmp(argv[ctr], "kaiser")) mipFilter = MIP_FILTER_KAISER;
+			else
+				{
+				fprintf(stderr, "xstarfish: mip filter must be box or kaiser.\n");
+				return 1;
+				}
+			}
+		else if(!strcmp(argv[ctr], "--animate"))
+			{
+			animate = ANIMATE_ROOT;
+			}
+		else if(!strcmp(argv[ctr], "--window"))
+			{
+			animate = ANIMATE_WINDOW;
+			}
+		else if(!strcmp(argv[ctr], "--fps") || !strcmp(argv[ctr], "--period"))
+			{
+			double value = (ctr + 1 < argc) ? atof(argv[ctr + 1]) : 0.0;
+			if(value > 0.0)
+				{
+				if(!strcmp(argv[ctr], "--fps")) fps = value;
+				else period = value;
+				ctr++;
+				}
+			else
+				{
+				fprintf(stderr, "xstarfish: %s requires a positive number.\n", argv[ctr]);
+				}
+			}
+		else if(!strcmp(argv[ctr], "--video"))
+			{
+			ctr++;
+			if(ctr < argc) videoFormat = VideoFormatForName(argv[ctr]);
+			if(videoFormat == VIDEO_NONE)
+				{
+				fprintf(stderr, "xstarfish: video format must be y4m or rgb.\n");
+				return 1;
+				}
+			}
+		else if(!strcmp(argv[ctr], "--frames"))
+			{
+			if(ctr + 1 < argc && isdigit(argv[ctr + 1][0]))
+				{
+				frameCount = atoi(argv[++ctr]);
+				}
+			else
+				{
+				fprintf(stderr, "xstarfish: %s requires a number.\n", argv[ctr]);
+				}
+			}
+		else if(!strcmp(argv[ctr], "--hack"))
+			{
+			const char* env = getenv("XSCREENSAVER_WINDOW");
+			hack = 1;
+			if(env && !hackWindow) hackWindow = strtoul(env, NULL, 0);
+			}
+		else if(!strcmp(argv[ctr], "-window-id") || !strcmp(argv[ctr], "--window-id"))
+			{
+			hack = 1;
+			if(ctr + 1 < argc) hackWindow = strtoul(argv[++ctr], NULL, 0);
+				else fprintf(stderr, "xstarfish: %s requires an argument.\n", argv[ctr]);
+			}
+		else if(!strcmp(argv[ctr], "--cycle"))
+			{
+			if(ctr + 1 < argc && isdigit(argv[ctr + 1][0]))
+				{
+				cycle = atoi(argv[++ctr]);
+				}
+			else
+				{
+				fprintf(stderr, "xstarfish: %s requires a number.\n", argv[ctr]);
+				}
+			}
+		else if(!strcmp(argv[ctr], "--batch") || !strcmp(argv[ctr], "--seed-start"))
+			{
+			if(ctr + 1 < argc && isdigit(argv[ctr + 1][0]))
+				{
+				if(!strcmp(argv[ctr], "--batch")) batchCount = atoi(argv[++ctr]);
+				else seedStart = strtoul(argv[++ctr], NULL, 10);
+				}
+			else
+				{
+				fprintf(stderr, "xstarfish: %s requires a number.\n", argv[ctr]);
+				}
+			}
+		else if(!strcmp(argv[ctr], "--outdir"))
+			{
+			if(ctr + 1 < argc) outDir = argv[++ctr];
+				else fprintf(stderr, "xstarfish: %s requires an argument.\n", argv[ctr]);
+			}
+		else if(!strcmp(argv[ctr], "--service"))
+			{
+			useService = 1;
+			}
+		else if(!strcmp(argv[ctr], "--cache-size"))
+			{
+			if(ctr + 1 < argc && isdigit(argv[ctr + 1][0]))
+				{
+				SetRenderCacheLimit((size_t) strtoul(argv[++ctr], NULL, 10) * 1024 * 1024);
+				}
+			else
+				{
+				fprintf(stderr, "xstarfish: %s requires a number.\n", argv[ctr]);
+				}
+			}
+		else if(!strcmp(argv[ctr], "--no-cache"))
+			{
+			useCache = 0;
+			}
+		else if(!strcmp(argv[ctr], "--budget"))
+			{
+			if(ctr + 1 < argc && atof(argv[ctr + 1]) > 0) budget = atof(argv[++ctr]);
+			else fprintf(stderr, "xstarfish: %s requires a number of seconds.\n", argv[ctr]);
+			}
+		else if(!strcmp(argv[ctr], "--calibrate"))
+			{
+			calibrate = 1;
+			}
+		else if(!strcmp(argv[ctr], "--heatmap"))
+			{
+			if(ctr + 1 < argc) heatmapPath = argv[++ctr];
+			else fprintf(stderr, "xstarfish: %s requires an argument.\n", argv[ctr]);
+			}
+		else if(!strcmp(argv[ctr], "--heatmap-step"))
+			{
+			if(ctr + 1 < argc && atoi(argv[ctr + 1]) > 0) heatmapStep = atoi(argv[++ctr]);
+			else fprintf(stderr, "xstarfish: %s requires a number of pixels.\n", argv[ctr]);
+			}
+		else if(!strcmp(argv[ctr], "--trace"))
+			{
+			if(ctr + 1 < argc) tracePath = argv[++ctr];
+			else fprintf(stderr, "xstarfish: %s requires an argument.\n", argv[ctr]);
+			}
+		else if(!strcmp(argv[ctr], "--stats"))
+			{
+			if(ctr + 1 < argc && !strcmp(argv[ctr + 1], "table")) stats = STATS_TABLE;
+			else if(ctr + 1 < argc && !strcmp(argv[ctr + 1], "json")) stats = STATS_JSON;
+			else fprintf(stderr, "xstarfish: %s requires table or json.\n", argv[ctr]);
+			if(stats) ctr++;
+			}
+		else if(!strcmp(argv[ctr], "--genome") || !strcmp(argv[ctr], "--save-genome"))
+			{
+			if(ctr + 1 >= argc) fprintf(stderr, "xstarfish: %s requires an argument.\n", argv[ctr]);
+			else if(!strcmp(argv[ctr], "--genome")) genomePath = argv[++ctr];
+			else saveGenomePath = argv[++ctr];
+			}
 		else if(!strcmp(argv[ctr], "-h") || !strcmp(argv[ctr], "--usage")
 				|| !strcmp(argv[ctr], "--help"))
 			{
@@ -351,11 +1057,187 @@ int main(int argc, char** argv)
 			   }
 			}
 		}
+	if(calibrate)
+		{
+		// starfish-tune's costs, if it has been run, save measuring again.
+		if(!LoadStarfishTuning(NULL, 1)) CalibrateStarfishCosts();
+		if(budget <= 0)
+			{
+			DumpStarfishCosts(stdout);
+			return 0;
+			}
+		}
+	if(threads <= 0) threads = StarfishTunedThreads();
+	/*
+	The desktop daemon makes a new pattern every time round; there is no
+	one pattern for a genome to draw or to be saved from, or to map.
+	*/
+	if(daemon && !haveOutfile && !pyramidPath && (genomePath || saveGenomePath || heatmapPath))
+		{
+		fprintf(stderr, "xstarfish: --genome, --save-genome and --heatmap can't be used with -d on the desktop.\n");
+		return 1;
+		}
 	/*
 	This line relies on conditional evaluation.
 	IIRC, that's in K&R, so it should be alright...
 	*/
 	if(daemon && fork()) return 0;
+	if(daemon && !haveOutfile && !pyramidPath)
+		{
+		return RunDesktopDaemon(width, height, sizeName, wrapEdges, budget, sleeptime, displayName, threads);
+		}
+	if(haveOutfile) container = TextureContainerForName(filename);
+	if(pyramidPath && pyramidFormat < 0)
+		{
+		size_t len = strlen(pyramidPath);
+		pyramidFormat = (len > 4 && !strcmp(pyramidPath + len - 4, ".dzi")) ? PYRAMID_DZI : PYRAMID_XYZ;
+		}
+	/*
+	Threads don't survive a fork, so the pool has to be made afterwards.
+	The counters, and the trace's names for threads, only follow threads
+	started after they are opened.
+	*/
+	if(stats) OpenPerfStats();
+	if(tracePath)
+		{
+		StartStarfishTrace(0);
+		NameStarfishTraceThread("main");
+		atexit(WriteTrace);
+		}
+	/*
+	A screensaver only ever has the machine's spare time.
+	*/
+	pool = hack ? MakeStarfishIdlePool(threads) : MakeStarfishPool(threads);
+	if(batchCount > 0)
+		{
+		BatchSize batchSize;
+		int failures;
+		batchSize.width = width;
+		batchSize.height = height;
+		batchSize.sizeName = sizeName;
+		if(sizeName) GetDisplaySize(&batchSize.maxH, &batchSize.maxV, displayName);
+		failures = MakeBatch(batchCount, seedStart, outDir, wrapEdges, PickBatchSize, &batchSize, pool);
+#if STARFISH_PROFILE
+		ReportStarfishProfileTotals(stderr);
+#endif
+		DumpStarfishPool(pool);
+		return failures ? 1 : 0;
+		}
+	if(hack)
+		{
+		int result = 1;
+		if(OpenXDesktop(displayName))
+			{
+			result = RunHack(hackWindow, width, height, wrapEdges, cycle, pool);
+			CloseXDesktop();
+			}
+		DumpStarfishPool(pool);
+		return result;
+		}
+	if(videoFormat != VIDEO_NONE)
+		{
+		/*
+		Video goes to a file or down a pipe; either way we build the
+		tree once and keep the output open for every frame.
+		*/
+		int result = 1;
+		FILE* out = haveOutfile ? fopen(filename, "wb") : stdout;
+		if(frameCount <= 0) frameCount = (int) (fps * period + 0.5);
+		if(frameCount <= 0) frameCount = 1;
+		if(sizeName) CalcRandomSize(&width, &height, sizeName, displayName);
+		texture = out ? MakeStarfish(width, height, NULL, wrapEdges) : NULL;
+		if(!out) fprintf(stderr, "xstarfish: could not open output file %s.\n", filename);
+		if(texture)
+			{
+			result = !MakeVideo(texture, out, videoFormat, frameCount, fps, pool);
+			DumpStarfish(texture);
+			}
+		if(out && out != stdout) fclose(out);
+		DumpStarfishPool(pool);
+		return result;
+		}
+	if(animate)
+		{
+		int result = 1;
+		if(OpenXDesktop(displayName))
+			{
+			if(animate == ANIMATE_ROOT) XDesktopSize(&width, &height);
+			texture = MakeStarfish(width, height, NULL, wrapEdges);
+			if(texture)
+				{
+				result = RunAnimation(texture, animate == ANIMATE_WINDOW, width, height, period, fps, pool);
+				DumpStarfish(texture);
+				}
+			CloseXDesktop();
+			}
+		DumpStarfishPool(pool);
+		return result;
+		}
+	/*
+	On a screen with several monitors, each monitor gets its own pattern.
+	A genome, to load or to save, is of one pattern, and so is a heatmap,
+	so with any of those a single pattern covers the screen instead.
+	*/
+	if(!haveOutfile && !pyramidPath && !genomePath && !saveGenomePath && !heatmapPath
+			&& OpenXDesktop(displayName))
+		{
+		DesktopRect monitors[MAX_MONITORS];
+		if(XDesktopMonitors(monitors, MAX_MONITORS) > 1)
+			{
+			int result = SetMonitorPatterns(width, height, sizeName, wrapEdges, budget, displayName, pool);
+			if(stats) ReportPerfStats(stderr, stats);
+			CloseXDesktop();
+			DumpStarfishPool(pool);
+			return result;
+			}
+		}
+	/*
+	A single pattern from a known seed may be in the render cache already,
+	or starfishd may have it. A size picked at random draws on the seed
+	too, and starfishd makes its pattern straight from the seed, so only
+	patterns of a given geometry are cached or fetched. Neither has a
+	genome to save, though, nor a budget: that changes the seed's pattern.
+	Nor can either map the cost of a tree they don't have.
+	*/
+	if(!daemon && !pyramidPath && !genomePath && !saveGenomePath && !heatmapPath && budget <= 0
+			&& container == TEXTURE_NONE && (haveSeed || useService))
+		{
+		if(!haveSeed)
+			{
+			seed = (unsigned int) time(NULL) ^ (unsigned int) getpid();
+			srand(seed);
+			}
+		caching = haveSeed && useCache && !sizeName;
+		fetching = useService && !sizeName;
+		if(caching)
+			{
+			CachedRender cached;
+			InitRenderCacheKey(&cacheKey, seed, width, height, wrapEdges, NULL);
+			if(FindCachedRender(&cacheKey, &cached))
+				{
+				ShowPatternPixels(cached.pixels, cached.width, cached.height,
+						haveOutfile ? filename : NULL, displayName, pool);
+				ReleaseCachedRender(&cached);
+				if(stats) ReportPerfStats(stderr, stats);
+				DumpStarfishPool(pool);
+				return 0;
+				}
+			}
+		// Settle the size once, so that rendering here after all still
+		// makes the pattern the seed promises.
+		if(sizeName)
+			{
+			CalcRandomSize(&width, &height, sizeName, displayName);
+			sizeName = NULL;
+			}
+		if(fetching && (fetched = FetchFromService(seed, width, height, wrapEdges,
+				haveOutfile ? filename : NULL, displayName, pool)))
+			{
+			if(stats) ReportPerfStats(stderr, stats);
+			DumpStarfishPool(pool);
+			return fetched < 0;
+			}
+		}
 	/*
 	Do the thing that makes Starfish worth installing.
 	Create a seamlessly tiled, anti-aliased image. Then do with
@@ -366,21 +1248,42 @@ int main(int argc, char** argv)
 	do
 		{
 		if(sizeName) CalcRandomSize(&width, &height, sizeName, displayName);
-		texture = MakeStarfish(width, height, NULL);
+		BeginPerfStage(STAGE_GENERATE);
+		if(genomePath) texture = LoadGenomeFile(genomePath, width, height);
+		else if(budget > 0) texture = MakeStarfishWithin(width, height, NULL, wrapEdges, budget, StarfishPoolThreads(pool));
+		else texture = MakeStarfish(width, height, NULL, wrapEdges);
+		EndPerfStage(STAGE_GENERATE);
+		if(texture && saveGenomePath) SaveGenomeFile(texture, saveGenomePath);
+		if(texture && heatmapPath) MakeHeatmapFile(texture, heatmapPath, heatmapStep, stderr);
 		if(texture)
 			{
-			if(haveOutfile) MakePNGFile(texture, filename);
-			else SetXDesktop(texture, displayName);
+			if(pyramidPath) failed |= !MakeTilePyramid(texture, pyramidPath, pyramidFormat, tileSize, pool);
+			else if(container != TEXTURE_NONE) failed |= !MakeTextureFile(texture, filename, container, mipFilter, pool);
+			else if(caching || stats)
+				{
+				RenderThenShowPattern(texture, caching ? &cacheKey : NULL,
+						haveOutfile ? filename : NULL, displayName, pool);
+				}
+			else if(haveOutfile) MakePNGFile(texture, filename, pool);
+			else SetXDesktop(texture, displayName, pool);
+#if STARFISH_PROFILE
+			ReportStarfishProfile(texture, stderr);
+#endif
+			if(stats) ReportPerfStats(stderr, stats);
 			DumpStarfish(texture);
 			}
 		else
 			{
 			fprintf(stderr, "xstarfish: was not able to create texture\n");
+			DumpStarfishPool(pool);
 			return 1;
 			}
 		if(daemon){sleep(sleeptime);}
 		}
 	while(daemon);
-	return 0;
+	CloseXDesktop();
+	ClosePerfStats();
+	DumpStarfishPool(pool);
+	return failed;
 	}
 
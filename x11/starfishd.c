@@ -0,0 +1,596 @@
+/*
+
+Copyright (c) 2026 the Starfish contributors
+All Rights Reserved
+
+This file is part of xstarfish
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/*
+starfishd: renders starfish patterns for local clients.
+
+Every client shares one pool of render threads, so a desktop full of
+clients doesn't oversubscribe the processors, and a pattern that several
+clients ask for at once is rendered only once. Recently finished results
+are kept, as sealed memory files, and handed straight to anyone else who
+asks for them. See starfish-service.h for the protocol.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "starfish-engine.h"
+#include "starfish-pool.h"
+#include "starfish-render.h"
+#include "makepng.h"
+#include "starfish-service.h"
+#include "rendercache.h"
+
+#define MAX_CLIENTS 256
+#define DEFAULT_CACHE 32	/* finished results kept for reuse */
+#define MAX_DIMENSION 32768
+
+#define QUEUED 0
+#define RUNNING 1
+#define DONE 2
+
+/*
+An entry is one distinct pattern: waiting to be rendered, rendering, or
+finished and cached. Clients that asked for it wait on it together.
+*/
+typedef struct Entry
+{
+	StarfishRequest request;
+	int state;
+	int status;
+	int fd;
+	uint64_t size;
+	int* waiters;		/* client sockets... */
+	uint32_t* tags;		/* ...and the tag each of them used */
+	int waiterCount, waiterRoom;
+	unsigned long lastUsed;
+	struct Entry* next;
+} Entry;
+
+static Entry* entries;		/* oldest first, so queued ones go in order */
+static StarfishPoolRef pool;
+static StarfishPoolRef lanes[STARFISHD_INTERACTIVE + 1];	/* by priority */
+static int running[STARFISHD_INTERACTIVE + 1], runLimit;
+static int cacheLimit = DEFAULT_CACHE;
+static unsigned long useClock;
+static int wakePipe[2];
+
+/*
+Clients are never waited on: their sockets don't block, and each keeps
+whatever part of a request has come in so far until the rest arrives.
+*/
+typedef struct
+{
+	int fd;
+	size_t got;
+	StarfishRequest request;
+} Client;
+
+/* tree building draws on the one random number generator */
+static pthread_mutex_t randomLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int SameKey(const StarfishRequest* a, const StarfishRequest* b)
+{
+	return !memcmp((const char*) a + STARFISHD_KEY_OFFSET, (const char*) b + STARFISHD_KEY_OFFSET,
+		sizeof(StarfishRequest) - STARFISHD_KEY_OFFSET);
+}
+
+static int ValidRequest(const StarfishRequest* request)
+{
+	return request->magic == STARFISHD_MAGIC &&
+		request->width > 0 && request->width <= MAX_DIMENSION &&
+		request->height > 0 && request->height <= MAX_DIMENSION &&
+		(request->format == STARFISHD_RGBA || request->format == STARFISHD_PNG) &&
+		request->colourCount >= 0 && request->colourCount <= MAX_PALETTE_ENTRIES &&
+		request->priority <= STARFISHD_INTERACTIVE;
+}
+
+/*
+Results live in anonymous memory files. Where there is no memfd, an
+unlinked temporary file does the same job, just without the seals.
+*/
+static int NewResultFile(void)
+{
+#ifdef MFD_ALLOW_SEALING
+	int fd = memfd_create("starfish", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(fd >= 0) return fd;
+#endif
+	{
+		FILE* file = tmpfile();
+		int fd = file ? dup(fileno(file)) : -1;
+		if(file) fclose(file);
+		return fd;
+	}
+}
+
+static int WriteAll(int fd, const void* data, size_t size)
+{
+	const char* out = data;
+	while(size)
+	{
+		ssize_t wrote = write(fd, out, size);
+		if(wrote < 0 && errno == EINTR) continue;
+		if(wrote <= 0) return 0;
+		out += wrote;
+		size -= wrote;
+	}
+	return 1;
+}
+
+static void* RenderEntry(void* context)
+{
+	Entry* entry = context;
+	const StarfishRequest* request = &entry->request;
+	StarfishPalette palette;
+	RenderCacheKey key;
+	CachedRender cached;
+	StarfishRef texture = NULL;
+	pixel* rendered = NULL;
+	const pixel* pixels = NULL;
+	int fd = -1, ok = 0;
+
+	palette.colourcount = request->colourCount;
+	memcpy(palette.colour, request->colours, request->colourCount * sizeof(pixel));
+	InitRenderCacheKey(&key, request->seed, request->width, request->height, request->wrapEdges,
+		request->colourCount ? &palette : NULL);
+	if(FindCachedRender(&key, &cached)) pixels = cached.pixels;
+	else
+	{
+		cached.map = NULL;
+		pthread_mutex_lock(&randomLock);
+		srand(request->seed);
+		texture = MakeStarfish(request->width, request->height, request->colourCount ? &palette : NULL,
+			request->wrapEdges);
+		pthread_mutex_unlock(&randomLock);
+
+		if(texture) rendered = malloc((size_t) request->width * request->height * sizeof(pixel));
+		if(rendered)
+		{
+			RenderStarfish(texture, rendered, request->width, lanes[request->priority]);
+			StoreCachedRender(&key, rendered, request->width);
+			pixels = rendered;
+		}
+	}
+	if(pixels) fd = NewResultFile();
+	if(fd >= 0)
+	{
+		if(request->format == STARFISHD_PNG)
+		{
+			int copy = dup(fd);
+			FILE* file = (copy >= 0) ? fdopen(copy, "wb") : NULL;
+			if(file)
+			{
+				ok = WritePNGStream(file, pixels, request->width, request->height, request->width);
+				if(fclose(file) == EOF) ok = 0;
+			}
+			else if(copy >= 0) close(copy);
+		}
+		else ok = WriteAll(fd, pixels, (size_t) request->width * request->height * sizeof(pixel));
+	}
+	if(ok)
+	{
+		entry->size = lseek(fd, 0, SEEK_END);
+#ifdef F_ADD_SEALS
+		/* clients share this file; none of them may change it */
+		fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+		entry->fd = fd;
+		entry->status = 0;
+	}
+	else
+	{
+		if(fd >= 0) close(fd);
+		entry->status = pixels ? EIO : ENOMEM;
+	}
+	if(texture) DumpStarfish(texture);
+	free(rendered);
+	ReleaseCachedRender(&cached);
+
+	/* the main thread takes it from here */
+	WriteAll(wakePipe[1], &entry, sizeof(entry));
+	return NULL;
+}
+
+static void SendReply(int client, uint32_t tag, const Entry* entry, int status)
+{
+	StarfishReply reply;
+	struct msghdr message;
+	struct iovec part;
+	union
+	{
+		struct cmsghdr header;
+		char space[CMSG_SPACE(sizeof(int))];
+	} control;
+
+	memset(&reply, 0, sizeof(reply));
+	reply.magic = STARFISHD_MAGIC;
+	reply.tag = tag;
+	reply.status = entry ? entry->status : status;
+	memset(&message, 0, sizeof(message));
+	part.iov_base = &reply;
+	part.iov_len = sizeof(reply);
+	message.msg_iov = &part;
+	message.msg_iovlen = 1;
+	if(entry && !entry->status)
+	{
+		struct cmsghdr* header;
+		reply.width = entry->request.width;
+		reply.height = entry->request.height;
+		reply.format = entry->request.format;
+		reply.size = entry->size;
+		memset(&control, 0, sizeof(control));
+		message.msg_control = control.space;
+		message.msg_controllen = sizeof(control.space);
+		header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type = SCM_RIGHTS;
+		header->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(header), &entry->fd, sizeof(int));
+	}
+	/*
+	A client that has gone away will find out when it next reads. One
+	that has let its socket fill up with replies it hasn't read loses
+	this one, rather than holding up everybody else.
+	*/
+	while(sendmsg(client, &message, MSG_NOSIGNAL) < 0 && errno == EINTR)
+		;
+}
+
+static int AddWaiter(Entry* entry, int client, uint32_t tag)
+{
+	if(entry->waiterCount == entry->waiterRoom)
+	{
+		int room = entry->waiterRoom ? entry->waiterRoom * 2 : 4;
+		int* waiters = realloc(entry->waiters, room * sizeof(int));
+		uint32_t* tags;
+		if(!waiters) return 0;
+		entry->waiters = waiters;
+		tags = realloc(entry->tags, room * sizeof(uint32_t));
+		if(!tags) return 0;
+		entry->tags = tags;
+		entry->waiterRoom = room;
+	}
+	entry->waiters[entry->waiterCount] = client;
+	entry->tags[entry->waiterCount] = tag;
+	entry->waiterCount++;
+	return 1;
+}
+
+static void FreeEntry(Entry* entry)
+{
+	if(entry->fd >= 0) close(entry->fd);
+	free(entry->waiters);
+	free(entry->tags);
+	free(entry);
+}
+
+/*
+Start queued renders, oldest first, while there is room. Each priority
+has its own room, so interactive requests never wait for batch renders
+to finish; once they are running, the pool serves their tiles first.
+*/
+static void StartRenders(void)
+{
+	int priority;
+	for(priority = STARFISHD_INTERACTIVE; priority >= STARFISHD_BATCH; priority--)
+	{
+		Entry* entry;
+		for(entry = entries; entry && running[priority] < runLimit; entry = entry->next)
+		{
+			pthread_t thread;
+			if(entry->state != QUEUED || entry->request.priority != (uint32_t) priority) continue;
+			if(pthread_create(&thread, NULL, RenderEntry, entry)) break;
+			pthread_detach(thread);
+			entry->state = RUNNING;
+			running[priority]++;
+		}
+	}
+}
+
+/*
+Drop failures at once, and the least recently used results once there
+are more than the cache holds.
+*/
+static void TrimCache(void)
+{
+	for(;;)
+	{
+		Entry** link;
+		Entry** oldest = NULL;
+		int cached = 0;
+		for(link = &entries; *link; link = &(*link)->next)
+		{
+			Entry* entry = *link;
+			if(entry->state != DONE) continue;
+			if(entry->status)
+			{
+				oldest = link;
+				cached = cacheLimit + 1;
+				break;
+			}
+			cached++;
+			if(!oldest || entry->lastUsed < (*oldest)->lastUsed) oldest = link;
+		}
+		if(cached <= cacheLimit) return;
+		{
+			Entry* gone = *oldest;
+			*oldest = gone->next;
+			FreeEntry(gone);
+		}
+	}
+}
+
+static void Finished(Entry* entry)
+{
+	int i;
+	entry->state = DONE;
+	entry->lastUsed = ++useClock;
+	running[entry->request.priority]--;
+	for(i = 0; i < entry->waiterCount; i++)
+	{
+		if(entry->waiters[i] >= 0) SendReply(entry->waiters[i], entry->tags[i], entry, 0);
+	}
+	entry->waiterCount = 0;
+	StartRenders();
+	TrimCache();
+}
+
+static void HandleRequest(int client, const StarfishRequest* request)
+{
+	Entry** link;
+	Entry* entry;
+	if(!ValidRequest(request))
+	{
+		SendReply(client, request->tag, NULL, EINVAL);
+		return;
+	}
+	for(link = &entries; *link; link = &(*link)->next)
+	{
+		if(SameKey(&(*link)->request, request)) break;
+	}
+	entry = *link;
+	if(entry && entry->state == DONE)
+	{
+		entry->lastUsed = ++useClock;
+		SendReply(client, request->tag, entry, 0);
+		return;
+	}
+	if(!entry)
+	{
+		entry = calloc(1, sizeof(Entry));
+		if(!entry)
+		{
+			SendReply(client, request->tag, NULL, ENOMEM);
+			return;
+		}
+		entry->request = *request;
+		entry->state = QUEUED;
+		entry->fd = -1;
+		*link = entry;
+	}
+	/* too late once it is running: its tiles are already in the batch lane */
+	else if(entry->state == QUEUED && request->priority > entry->request.priority)
+		entry->request.priority = request->priority;
+	if(!AddWaiter(entry, client, request->tag))
+	{
+		SendReply(client, request->tag, NULL, ENOMEM);
+		return;
+	}
+	StartRenders();
+}
+
+/* a client has gone: nobody needs to answer it any more */
+static void ForgetClient(int client)
+{
+	Entry* entry;
+	int i;
+	for(entry = entries; entry; entry = entry->next)
+	{
+		for(i = 0; i < entry->waiterCount; i++)
+		{
+			if(entry->waiters[i] == client) entry->waiters[i] = -1;
+		}
+	}
+	close(client);
+}
+
+static int Listen(const char* path)
+{
+	struct sockaddr_un address;
+	int server, probe;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(address.sun_path)) return -1;
+	strcpy(address.sun_path, path);
+	/* a socket nobody answers on was left by a daemon that died */
+	probe = ConnectStarfishService(path);
+	if(probe >= 0)
+	{
+		close(probe);
+		fprintf(stderr, "starfishd: already running on %s\n", path);
+		return -1;
+	}
+	unlink(path);
+	server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(server < 0) return -1;
+	if(bind(server, (struct sockaddr*) &address, sizeof(address)) || listen(server, 16))
+	{
+		close(server);
+		return -1;
+	}
+	chmod(path, 0600);
+	return server;
+}
+
+static void usage(void)
+{
+	puts(
+		"starfishd: renders starfish patterns for local clients.\n"
+		"Usage: starfishd [options...]\n"
+		"-j,--threads:	number of render threads, one per processor by default.\n"
+		"--socket:	the socket to listen on; by default starfishd.sock in\n"
+		"		$XDG_RUNTIME_DIR, or /tmp/starfishd-UID.sock.\n"
+		"--cache:	how many finished patterns to keep, 32 by default.\n"
+		"--disk-cache:	megabytes of finished patterns to keep on disk, shared\n"
+		"		with xstarfish; 256 by default, 0 for none.\n"
+		"--batch-threads: most threads any one batch render may use, so\n"
+		"		some are always free for interactive ones; no limit by default.\n"
+		);
+}
+
+/*
+Take in whatever the client has sent, and act on its request once the
+whole of it is here. Returns zero when the client has gone.
+*/
+static int ReadClient(Client* client)
+{
+	ssize_t got = recv(client->fd, (char*) &client->request + client->got,
+		sizeof(client->request) - client->got, 0);
+	if(got < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	if(got == 0) return 0;
+	client->got += got;
+	if(client->got == sizeof(client->request))
+	{
+		client->got = 0;
+		HandleRequest(client->fd, &client->request);
+	}
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	struct pollfd watch[MAX_CLIENTS + 2];
+	static Client clients[MAX_CLIENTS];
+	int clientCount = 0;
+	int threads = 0, batchThreads = 0;
+	char defaultPath[108];
+	const char* path = NULL;
+	int server, ctr, i;
+
+	for(ctr = 1; ctr < argc; ctr++)
+	{
+		if((!strcmp(argv[ctr], "-j") || !strcmp(argv[ctr], "--threads")) && ctr + 1 < argc)
+			threads = atoi(argv[++ctr]);
+		else if(!strcmp(argv[ctr], "--socket") && ctr + 1 < argc)
+			path = argv[++ctr];
+		else if(!strcmp(argv[ctr], "--cache") && ctr + 1 < argc)
+			cacheLimit = atoi(argv[++ctr]);
+		else if(!strcmp(argv[ctr], "--disk-cache") && ctr + 1 < argc)
+			SetRenderCacheLimit((size_t) strtoul(argv[++ctr], NULL, 10) * 1024 * 1024);
+		else if(!strcmp(argv[ctr], "--batch-threads") && ctr + 1 < argc)
+			batchThreads = atoi(argv[++ctr]);
+		else
+		{
+			usage();
+			return !(!strcmp(argv[ctr], "-h") || !strcmp(argv[ctr], "--help"));
+		}
+	}
+	if(!path)
+	{
+		if(!StarfishServicePath(defaultPath, sizeof(defaultPath)))
+		{
+			fprintf(stderr, "starfishd: socket path is too long\n");
+			return 1;
+		}
+		path = defaultPath;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	server = Listen(path);
+	if(server < 0)
+	{
+		fprintf(stderr, "starfishd: could not listen on %s\n", path);
+		return 1;
+	}
+	if(pipe(wakePipe))
+	{
+		fprintf(stderr, "starfishd: could not make a pipe\n");
+		return 1;
+	}
+	pool = MakeStarfishPool(threads);
+	lanes[STARFISHD_BATCH] = MakeStarfishPoolLane(pool, STARFISH_PRIORITY_BATCH, batchThreads);
+	lanes[STARFISHD_INTERACTIVE] = MakeStarfishPoolLane(pool, STARFISH_PRIORITY_INTERACTIVE, 0);
+	/*
+	Each render's own thread builds the tree and encodes the result, and
+	pitches in on the pool while it waits; one per pool thread keeps
+	every processor busy without queueing up more than that. Interactive
+	renders get as many again of their own.
+	*/
+	runLimit = StarfishPoolThreads(pool);
+
+	for(;;)
+	{
+		int count = 0;
+		watch[count].fd = server;
+		watch[count++].events = (clientCount < MAX_CLIENTS) ? POLLIN : 0;
+		watch[count].fd = wakePipe[0];
+		watch[count++].events = POLLIN;
+		for(i = 0; i < clientCount; i++)
+		{
+			watch[count].fd = clients[i].fd;
+			watch[count++].events = POLLIN;
+		}
+		if(poll(watch, count, -1) < 0)
+		{
+			if(errno == EINTR) continue;
+			break;
+		}
+		if(watch[1].revents & POLLIN)
+		{
+			Entry* entry;
+			if(read(wakePipe[0], &entry, sizeof(entry)) == sizeof(entry)) Finished(entry);
+		}
+		for(i = clientCount - 1; i >= 0; i--)
+		{
+			if(!(watch[i + 2].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+			if(ReadClient(&clients[i])) continue;
+			ForgetClient(clients[i].fd);
+			clients[i] = clients[--clientCount];
+		}
+		if(watch[0].revents & POLLIN)
+		{
+			int client = accept4(server, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if(client >= 0)
+			{
+				clients[clientCount].fd = client;
+				clients[clientCount++].got = 0;
+			}
+		}
+	}
+	unlink(path);
+	DumpStarfishPool(lanes[STARFISHD_INTERACTIVE]);
+	DumpStarfishPool(lanes[STARFISHD_BATCH]);
+	DumpStarfishPool(pool);
+	return 1;
+}